@@ -1,5 +1,7 @@
+#include <QHostAddress>
 #include <QTcpSocket>
 #include "CommonUtils.hpp"
+#include "WireFormat.hpp"
 
 #pragma once
 
@@ -8,18 +10,36 @@
 class Client : public CommonUtils
 {
     public:
-        Client(const std::string &host, const short port);
+        // id is the MID of the smart reader
+        Client(const std::string &host, const short port, const std::string &id = "SmartReaderMID098735");
         ~Client() = default;
 
+        // the local address the connections are made from, the Gateway tells smart readers apart by it
+        void    setSource(const QHostAddress &source);
+        // whether failures are written to the console, on by default
+        void    setVerbose(bool verbose);
+        // what made the last registerToNAN or loginToNAN fail
+        const std::string   &getLastError() const { return this->lastError; }
+
         bool    registerToNAN();
-        bool    loginToNAN();
+        // a non empty trace is sent along, the steps of the login become its spans
+        bool    loginToNAN(const std::string &trace = "");
 
     protected:
         std::string getMyId() const override;
 
     private:
-        std::string host;
-        short       port;
+        bool    fail(const std::string &error);
+
+        std::string     host;
+        short           port;
+        std::string     id;
+        QHostAddress    source;
+        bool            verbose;
+        std::string     lastError;
+
+        // starts binary, falls back to legacy for a Gateway that does not know it
+        Wire::Format    format;
 
         std::string myRandom;
         std::string verifier;
@@ -0,0 +1,72 @@
+#include <atomic>
+#include <cstdint>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <QHostAddress>
+#include "Client.h"
+
+#pragma once
+
+/*
+    Load generator simulating many smart readers against a Gateway.
+
+    Every reader is a Client of its own MID, which it names when it logs in, connecting from its
+    own source address when one is given. They all register first, then log in again and again
+    for the duration:
+        - closed loop: concurrency threads each log a reader in as soon as the previous login ended
+        - open loop: logins arrive at rate per second whatever the answers, at most concurrency
+          in flight; a login waiting for a free thread counts that wait in its latency
+
+    The report is a single JSON object written to the standard output.
+*/
+class LoadGenerator
+{
+    public:
+        struct Settings
+        {
+            std::string     host = "127.0.0.1";
+            short           port = 4542;
+            int             readers = 64;
+            int             concurrency = 16;
+            double          rate = 0;           // logins per second, 0 for the closed loop
+            double          duration = 30;      // seconds of logins
+            QHostAddress    source;             // address of the first reader, the next ones follow it
+        };
+
+        explicit LoadGenerator(const Settings &settings);
+        ~LoadGenerator();
+
+        // false when no reader could register
+        bool    run();
+
+    private:
+        struct Reader
+        {
+            std::unique_ptr<Client> client;
+            std::mutex              lock;       // a reader runs a single exchange at a time
+            bool                    registered = false;
+        };
+
+        struct Phase;
+        struct Worker;
+
+        // runs body on concurrency threads, each with its own counters, and times the whole
+        void    runPhase(Phase &phase, const std::function<void(Worker &)> &body);
+        void    registerReaders(Worker &worker);
+        void    loginReaders(Worker &worker);
+        // one exchange of reader, its latency counted from arrival
+        void    exchange(Reader &reader, bool login, Worker &worker, std::chrono::steady_clock::time_point arrival);
+
+        static std::string  report(const Phase &phase);
+
+        Settings                                settings;
+        std::vector<std::unique_ptr<Reader>>    readers;
+        std::vector<Reader *>                   registered;
+        std::atomic<uint64_t>                   next;       // next reader to register, next login to start
+        std::chrono::steady_clock::time_point   start;
+        std::chrono::steady_clock::time_point   deadline;
+};
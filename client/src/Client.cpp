@@ -1,5 +1,4 @@
 #include <string>
-#include <sstream>
 #include <iostream>
 #include <future>
 #include <QTcpSocket>
@@ -8,12 +7,33 @@
 #include "Client.h"
 #include "QTimings.h"
 
-Client::Client(const std::string &host, short port) : CommonUtils(16, 80), host(host), port(port)
+Client::Client(const std::string &host, short port, const std::string &id) : CommonUtils(16, 80), host(host), port(port), id(id), verbose(true),
+    format(Wire::Format::Binary)
 {}
 
 std::string Client::getMyId() const
 {
-    return "SmartReaderMID098735";
+    return this->id;
+}
+
+void    Client::setSource(const QHostAddress &source)
+{
+    this->source = source;
+}
+
+void    Client::setVerbose(bool verbose)
+{
+    this->verbose = verbose;
+}
+
+bool    Client::fail(const std::string &error)
+{
+    this->lastError = error;
+    if (this->verbose)
+    {
+        std::cerr << "The server returned an error: " << error << std::endl;
+    }
+    return false;
 }
 
 bool    Client::registerToNAN()
@@ -24,70 +44,31 @@ bool    Client::registerToNAN()
     std::cout << "[REGISTER] bi == '" << bi << "' (" << QByteArray::fromStdString(bi).toHex().toStdString() << ")" << std::endl;
 #endif
 
-    std::ostringstream strs;
-
-    strs.str("");
-    strs.clear();
-
-    strs << mid << bi;
-
-    std::string aj = this->hash(strs.str(), "calcA");
+    Digest aj = (Hasher("calcA") << mid << bi).finalize();
 #ifdef PRINT_DEBUG
-    std::cout << "[REGISTER] aj == '" << aj << "' (" << QByteArray::fromStdString(aj).toHex().toStdString() << ")" << std::endl;
+    std::cout << "[REGISTER] aj == '" << aj.hex() << "'" << std::endl;
 #endif
 
-    QTcpSocket  socket;
-    QByteArray  output;
-
-    output.append('1');
-    output.append(QByteArray::fromStdString(mid).toBase64());
-    output.append(':');
-    output.append(QByteArray::fromStdString(aj).toBase64());
+    Wire::Message   reply;
 
     QTimings::getShared().start("send_register");
 
-    std::cout << "Connecting to " << this->host << ":" << this->port << " ..." << std::endl;
-    socket.connectToHost(QString::fromStdString(this->host), this->port);
-
-    if (!socket.waitForConnected())
+    if (!Wire::request(this->host, this->port, this->format, [&mid, &aj](Wire::Format format) {
+            return Wire::Writer(format, '1').add(mid).add(aj).data();
+        }, reply, this->source))
     {
-        std::cerr << "Error while connecting: " << socket.errorString().toStdString() << std::endl;
+        this->lastError = "ConnectionFailed";
         return false;
     }
 
-    socket.write(output);
-
-    if (!socket.waitForBytesWritten())
-    {
-        std::cerr << "Error while flushing: " << socket.errorString().toStdString() << std::endl;
-        socket.close();
-        return false;
-    }
-
-    if (!socket.waitForReadyRead())
-    {
-        std::cerr << "No informations to read: " << socket.errorString().toStdString() << std::endl;
-        socket.close();
-        return false;
-    }
-
-    QByteArray  rawResult = socket.readAll();
-
-    socket.disconnectFromHost();
-    socket.close();
-
     QTimings::getShared().stop("send_register");
 
-    if (rawResult.front() != '1')
+    if (reply.type != '1' || reply.fields.size() != 1)
     {
-        std::cerr << "The server returned an error: " << rawResult.toStdString() << std::endl;
-        return false;
+        return this->fail(reply.isError() ? reply.error() : "UnexpectedReply");
     }
 
-    rawResult.remove(0, 1);
-    QByteArray  result = QByteArray::fromBase64(rawResult);
-
-    std::string vm = result.toStdString();
+    std::string vm = reply.fields[0];
 #ifdef PRINT_DEBUG
     std::cout << "[REGISTER] vM == '" << vm << "' (" << QByteArray::fromStdString(vm).toHex().toStdString() << ")" << std::endl;
 #endif
@@ -97,16 +78,8 @@ bool    Client::registerToNAN()
     return true;
 }
 
-bool    Client::loginToNAN()
+bool    Client::loginToNAN(const std::string &trace)
 {
-
-    std::ostringstream strs;
-
-    strs.str("");
-    strs.clear();
-
-    strs << this->verifier << this->getMyId();
-
     std::string localTime = "TIME";
 
     std::string w = this->newRandom();
@@ -119,9 +92,9 @@ bool    Client::loginToNAN()
     std::cout << "[LOGIN] wP == '" << wP << "' (" << QByteArray::fromStdString(wP).toHex().toStdString() << ")" << std::endl;
 #endif
 
-    std::string hM = this->hash(strs.str(), "hash-cU");
+    Digest hM = (Hasher("hash-cU") << this->verifier << this->getMyId()).finalize();
 #ifdef PRINT_DEBUG
-    std::cout << "[LOGIN] hM == '" << hM << "' (" << QByteArray::fromStdString(hM).toHex().toStdString() << ")" << std::endl;
+    std::cout << "[LOGIN] hM == '" << hM.hex() << "'" << std::endl;
 #endif
 
     std::string cU = this->applyXOr(wP, hM, "xor-cU");
@@ -129,139 +102,79 @@ bool    Client::loginToNAN()
     std::cout << "[LOGIN] cU == '" << cU << "' (" << QByteArray::fromStdString(cU).toHex().toStdString() << ")" << std::endl;
 #endif
 
-    strs.str("");
-    strs.clear();
-
-    strs << wP << localTime;
-
-    std::string cid = this->applyXOr(this->hash(strs.str(), "hash-cid"), this->myRandom, "xor-cid");
+    std::string cid = this->applyXOr((Hasher("hash-cid") << wP << localTime).finalize(), this->myRandom, "xor-cid");
 #ifdef PRINT_DEBUG
     std::cout << "[LOGIN] cid == '" << cid << "' (" << QByteArray::fromStdString(cid).toHex().toStdString() << ")" << std::endl;
 #endif
 
-    strs.str("");
-    strs.clear();
-
-    strs << cid << this->myRandom << wP;
-
-    std::string c1 = this->hash(strs.str(), "hash-c1");
+    Digest c1 = (Hasher("hash-c1") << cid << this->myRandom << wP).finalize();
 #ifdef PRINT_DEBUG
-    std::cout << "[LOGIN] C1 == '" << c1 << "' (" << QByteArray::fromStdString(c1).toHex().toStdString() << ")" << std::endl;
+    std::cout << "[LOGIN] C1 == '" << c1.hex() << "'" << std::endl;
 #endif
 
-    QTcpSocket  socket;
-    QByteArray  output;
-
-    output.append('2');
-    output.append(QByteArray::fromStdString(cU).toBase64());
-    output.append(':');
-    output.append(QByteArray::fromStdString(cid).toBase64());
-    output.append(':');
-    output.append(QByteArray::fromStdString(c1).toBase64());
-    output.append(':');
-    output.append(QByteArray::fromStdString(localTime).toBase64());
+    Wire::Message   reply;
 
     QTimings::getShared().start("send_login");
 
-    socket.connectToHost(QString::fromStdString(this->host), this->port);
-
-    if (!socket.waitForConnected())
+    // the trace id, empty when there is none, then the mid so that the Gateway tells apart readers sharing an address
+    if (!Wire::request(this->host, this->port, this->format, [this, &cU, &cid, &c1, &localTime, &trace](Wire::Format format) {
+            return Wire::Writer(format, '2').add(cU).add(cid).add(c1).add(localTime).add(trace).add(this->getMyId()).data();
+        }, reply, this->source))
     {
-        std::cerr << "Error while connecting: " << socket.errorString().toStdString() << std::endl;
+        this->lastError = "ConnectionFailed";
         return false;
     }
 
-    socket.write(output);
-
-    if (!socket.waitForBytesWritten())
-    {
-        std::cerr << "Error while flushing: " << socket.errorString().toStdString() << std::endl;
-        socket.close();
-        return false;
-    }
+    QTimings::getShared().stop("send_login");
 
-    if (!socket.waitForReadyRead())
+    if (reply.type != '2' || reply.fields.size() != 7)
     {
-        std::cerr << "No informations to read: " << socket.errorString().toStdString() << std::endl;
-        socket.close();
-        return false;
+        return this->fail(reply.isError() ? reply.error() : "UnexpectedReply");
     }
 
-    QByteArray  rawResult = socket.readAll();
+    const std::string &cS = reply.fields[1];
+    const std::string &t3 = reply.fields[2];
+    const std::string &cM = reply.fields[4];
+    const std::string &t4 = reply.fields[5];
+    const std::string &rid = reply.fields[6];
+    Digest  c4;
 
-    socket.disconnectFromHost();
-    socket.close();
-
-    QTimings::getShared().stop("send_login");
-
-    if (rawResult.front() != '2')
+    if (!Wire::readDigest(reply.format, reply.fields[3], c4))
     {
-        std::cerr << "The server returned an error: " << rawResult.toStdString() << std::endl;
-        return false;
+        return this->fail("UnexpectedReply");
     }
 
-    rawResult.remove(0, 1);
-    QList<QByteArray> splitted = rawResult.split(':');
-
-    std::string c3 = QByteArray::fromBase64(splitted[0]).toStdString();
-    std::string cS = QByteArray::fromBase64(splitted[1]).toStdString();
-    std::string t3 = QByteArray::fromBase64(splitted[2]).toStdString();
-    std::string c4 = QByteArray::fromBase64(splitted[3]).toStdString();
-    std::string cM = QByteArray::fromBase64(splitted[4]).toStdString();
-    std::string t4 = QByteArray::fromBase64(splitted[5]).toStdString();
-    std::string rid = QByteArray::fromBase64(splitted[6]).toStdString();
-
-    strs.str("");
-    strs.clear();
-
-    strs << this->verifier << this->getMyId();
-
-    std::string hashVmMID = this->hash(strs.str(), "hash-VmMID");
+    Digest hashVmMID = (Hasher("hash-VmMID") << this->verifier << this->getMyId()).finalize();
 
     std::string yP = this->applyXOr(cS, hashVmMID, "xor-yP");
 #ifdef PRINT_DEBUG
     std::cout << "[LOGIN] yP == '" << yP << "' (" << QByteArray::fromStdString(yP).toHex().toStdString() << ")" << std::endl;
 #endif
 
-    strs.str("");
-    strs.clear();
-
-    strs << cM << hashVmMID;
-
-    std::string bj = this->applyXOr(this->hash(strs.str(), "hash-bj"), rid, "xor-bj");
+    std::string bj = this->applyXOr((Hasher("hash-bj") << cM << hashVmMID).finalize(), rid, "xor-bj");
 #ifdef PRINT_DEBUG
     std::cout << "[LOGIN] bj == '" << bj << "' (" << QByteArray::fromStdString(bj).toHex().toStdString() << ")" << std::endl;
 #endif
 
-    strs.str("");
-    strs.clear();
-
-    strs << yP << wP << this->myRandom << bj;
-
-    std::string SKm = this->hash(strs.str(), "hash-SKm");
+    Digest SKm = (Hasher("hash-SKm") << yP << wP << this->myRandom << bj).finalize();
 #ifdef PRINT_DEBUG
-    std::cout << "[LOGIN] SKm == '" << SKm << "' (" << QByteArray::fromStdString(SKm).toHex().toStdString() << ")" << std::endl;
+    std::cout << "[LOGIN] SKm == '" << SKm.hex() << "'" << std::endl;
 #endif
 
-    strs.str("");
-    strs.clear();
-
-    strs << SKm << t3 << yP;
-
-    std::string c3_bis = this->hash(strs.str(), "hash-c3'");
+    Digest c3_bis = (Hasher("hash-c3'") << SKm << t3 << yP).finalize();
 #ifdef PRINT_DEBUG
-    std::cout << "[LOGIN] C3' == '" << c3_bis << "' (" << QByteArray::fromStdString(c3_bis).toHex().toStdString() << ")" << std::endl;
+    std::cout << "[LOGIN] C3' == '" << c3_bis.hex() << "'" << std::endl;
 #endif
 
-    strs.str("");
-    strs.clear();
-
-    strs << c3_bis << t4 << cM << bj;
-
-    std::string c4_bis = this->hash(strs.str(), "hash-c4'");
+    Digest c4_bis = (Hasher("hash-c4'") << c3_bis << t4 << cM << bj).finalize();
 #ifdef PRINT_DEBUG
-    std::cout << "[LOGIN] C4' == '" << c4_bis << "' (" << QByteArray::fromStdString(c4_bis).toHex().toStdString() << ")" << std::endl;
+    std::cout << "[LOGIN] C4' == '" << c4_bis.hex() << "'" << std::endl;
 #endif
 
-    return (c4_bis.compare(c4) == 0);
+    if (c4_bis != c4)
+    {
+        this->lastError = "VerificationFailed";
+        return false;
+    }
+    return true;
 }
@@ -0,0 +1,237 @@
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <thread>
+#include "LoadGenerator.h"
+#include "Histogram.hpp"
+#include "QTimings.h"
+#include "Trace.hpp"
+#include "WireFormat.hpp"
+
+struct LoadGenerator::Worker
+{
+    Histogram                       latencies;
+    uint64_t                        succeeded = 0;
+    std::map<std::string, uint64_t> errors;
+};
+
+struct LoadGenerator::Phase
+{
+    std::vector<std::unique_ptr<Worker>>    workers;
+    double                                  seconds = 0;
+};
+
+LoadGenerator::LoadGenerator(const Settings &settings) : settings(settings), next(0)
+{
+    this->settings.readers = std::max(this->settings.readers, 1);
+    this->settings.concurrency = std::max(this->settings.concurrency, 1);
+
+    quint32 source = this->settings.source.toIPv4Address();
+
+    for (int i = 0; i < this->settings.readers; ++i)
+    {
+        std::unique_ptr<Reader> reader(new Reader);
+
+        reader->client.reset(new Client(this->settings.host, this->settings.port, "SmartReaderMID" + std::to_string(100000 + i)));
+        reader->client->setVerbose(false);
+        if (source != 0)
+        {
+            reader->client->setSource(QHostAddress(source + static_cast<quint32>(i)));
+        }
+        this->readers.push_back(std::move(reader));
+    }
+}
+
+LoadGenerator::~LoadGenerator() = default;
+
+bool    LoadGenerator::run()
+{
+    Phase   registration;
+    Phase   login;
+
+    Wire::setVerbose(false);
+
+    std::cerr << "Registering " << this->readers.size() << " readers..." << std::endl;
+    this->next = 0;
+    this->runPhase(registration, [this](Worker &worker) { this->registerReaders(worker); });
+
+    for (const std::unique_ptr<Reader> &reader : this->readers)
+    {
+        if (reader->registered)
+        {
+            this->registered.push_back(reader.get());
+        }
+    }
+
+    if (!this->registered.empty())
+    {
+        std::cerr << "Logging " << this->registered.size() << " readers in for " << this->settings.duration << " s..." << std::endl;
+        this->next = 0;
+        this->start = std::chrono::steady_clock::now();
+        this->deadline = this->start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(this->settings.duration));
+        this->runPhase(login, [this](Worker &worker) { this->loginReaders(worker); });
+    }
+
+    std::ostringstream  out;
+
+    out << "{\"host\":\"" << this->settings.host << ":" << this->settings.port << "\""
+        << ",\"mode\":\"" << (this->settings.rate > 0 ? "open" : "closed") << "\""
+        << ",\"readers\":" << this->readers.size()
+        << ",\"concurrency\":" << this->settings.concurrency
+        << ",\"rate\":" << this->settings.rate
+        << ",\"duration\":" << this->settings.duration
+        << ",\"register\":" << LoadGenerator::report(registration)
+        << ",\"login\":" << LoadGenerator::report(login) << "}";
+    std::cout << out.str() << std::endl;
+
+    if (this->registered.empty())
+    {
+        std::cerr << "No reader could register" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void    LoadGenerator::runPhase(Phase &phase, const std::function<void(Worker &)> &body)
+{
+    std::vector<std::thread>                threads;
+    std::chrono::steady_clock::time_point   begin = std::chrono::steady_clock::now();
+
+    for (int i = 0; i < this->settings.concurrency; ++i)
+    {
+        phase.workers.emplace_back(new Worker);
+    }
+    for (const std::unique_ptr<Worker> &worker : phase.workers)
+    {
+        Worker *current = worker.get();
+        threads.emplace_back([&body, current]() { body(*current); });
+    }
+    for (std::thread &thread : threads)
+    {
+        thread.join();
+    }
+    phase.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+}
+
+void    LoadGenerator::registerReaders(Worker &worker)
+{
+    for (uint64_t i = this->next++; i < this->readers.size(); i = this->next++)
+    {
+        this->exchange(*this->readers[i], false, worker, std::chrono::steady_clock::now());
+    }
+}
+
+void    LoadGenerator::loginReaders(Worker &worker)
+{
+    while (true)
+    {
+        uint64_t                                i = this->next++;
+        std::chrono::steady_clock::time_point   arrival = std::chrono::steady_clock::now();
+
+        // the open loop schedules login i at start + i / rate, late or not
+        if (this->settings.rate > 0)
+        {
+            arrival = this->start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(i / this->settings.rate));
+            if (arrival >= this->deadline)
+            {
+                return;
+            }
+            std::this_thread::sleep_until(arrival);
+        }
+        else if (arrival >= this->deadline)
+        {
+            return;
+        }
+
+        this->exchange(*this->registered[i % this->registered.size()], true, worker, arrival);
+    }
+}
+
+void    LoadGenerator::exchange(Reader &reader, bool login, Worker &worker, std::chrono::steady_clock::time_point arrival)
+{
+    std::lock_guard<std::mutex> lock(reader.lock);
+    bool                        succeeded;
+
+    if (login)
+    {
+        std::string             trace = Trace::enabled() ? Trace::newId() : std::string();
+        QTimings::TraceScope    traceScope(QTimings::getShared(), { trace });
+
+        succeeded = reader.client->loginToNAN(trace);
+    }
+    else
+    {
+        succeeded = reader.registered = reader.client->registerToNAN();
+    }
+
+    std::chrono::steady_clock::duration latency = std::chrono::steady_clock::now() - arrival;
+
+    // the timings of every exchange would pile up otherwise
+    QTimings::getShared().reset();
+
+    if (succeeded)
+    {
+        ++worker.succeeded;
+        worker.latencies.record(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(latency).count()));
+    }
+    else
+    {
+        ++worker.errors[reader.client->getLastError()];
+    }
+}
+
+std::string LoadGenerator::report(const Phase &phase)
+{
+    std::vector<uint64_t>           totals(Histogram::bucketCount, 0);
+    std::map<std::string, uint64_t> errors;
+    uint64_t                        succeeded = 0;
+    uint64_t                        failed = 0;
+    uint64_t                        max = 0;
+
+    for (const std::unique_ptr<Worker> &worker : phase.workers)
+    {
+        worker->latencies.addTo(totals);
+        succeeded += worker->succeeded;
+        for (const auto &error : worker->errors)
+        {
+            errors[error.first] += error.second;
+            failed += error.second;
+        }
+    }
+    for (std::size_t i = 0; i < totals.size(); ++i)
+    {
+        if (totals[i] != 0)
+        {
+            max = Histogram::highest(i);
+        }
+    }
+
+    std::ostringstream  out;
+
+    // latencies in milliseconds, of the successful exchanges
+    out << "{\"succeeded\":" << succeeded
+        << ",\"failed\":" << failed
+        << ",\"seconds\":" << phase.seconds
+        << ",\"throughput\":" << (phase.seconds > 0 ? succeeded / phase.seconds : 0)
+        << ",\"latency_ms\":{\"p50\":" << Histogram::percentile(totals, 0.5) / 1e6
+        << ",\"p90\":" << Histogram::percentile(totals, 0.9) / 1e6
+        << ",\"p99\":" << Histogram::percentile(totals, 0.99) / 1e6
+        << ",\"p999\":" << Histogram::percentile(totals, 0.999) / 1e6
+        << ",\"max\":" << max / 1e6 << "}"
+        << ",\"errors\":{";
+    for (auto it = errors.begin(); it != errors.end(); ++it)
+    {
+        std::string name;
+        for (char c : it->first)
+        {
+            if (c == '"' || c == '\\')
+            {
+                name += '\\';
+            }
+            name += c;
+        }
+        out << (it == errors.begin() ? "" : ",") << "\"" << name << "\":" << it->second;
+    }
+    out << "}}";
+    return out.str();
+}
@@ -1,10 +1,66 @@
 #include <iostream>
+#include <QCoreApplication>
+#include <QCommandLineParser>
 #include "Client.h"
+#include "LoadGenerator.h"
 #include "QTimings.h"
+#include "Trace.hpp"
 
-int main()
+int main(int argc, char **argv)
 {
-    Client cli("127.0.0.1", 4542);
+    QCoreApplication app(argc, argv);
+    QCommandLineParser parser;
+    QCommandLineOption hostOption("host", "Address of the Gateway (default: 127.0.0.1).", "host", "127.0.0.1");
+    QCommandLineOption portOption("port", "Port of the Gateway (default: 4542).", "port", "4542");
+    QCommandLineOption loadOption("load", "Simulate many smart readers and report throughput and latencies as JSON.");
+    QCommandLineOption readersOption("readers", "Smart readers simulated by --load (default: 64).", "count", "64");
+    QCommandLineOption concurrencyOption("concurrency", "Exchanges in flight with --load (default: 16).", "count", "16");
+    QCommandLineOption rateOption("rate", "Logins started per second with --load, 0 logs in again as soon as a login ends (default: 0).", "per-second", "0");
+    QCommandLineOption durationOption("duration", "Seconds of logins with --load (default: 30).", "seconds", "30");
+    QCommandLineOption sourceOption("source", "Local address of the first simulated reader, the next ones follow it (default: 127.1.0.1 for a local Gateway).", "address");
+
+    parser.addHelpOption();
+    parser.addOption(hostOption);
+    parser.addOption(portOption);
+    parser.addOption(loadOption);
+    parser.addOption(readersOption);
+    parser.addOption(concurrencyOption);
+    parser.addOption(rateOption);
+    parser.addOption(durationOption);
+    parser.addOption(sourceOption);
+    parser.process(app);
+
+    Trace::setProcess("client");
+
+    std::string host = parser.value(hostOption).toStdString();
+    short       port = static_cast<short>(parser.value(portOption).toInt());
+
+    if (parser.isSet(loadOption))
+    {
+        LoadGenerator::Settings settings;
+
+        settings.host = host;
+        settings.port = port;
+        settings.readers = parser.value(readersOption).toInt();
+        settings.concurrency = parser.value(concurrencyOption).toInt();
+        settings.rate = parser.value(rateOption).toDouble();
+        settings.duration = parser.value(durationOption).toDouble();
+
+        // the readers name themselves at login, their own addresses only spread the connections.
+        // The whole 127/8 reaches a local Gateway
+        if (parser.isSet(sourceOption))
+        {
+            settings.source = QHostAddress(parser.value(sourceOption));
+        }
+        else if (QHostAddress(parser.value(hostOption)).isLoopback())
+        {
+            settings.source = QHostAddress(QString("127.1.0.1"));
+        }
+
+        return LoadGenerator(settings).run() ? 0 : 1;
+    }
+
+    Client cli(host, port);
 
     QTimings::getShared().start("register");
 
@@ -20,7 +76,15 @@ int main()
 
     QTimings::getShared().stopAndStart("register", "login");
 
-    if (cli.loginToNAN())
+    std::string             trace = Trace::enabled() ? Trace::newId() : std::string();
+    QTimings::TraceScope    traceScope(QTimings::getShared(), { trace });
+
+    if (!trace.empty())
+    {
+        std::cout << "Login trace " << trace << std::endl;
+    }
+
+    if (cli.loginToNAN(trace))
     {
         std::cout << "OKAY !!! Logged In !" << std::endl;
     }
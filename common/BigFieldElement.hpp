@@ -0,0 +1,464 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include "FiniteFieldElement.hpp"
+
+namespace Cryptography
+{
+        /*
+            An element of a prime field Fp too big for a machine integer, stored in N 64 bits limbs
+            (little endian), for the curves used in practice: N = 4 for 256 bits primes.
+            Allows the same operations as FiniteFieldElement so that EllipticCurve can use it:
+                typedef EllipticCurve<0, BigFieldElement<4, Secp256k1Prime> > secp256k1_t;
+
+            Template parameter M describes the prime:
+                static const std::uint64_t* modulus();  its N limbs, little endian
+                static const std::uint64_t  c;          p = 2^(64N) - c for a pseudo-Mersenne prime, 0 otherwise
+
+            Products are reduced by folding the high half times c for a pseudo-Mersenne prime,
+            by Montgomery multiplication otherwise; in the latter case elements are stored in
+            Montgomery form (a*2^(64N) mod p), converted when built from and printed as integers.
+
+            NOTE: relies on the unsigned __int128 extension of gcc and clang. Not constant time.
+        */
+        template<int N, class M>
+        class   BigFieldElement
+        {
+            typedef unsigned __int128   wide_t;
+
+            std::uint64_t   l_[N];
+
+            // precomputed Montgomery constants of the prime
+            struct  Constants
+            {
+                std::uint64_t   r2[N];      // 2^(128N) mod p
+                std::uint64_t   n0;         // -p^-1 mod 2^64
+
+                Constants()
+                {
+                    const std::uint64_t* p = M::modulus();
+
+                    // 2^(128N) mod p by doubling 1 mod p
+                    std::uint64_t one[N] = { 1 };
+                    for ( int n = 0; n < N; ++n ) r2[n] = one[n];
+                    for ( int n = 0; n < 128*N; ++n ) addMod(r2, r2, r2);
+
+                    // Newton iteration, each step doubles the number of correct bits
+                    std::uint64_t inv = p[0];
+                    for ( int n = 0; n < 6; ++n ) inv *= 2 - p[0]*inv;
+                    n0 = ~inv + 1;
+                }
+            };
+
+            static const Constants& constants()
+            {
+                static const Constants k;
+                return k;
+            }
+
+            static bool    pseudoMersenne() { return M::c != 0; }
+
+            // a >= p
+            static bool    geq(const std::uint64_t* a, const std::uint64_t* p)
+            {
+                for ( int n = N - 1; n >= 0; --n )
+                {
+                    if ( a[n] != p[n] )
+                    {
+                        return a[n] > p[n];
+                    }
+                }
+                return true;
+            }
+
+            // r = a - b, returns the borrow
+            static std::uint64_t   sub(std::uint64_t* r, const std::uint64_t* a, const std::uint64_t* b)
+            {
+                std::uint64_t borrow = 0;
+                for ( int n = 0; n < N; ++n )
+                {
+                    wide_t d = wide_t(a[n]) - b[n] - borrow;
+                    r[n] = static_cast<std::uint64_t>(d);
+                    borrow = static_cast<std::uint64_t>(d >> 64) & 1;
+                }
+                return borrow;
+            }
+
+            // r = a + b, returns the carry
+            static std::uint64_t   add(std::uint64_t* r, const std::uint64_t* a, const std::uint64_t* b)
+            {
+                std::uint64_t carry = 0;
+                for ( int n = 0; n < N; ++n )
+                {
+                    wide_t s = wide_t(a[n]) + b[n] + carry;
+                    r[n] = static_cast<std::uint64_t>(s);
+                    carry = static_cast<std::uint64_t>(s >> 64);
+                }
+                return carry;
+            }
+
+            // r = a + b mod p
+            static void    addMod(std::uint64_t* r, const std::uint64_t* a, const std::uint64_t* b)
+            {
+                if ( add(r, a, b) != 0 || geq(r, M::modulus()) )
+                {
+                    sub(r, r, M::modulus());
+                }
+            }
+
+            // r = a - b mod p
+            static void    subMod(std::uint64_t* r, const std::uint64_t* a, const std::uint64_t* b)
+            {
+                if ( sub(r, a, b) != 0 )
+                {
+                    add(r, r, M::modulus());
+                }
+            }
+
+            // r = a*b*2^-(64N) mod p (CIOS)
+            static void    montgomery(std::uint64_t* r, const std::uint64_t* a, const std::uint64_t* b)
+            {
+                const std::uint64_t* p = M::modulus();
+                const std::uint64_t n0 = constants().n0;
+                std::uint64_t t[N + 2] = { 0 };
+
+                for ( int i = 0; i < N; ++i )
+                {
+                    std::uint64_t carry = 0;
+                    for ( int j = 0; j < N; ++j )
+                    {
+                        wide_t s = wide_t(a[j])*b[i] + t[j] + carry;
+                        t[j] = static_cast<std::uint64_t>(s);
+                        carry = static_cast<std::uint64_t>(s >> 64);
+                    }
+                    wide_t s = wide_t(t[N]) + carry;
+                    t[N] = static_cast<std::uint64_t>(s);
+                    t[N + 1] = static_cast<std::uint64_t>(s >> 64);
+
+                    std::uint64_t m = t[0]*n0;
+                    s = wide_t(m)*p[0] + t[0];
+                    carry = static_cast<std::uint64_t>(s >> 64);
+                    for ( int j = 1; j < N; ++j )
+                    {
+                        s = wide_t(m)*p[j] + t[j] + carry;
+                        t[j - 1] = static_cast<std::uint64_t>(s);
+                        carry = static_cast<std::uint64_t>(s >> 64);
+                    }
+                    s = wide_t(t[N]) + carry;
+                    t[N - 1] = static_cast<std::uint64_t>(s);
+                    t[N] = t[N + 1] + static_cast<std::uint64_t>(s >> 64);
+                }
+
+                for ( int n = 0; n < N; ++n ) r[n] = t[n];
+                if ( t[N] != 0 || geq(r, p) )
+                {
+                    sub(r, r, p);
+                }
+            }
+
+            // r = a*b mod p for p = 2^(64N) - c: 2^(64N) is c mod p, so the high half folds onto the low one
+            static void    fold(std::uint64_t* r, const std::uint64_t* a, const std::uint64_t* b)
+            {
+                std::uint64_t w[2*N] = { 0 };
+
+                for ( int i = 0; i < N; ++i )
+                {
+                    std::uint64_t carry = 0;
+                    for ( int j = 0; j < N; ++j )
+                    {
+                        wide_t s = wide_t(a[j])*b[i] + w[i + j] + carry;
+                        w[i + j] = static_cast<std::uint64_t>(s);
+                        carry = static_cast<std::uint64_t>(s >> 64);
+                    }
+                    w[i + N] = carry;
+                }
+
+                // low + high*c, at most N limbs and a small top one
+                std::uint64_t carry = 0;
+                for ( int n = 0; n < N; ++n )
+                {
+                    wide_t s = wide_t(w[N + n])*M::c + w[n] + carry;
+                    r[n] = static_cast<std::uint64_t>(s);
+                    carry = static_cast<std::uint64_t>(s >> 64);
+                }
+
+                // fold the top limb again, and once more if that overflows
+                wide_t s = wide_t(carry)*M::c;
+                while ( s != 0 )
+                {
+                    for ( int n = 0; n < N && s != 0; ++n )
+                    {
+                        s += r[n];
+                        r[n] = static_cast<std::uint64_t>(s);
+                        s >>= 64;
+                    }
+                    s *= M::c;
+                }
+
+                while ( geq(r, M::modulus()) )
+                {
+                    sub(r, r, M::modulus());
+                }
+            }
+
+            static void    multiply(std::uint64_t* r, const std::uint64_t* a, const std::uint64_t* b)
+            {
+                if ( pseudoMersenne() )
+                {
+                    fold(r, a, b);
+                }
+                else
+                {
+                    montgomery(r, a, b);
+                }
+            }
+
+            // from an integer to the stored form
+            void    assign(std::uint64_t* v)
+            {
+                while ( geq(v, M::modulus()) )
+                {
+                    sub(v, v, M::modulus());
+                }
+                if ( pseudoMersenne() )
+                {
+                    for ( int n = 0; n < N; ++n ) l_[n] = v[n];
+                }
+                else
+                {
+                    montgomery(l_, v, constants().r2);
+                }
+            }
+
+            public:
+                // ctor
+                BigFieldElement()
+                {
+                    for ( int n = 0; n < N; ++n ) l_[n] = 0;
+                }
+                // ctor
+                explicit BigFieldElement(int i)
+                {
+                    std::uint64_t v[N] = { 0 };
+                    v[0] = static_cast<std::uint64_t>(i < 0 ? -static_cast<std::int64_t>(i) : i);
+                    if ( i < 0 )
+                    {
+                        // (-i) mod p
+                        sub(v, M::modulus(), v);
+                    }
+                    assign(v);
+                }
+
+                // from big endian hexadecimal digits, anything else in hex is skipped
+                static BigFieldElement  fromHex(const std::string& hex)
+                {
+                    std::uint64_t v[N] = { 0 };
+                    int bit = 0;
+                    for ( std::string::const_reverse_iterator it = hex.rbegin(); it != hex.rend() && bit < 64*N; ++it )
+                    {
+                        char c = *it;
+                        int digit = (c >= '0' && c <= '9') ? c - '0' : (c >= 'a' && c <= 'f') ? c - 'a' + 10 : (c >= 'A' && c <= 'F') ? c - 'A' + 10 : -1;
+                        if ( digit < 0 )
+                        {
+                            continue;
+                        }
+                        v[bit/64] |= std::uint64_t(digit) << (bit%64);
+                        bit += 4;
+                    }
+                    BigFieldElement e;
+                    e.assign(v);
+                    return e;
+                }
+
+                // big endian hexadecimal digits of the integer
+                std::string toHex() const
+                {
+                    static const char digits[] = "0123456789abcdef";
+                    std::uint64_t v[N];
+                    integer(v);
+
+                    std::string hex;
+                    for ( int n = N - 1; n >= 0; --n )
+                    {
+                        for ( int shift = 60; shift >= 0; shift -= 4 )
+                        {
+                            hex += digits[(v[n] >> shift) & 0xf];
+                        }
+                    }
+                    return hex;
+                }
+
+                // the little endian limbs of the integer
+                void    integer(std::uint64_t* v) const
+                {
+                    if ( pseudoMersenne() )
+                    {
+                        for ( int n = 0; n < N; ++n ) v[n] = l_[n];
+                    }
+                    else
+                    {
+                        std::uint64_t one[N] = { 1 };
+                        montgomery(v, l_, one);
+                    }
+                }
+
+                // a^-1 = a^(p-2), 0 for 0
+                BigFieldElement inverse() const
+                {
+                    std::uint64_t e[N];
+                    std::uint64_t two[N] = { 2 };
+                    sub(e, M::modulus(), two);
+
+                    BigFieldElement r(1);
+                    for ( int n = 64*N - 1; n >= 0; --n )
+                    {
+                        r *= r;
+                        if ( (e[n/64] >> (n%64)) & 1 )
+                        {
+                            r *= *this;
+                        }
+                    }
+                    return r;
+                }
+
+                // negate
+                BigFieldElement  operator-() const
+                {
+                    BigFieldElement r;
+                    if ( *this != 0 )
+                    {
+                        sub(r.l_, M::modulus(), l_);
+                    }
+                    return r;
+                }
+                // assign from integer
+                BigFieldElement& operator=(int i)
+                {
+                    return (*this = BigFieldElement(i));
+                }
+                // *=
+                BigFieldElement& operator*=(const BigFieldElement& rhs)
+                {
+                    multiply(l_, l_, rhs.l_);
+                    return *this;
+                }
+                // ==
+                friend bool    operator==(const BigFieldElement& lhs, const BigFieldElement& rhs)
+                {
+                    for ( int n = 0; n < N; ++n )
+                    {
+                        if ( lhs.l_[n] != rhs.l_[n] )
+                        {
+                            return false;
+                        }
+                    }
+                    return true;
+                }
+                // == int, comparing to 0 (the same in both forms) is the common case
+                friend bool    operator==(const BigFieldElement& lhs, int rhs)
+                {
+                    if ( rhs == 0 )
+                    {
+                        std::uint64_t bits = 0;
+                        for ( int n = 0; n < N; ++n ) bits |= lhs.l_[n];
+                        return bits == 0;
+                    }
+                    return lhs == BigFieldElement(rhs);
+                }
+                // !=
+                friend bool    operator!=(const BigFieldElement& lhs, int rhs)
+                {
+                    return !(lhs == rhs);
+                }
+                // a / b
+                friend BigFieldElement operator/(const BigFieldElement& lhs, const BigFieldElement& rhs)
+                {
+                    return lhs*rhs.inverse();
+                }
+                // a + b
+                friend BigFieldElement operator+(const BigFieldElement& lhs, const BigFieldElement& rhs)
+                {
+                    BigFieldElement r;
+                    addMod(r.l_, lhs.l_, rhs.l_);
+                    return r;
+                }
+                // a - b
+                friend BigFieldElement operator-(const BigFieldElement& lhs, const BigFieldElement& rhs)
+                {
+                    BigFieldElement r;
+                    subMod(r.l_, lhs.l_, rhs.l_);
+                    return r;
+                }
+                // a + int
+                friend BigFieldElement operator+(const BigFieldElement& lhs, int i)
+                {
+                    return lhs + BigFieldElement(i);
+                }
+                // int + a
+                friend BigFieldElement operator+(int i, const BigFieldElement& rhs)
+                {
+                    return rhs + BigFieldElement(i);
+                }
+                // int * a, by additions for the small constants of the curve formulas
+                friend BigFieldElement operator*(int n, const BigFieldElement& rhs)
+                {
+                    if ( n < 0 || n > 16 )
+                    {
+                        return BigFieldElement(n)*rhs;
+                    }
+                    BigFieldElement r;
+                    BigFieldElement d = rhs;
+                    for ( ; n != 0; n >>= 1 )
+                    {
+                        if ( n & 1 )
+                        {
+                            r = r + d;
+                        }
+                        d = d + d;
+                    }
+                    return r;
+                }
+                // a * b
+                friend BigFieldElement operator*(const BigFieldElement& lhs, const BigFieldElement& rhs)
+                {
+                    BigFieldElement r;
+                    multiply(r.l_, lhs.l_, rhs.l_);
+                    return r;
+                }
+                // ostream handler
+                friend  std::ostream&    operator<<(std::ostream& os, const BigFieldElement& g)
+                {
+                    return os << "0x" << g.toHex();
+                }
+        };
+
+        // p = 2^256 - 2^32 - 977, the field of secp256k1 (y^2 = x^3 + 7)
+        struct  Secp256k1Prime
+        {
+            static const std::uint64_t* modulus()
+            {
+                static const std::uint64_t p[4] = { 0xFFFFFFFEFFFFFC2FULL, 0xFFFFFFFFFFFFFFFFULL, 0xFFFFFFFFFFFFFFFFULL, 0xFFFFFFFFFFFFFFFFULL };
+                return p;
+            }
+            static const std::uint64_t  c = 0x1000003D1ULL;
+        };
+
+        // p = 2^256 - 2^224 + 2^192 + 2^96 - 1, the field of NIST P-256 (y^2 = x^3 - 3x + b)
+        struct  P256Prime
+        {
+            static const std::uint64_t* modulus()
+            {
+                static const std::uint64_t p[4] = { 0xFFFFFFFFFFFFFFFFULL, 0x00000000FFFFFFFFULL, 0x0000000000000000ULL, 0xFFFFFFFF00000001ULL };
+                return p;
+            }
+            static const std::uint64_t  c = 0;
+        };
+
+        typedef BigFieldElement<4, Secp256k1Prime>  secp256k1_ffe_t;
+        typedef BigFieldElement<4, P256Prime>       p256_ffe_t;
+
+        typedef EllipticCurve<0, secp256k1_ffe_t>   Secp256k1Curve;
+        typedef EllipticCurve<0, p256_ffe_t>        P256Curve;
+}
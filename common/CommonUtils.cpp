@@ -1,8 +1,8 @@
 #include <sstream>
-#include <QRandomGenerator>
-#include <QString>
 #include "QTimings.h"
 #include "CommonUtils.hpp"
+#include "SecureRandom.hpp"
+#include "XorKernel.hpp"
 #include "FiniteFieldElement.cpp"
 
 CommonUtils::CommonUtils(int a, int b) : generatedCurve(a, b)
@@ -12,70 +12,41 @@ CommonUtils::CommonUtils(int a, int b) : generatedCurve(a, b)
 
 std::string CommonUtils::newRandom() const
 {
-    QRandomGenerator gen;
-    quint32 generated = gen.generate();
+    return SecureRandom::local().decimal();
+}
 
-    return QString::number(generated).toStdString();
+Digest  CommonUtils::hash(const std::string &text, const char *operationName, HashBackend::Algorithm algorithm) const
+{
+    return Hasher(operationName, algorithm).update(text).finalize();
 }
 
-std::string CommonUtils::hash(const std::string &text, const std::string &operationName, const QCryptographicHash::Algorithm algorithm) const
+std::string CommonUtils::applyXOr(const std::string &inA, const std::string &inB, const char *operationName) const
 {
-    if (!operationName.empty())
-    {
-        QTimings::getShared().start(operationName + "_hash");
-    }
-    std::string result = QCryptographicHash::hash(QByteArray::fromStdString(text), algorithm).toHex().toStdString();
-    if (!operationName.empty())
-    {
-        QTimings::getShared().stop(operationName + "_hash");
-    }
+    QTimings::Timer timer(operationName, "_xor");
+
+    // a single allocation, trimmed to the length the kernel reports
+    std::string result(std::max(inA.size(), inB.size()), '\0');
+    result.resize(XorKernel::apply(inA.data(), inA.size(), inB.data(), inB.size(), &result[0]));
+
     return result;
 }
 
-std::string CommonUtils::applyXOr(const std::string &inA, const std::string &inB, const std::string &operationName) const
+std::string CommonUtils::applyXOr(const std::string &inA, const Digest &inB, const char *operationName) const
 {
-    if (!operationName.empty())
-    {
-        QTimings::getShared().start(operationName + "_xor");
-    }
-    QByteArray arrA = QByteArray::fromStdString(inA);
-    QByteArray arrB = QByteArray::fromStdString(inB);
+    QTimings::Timer timer(operationName, "_xor");
+    char            text[2 * Digest::maxSize];
+    std::size_t     size = 2 * inB.size();
 
-    QByteArray  result;
-    int zeroCount = 0;
+    inB.hex(text);
+    std::string result(std::max(inA.size(), size), '\0');
+    result.resize(XorKernel::apply(inA.data(), inA.size(), text, size, &result[0]));
 
-    for (int i = 0; i < std::max(arrA.length(), arrB.length()); ++i)
-    {
-        char cA = (i >= arrA.size()) ? 0 : arrA.at(i);
-        char cB = (i >= arrB.size()) ? 0 : arrB.at(i);
-
-        char tmp = (cA ^ cB);
-        if (tmp <= '\0')
-        {
-            zeroCount += 1;
-            continue;
-        }
-        else if (zeroCount > 0)
-        {
-            result.append(zeroCount, '\0');
-            zeroCount = 0;
-        }
-
-        result.append(tmp);
-    }
-    if (!operationName.empty())
-    {
-        QTimings::getShared().stop(operationName + "_xor");
-    }
-    return result.toStdString();
+    return result;
 }
 
-std::string CommonUtils::scalarMul(const std::string &text, int pointIndex, const std::string &operationName)
+std::string CommonUtils::scalarMul(const std::string &text, int pointIndex, const char *operationName)
 {
-    if (!operationName.empty())
-    {
-        QTimings::getShared().start(operationName + "_scalar");
-    }
+    QTimings::Timer timer(operationName, "_scalar");
 
     ec_t::Point point = this->generatedCurve[pointIndex];
 
@@ -91,10 +62,7 @@ std::string CommonUtils::scalarMul(const std::string &text, int pointIndex, cons
 
         strs << ((c1.i() ^ c2.i()) % 255);
     }
-    if (!operationName.empty())
-    {
-        QTimings::getShared().stop(operationName + "_scalar");
-    }
+    timer.stop();
 
     return strs.str();
 }
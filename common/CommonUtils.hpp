@@ -1,6 +1,6 @@
 #include <string>
-#include <QCryptographicHash>
 #include "FiniteFieldElement.hpp"
+#include "Hasher.hpp"
 
 #pragma once
 
@@ -14,9 +14,13 @@ class CommonUtils
         using ec_t = Cryptography::EllipticCurve<263>;
 
         virtual std::string newRandom() const;
-        virtual std::string hash(const std::string &text, const std::string &operationName = "", const QCryptographicHash::Algorithm algorithm = QCryptographicHash::Algorithm::Md5) const;
-        virtual std::string applyXOr(const std::string &inA, const std::string &inB, const std::string &operationName = "") const;
-        virtual std::string scalarMul(const std::string &text, int pointIndex, const std::string &operationName = "");
+        // a non empty operationName, a string literal, times the call as "<operationName>_hash", "_xor" or "_scalar"
+        virtual Digest      hash(const std::string &text, const char *operationName = "", HashBackend::Algorithm algorithm = HashBackend::defaultAlgorithm()) const;
+        virtual std::string applyXOr(const std::string &inA, const std::string &inB, const char *operationName = "") const;
+        // XOR with the hexadecimal text of the digest, written on the stack
+        virtual std::string applyXOr(const std::string &inA, const Digest &inB, const char *operationName = "") const;
+        std::string         applyXOr(const Digest &inA, const std::string &inB, const char *operationName = "") const { return this->applyXOr(inB, inA, operationName); }
+        virtual std::string scalarMul(const std::string &text, int pointIndex, const char *operationName = "");
 
         virtual std::string getMyId() const = 0;
 
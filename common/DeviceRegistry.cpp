@@ -0,0 +1,376 @@
+#include <algorithm>
+#include <cstring>
+#include <thread>
+#include "DeviceRegistry.hpp"
+
+namespace
+{
+    // splitmix64 finalizer, every bit of the result depends on every bit of x
+    uint64_t    mix(uint64_t x)
+    {
+        x ^= x >> 30;
+        x *= 0xbf58476d1ce4e5b9ULL;
+        x ^= x >> 27;
+        x *= 0x94d049bb133111ebULL;
+        return x ^ (x >> 31);
+    }
+
+    // FNV-1a
+    uint64_t    hashId(const char *id, std::size_t size)
+    {
+        uint64_t hash = 0xcbf29ce484222325ULL;
+
+        for (std::size_t i = 0; i < size; ++i)
+        {
+            hash = (hash ^ static_cast<unsigned char>(id[i])) * 0x100000001b3ULL;
+        }
+        return mix(hash);
+    }
+}
+
+DeviceRegistry::DeviceRegistry() : count(0)
+{
+}
+
+std::size_t DeviceRegistry::slotsFor(std::size_t count)
+{
+    std::size_t slots = 16;
+
+    while (count > slots / 4 * 3)
+    {
+        slots *= 2;
+    }
+    return slots;
+}
+
+uint64_t    DeviceRegistry::hashOf(const Entry &entry)
+{
+    return hashId(entry.id, entry.idSize);
+}
+
+uint64_t    DeviceRegistry::hashOf(const Binding &binding)
+{
+    return mix(binding.ip);
+}
+
+// the slot holding what match accepts or else the free slot where it belongs, a table always has free slots
+template<typename V, typename Match>
+auto    DeviceRegistry::probe(V &slots, uint64_t hash, Match match) -> decltype(&slots[0])
+{
+    std::size_t mask = slots.size() - 1;
+
+    for (std::size_t i = hash & mask; ; i = (i + 1) & mask)
+    {
+        if (slots[i].idSize == 0 || match(slots[i]))
+        {
+            return &slots[i];
+        }
+    }
+}
+
+// called with the write lock of shard
+template<typename T>
+void    DeviceRegistry::grow(Shard<T> &shard, std::size_t slots, uint64_t (*hashOf)(const T &))
+{
+    std::vector<T>  grown(slots);
+
+    for (const T &slot : shard.slots)
+    {
+        if (slot.idSize != 0)
+        {
+            *probe(grown, hashOf(slot), [](const T &) { return false; }) = slot;
+        }
+    }
+    shard.slots.swap(grown);
+}
+
+bool    DeviceRegistry::makeEntry(const Registration &registration, Entry &entry)
+{
+    if (registration.idSize == 0 || registration.idSize > maxIdSize || registration.digestSize == 0 || registration.digestSize > maxDigestSize)
+    {
+        return false;
+    }
+
+    entry = Entry();
+    entry.idSize = static_cast<unsigned char>(registration.idSize);
+    entry.digestSize = static_cast<unsigned char>(registration.digestSize);
+    entry.ip = registration.ip;
+    std::memcpy(entry.id, registration.id, registration.idSize);
+    std::memcpy(entry.digest, registration.digest, registration.digestSize);
+    return true;
+}
+
+void    DeviceRegistry::presize(int shard, std::size_t slots)
+{
+    {
+        QWriteLocker lock(&this->entries[shard].lock);
+        if (this->entries[shard].slots.size() < slots)
+        {
+            grow(this->entries[shard], slots, &DeviceRegistry::hashOf);
+        }
+    }
+    {
+        QWriteLocker lock(&this->bindings[shard].lock);
+        if (this->bindings[shard].slots.size() < slots)
+        {
+            grow(this->bindings[shard], slots, &DeviceRegistry::hashOf);
+        }
+    }
+}
+
+void    DeviceRegistry::reserve(std::size_t count)
+{
+    const int   shards = 1 << shardBits;
+    // the devices do not spread perfectly evenly
+    std::size_t slots = slotsFor(count / shards + count / shards / 8 + 1);
+
+    for (int i = 0; i < shards; ++i)
+    {
+        this->presize(i, slots);
+    }
+}
+
+bool    DeviceRegistry::store(const Entry &entry, uint64_t hash)
+{
+    Shard<Entry>    &shard = this->entries[hash >> (64 - shardBits)];
+    QWriteLocker    lock(&shard.lock);
+
+    if (shard.used + 1 > shard.slots.size() / 4 * 3)
+    {
+        grow(shard, std::max(slotsFor(shard.used + 1), shard.slots.size() * 2), &DeviceRegistry::hashOf);
+    }
+
+    Entry *slot = probe(shard.slots, hash, [&entry](const Entry &other) {
+        return other.idSize == entry.idSize && std::memcmp(other.id, entry.id, entry.idSize) == 0;
+    });
+    bool    added = (slot->idSize == 0);
+
+    if (added)
+    {
+        ++shard.used;
+        ++this->count;
+    }
+    *slot = entry;
+    return added;
+}
+
+void    DeviceRegistry::bind(const char *id, std::size_t idSize, quint32 ip, uint64_t hash)
+{
+    Shard<Binding>  &shard = this->bindings[hash >> (64 - shardBits)];
+    QWriteLocker    lock(&shard.lock);
+
+    if (shard.used + 1 > shard.slots.size() / 4 * 3)
+    {
+        grow(shard, std::max(slotsFor(shard.used + 1), shard.slots.size() * 2), &DeviceRegistry::hashOf);
+    }
+
+    Binding *slot = probe(shard.slots, hash, [ip](const Binding &other) { return other.ip == ip; });
+
+    if (slot->idSize == 0)
+    {
+        ++shard.used;
+    }
+    slot->ip = ip;
+    slot->idSize = static_cast<unsigned char>(idSize);
+    std::memcpy(slot->id, id, idSize);
+}
+
+bool    DeviceRegistry::insert(const std::string &id, const Digest &digest, quint32 ip)
+{
+    Registration    registration = { id.data(), id.size(), digest.data(), digest.size(), ip, true };
+    Entry           entry;
+
+    if (!makeEntry(registration, entry))
+    {
+        return false;
+    }
+
+    this->store(entry, hashOf(entry));
+    if (ip != 0)
+    {
+        this->bind(id.data(), id.size(), ip, mix(ip));
+    }
+    return true;
+}
+
+void    DeviceRegistry::insertMany(const std::vector<Registration> &registrations, unsigned int threads)
+{
+    const int   shards = 1 << shardBits;
+    std::size_t slots = slotsFor(registrations.size() / shards + registrations.size() / shards / 8 + 1);
+
+    threads = std::max(1u, std::min(threads, static_cast<unsigned int>(shards)));
+
+    // each thread owns the shards i with i % threads == t, the registrations of a shard keep their order
+    auto run = [threads](const std::function<void(unsigned int)> &body) {
+        std::vector<std::thread> workers;
+
+        for (unsigned int t = 1; t < threads; ++t)
+        {
+            workers.push_back(std::thread(body, t));
+        }
+        body(0);
+        for (std::thread &worker : workers)
+        {
+            worker.join();
+        }
+    };
+
+    run([this, &registrations, threads, slots](unsigned int t) {
+        Entry   entry;
+
+        for (int i = static_cast<int>(t); i < shards; i += static_cast<int>(threads))
+        {
+            this->presize(i, slots);
+        }
+        for (const Registration &registration : registrations)
+        {
+            uint64_t hash = hashId(registration.id, registration.idSize);
+
+            if ((hash >> (64 - shardBits)) % threads == t && makeEntry(registration, entry))
+            {
+                this->store(entry, hash);
+            }
+        }
+    });
+
+    // an address is bound to the last device registered from it, so the bindings follow the stores
+    run([this, &registrations, threads](unsigned int t) {
+        for (const Registration &registration : registrations)
+        {
+            if (!registration.bind || registration.ip == 0 || registration.idSize == 0 || registration.idSize > maxIdSize)
+            {
+                continue;
+            }
+
+            uint64_t hash = mix(registration.ip);
+
+            if ((hash >> (64 - shardBits)) % threads == t)
+            {
+                this->bind(registration.id, registration.idSize, registration.ip, hash);
+            }
+        }
+    });
+}
+
+Digest  DeviceRegistry::find(const std::string &id, quint32 ip) const
+{
+    return this->find(id.data(), id.size(), ip);
+}
+
+Digest  DeviceRegistry::find(const char *id, std::size_t idSize, quint32 ip) const
+{
+    if (idSize == 0 || idSize > maxIdSize)
+    {
+        return Digest();
+    }
+
+    uint64_t            hash = hashId(id, idSize);
+    const Shard<Entry>  &shard = this->entries[hash >> (64 - shardBits)];
+    QReadLocker         lock(&shard.lock);
+
+    if (shard.slots.empty())
+    {
+        return Digest();
+    }
+
+    const Entry *slot = probe(shard.slots, hash, [id, idSize](const Entry &other) {
+        return other.idSize == idSize && std::memcmp(other.id, id, idSize) == 0;
+    });
+
+    if (slot->idSize == 0 || (slot->ip != 0 && slot->ip != ip))
+    {
+        return Digest();
+    }
+    return Digest(slot->digest, slot->digestSize);
+}
+
+Digest  DeviceRegistry::findByAddress(quint32 ip) const
+{
+    if (ip == 0)
+    {
+        return Digest();
+    }
+
+    uint64_t                hash = mix(ip);
+    const Shard<Binding>    &shard = this->bindings[hash >> (64 - shardBits)];
+    char                    id[maxIdSize];
+    std::size_t             idSize;
+
+    {
+        QReadLocker lock(&shard.lock);
+
+        if (shard.slots.empty())
+        {
+            return Digest();
+        }
+
+        const Binding *slot = probe(shard.slots, hash, [ip](const Binding &other) { return other.ip == ip; });
+
+        if (slot->idSize == 0)
+        {
+            return Digest();
+        }
+        idSize = slot->idSize;
+        std::memcpy(id, slot->id, idSize);
+    }
+
+    // the device may have registered again from another address since
+    return this->find(id, idSize, ip);
+}
+
+void    DeviceRegistry::forEach(const std::function<void(const std::string &, const Digest &, quint32, bool)> &visit) const
+{
+    std::string id;
+    // no writer holds a binding lock while it waits for an entry lock
+    auto        bound = [this](const Entry &entry) {
+        uint64_t                hash = mix(entry.ip);
+        const Shard<Binding>    &shard = this->bindings[hash >> (64 - shardBits)];
+        QReadLocker             lock(&shard.lock);
+
+        if (entry.ip == 0 || shard.slots.empty())
+        {
+            return false;
+        }
+
+        const Binding *slot = probe(shard.slots, hash, [&entry](const Binding &other) { return other.ip == entry.ip; });
+
+        return slot->idSize == entry.idSize && std::memcmp(slot->id, entry.id, entry.idSize) == 0;
+    };
+
+    for (int i = 0; i < (1 << shardBits); ++i)
+    {
+        QReadLocker lock(&this->entries[i].lock);
+
+        for (const Entry &entry : this->entries[i].slots)
+        {
+            if (entry.idSize != 0)
+            {
+                id.assign(entry.id, entry.idSize);
+                visit(id, Digest(entry.digest, entry.digestSize), entry.ip, bound(entry));
+            }
+        }
+    }
+}
+
+std::size_t DeviceRegistry::size() const
+{
+    return this->count.load(std::memory_order_relaxed);
+}
+
+std::size_t DeviceRegistry::memory() const
+{
+    std::size_t bytes = 0;
+
+    for (int i = 0; i < (1 << shardBits); ++i)
+    {
+        {
+            QReadLocker lock(&this->entries[i].lock);
+            bytes += this->entries[i].slots.capacity() * sizeof(Entry);
+        }
+        {
+            QReadLocker lock(&this->bindings[i].lock);
+            bytes += this->bindings[i].slots.capacity() * sizeof(Binding);
+        }
+    }
+    return bytes;
+}
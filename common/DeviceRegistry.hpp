@@ -0,0 +1,118 @@
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+#include <QReadWriteLock>
+#include "Digest.hpp"
+
+#pragma once
+
+/*
+    Registered devices and their digest (hM on the Gateway, hN on the Server), read and written
+    from any thread.
+
+    Devices are keyed by their id, which may be bound to the IPv4 address it registered from: a
+    login naming its device has to come from that address, a login that does not is resolved
+    through the address alone, as before ids were known. Several devices behind the same NAT
+    keep their own entry, the address then resolves to the last one registered.
+
+    The entries are spread over shards that each have a read-write lock and an open addressing
+    table (linear probing) holding the id and the digest inline: 72 bytes per slot plus
+    40 per address binding, tables kept between 3/8 and 3/4 full. reserve() sizes them up front
+    so that a large fleet does not rehash while it registers.
+*/
+class DeviceRegistry
+{
+    public:
+        static const std::size_t    maxIdSize = 32;
+        static const std::size_t    maxDigestSize = Digest::maxSize;
+
+        DeviceRegistry();
+        DeviceRegistry(const DeviceRegistry &) = delete;
+        DeviceRegistry &operator=(const DeviceRegistry &) = delete;
+
+        // room for count devices without growing
+        void        reserve(std::size_t count);
+
+        // registers the device or replaces its digest and binding, ip 0 leaves it unbound.
+        // False when id is empty or too long or digest is empty
+        bool        insert(const std::string &id, const Digest &digest, quint32 ip);
+
+        // what insert() takes, pointing to memory the caller owns
+        struct Registration
+        {
+            const char          *id;
+            std::size_t         idSize;
+            const unsigned char *digest;
+            std::size_t         digestSize;
+            quint32             ip;
+            bool                bind;       // false keeps the binding ip has, when it has one
+        };
+
+        // insert() of every registration in order, threads sharing the shards: sizes the registry for
+        // them, stores the devices, then binds the addresses. For a replay, before the registry is used
+        void        insertMany(const std::vector<Registration> &registrations, unsigned int threads);
+
+        // digest of the device, empty if it is unknown or bound to another address than ip
+        Digest      find(const std::string &id, quint32 ip) const;
+        // digest of the device last registered from ip, empty if none is still bound to it
+        Digest      findByAddress(quint32 ip) const;
+
+        // calls visit with the id, the digest, the address (0 if unbound) of every device and whether
+        // findByAddress() resolves that address to it, a shard at a time under its read lock
+        void        forEach(const std::function<void(const std::string &, const Digest &, quint32, bool)> &visit) const;
+
+        std::size_t size() const;
+        // bytes held by the tables
+        std::size_t memory() const;
+
+    private:
+        struct Entry
+        {
+            unsigned char   idSize;         // 0 for a free slot
+            unsigned char   digestSize;
+            quint32         ip;
+            char            id[maxIdSize];
+            unsigned char   digest[maxDigestSize];
+        };
+
+        struct Binding
+        {
+            quint32         ip;             // 0 for a free slot
+            unsigned char   idSize;
+            char            id[maxIdSize];
+        };
+
+        template<typename T>
+        struct Shard
+        {
+            mutable QReadWriteLock  lock;
+            std::vector<T>          slots;  // a power of two, empty until the first insert
+            std::size_t             used = 0;
+        };
+
+        static const int    shardBits = 6;
+
+        static std::size_t  slotsFor(std::size_t count);
+        // false when the arguments of insert() do not fit an entry
+        static bool         makeEntry(const Registration &registration, Entry &entry);
+
+        Digest              find(const char *id, std::size_t idSize, quint32 ip) const;
+        void                presize(int shard, std::size_t slots);
+        // true when the device is new
+        bool                store(const Entry &entry, uint64_t hash);
+        void                bind(const char *id, std::size_t idSize, quint32 ip, uint64_t hash);
+
+        template<typename V, typename Match>
+        static auto         probe(V &slots, uint64_t hash, Match match) -> decltype(&slots[0]);
+        template<typename T>
+        static void         grow(Shard<T> &shard, std::size_t slots, uint64_t (*hashOf)(const T &));
+
+        static uint64_t     hashOf(const Entry &entry);
+        static uint64_t     hashOf(const Binding &binding);
+
+        Shard<Entry>        entries[1 << shardBits];
+        Shard<Binding>      bindings[1 << shardBits];
+        std::atomic<std::size_t>    count;
+};
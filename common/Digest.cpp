@@ -0,0 +1,79 @@
+#include <algorithm>
+#include <cstring>
+#include "Digest.hpp"
+
+namespace
+{
+    int     hexValue(char c)
+    {
+        if (c >= '0' && c <= '9')
+        {
+            return c - '0';
+        }
+        if (c >= 'a' && c <= 'f')
+        {
+            return c - 'a' + 10;
+        }
+        if (c >= 'A' && c <= 'F')
+        {
+            return c - 'A' + 10;
+        }
+        return -1;
+    }
+}
+
+Digest::Digest(const unsigned char *bytes, std::size_t size) : length(static_cast<unsigned char>(std::min(size, maxSize)))
+{
+    std::memcpy(this->bytes, bytes, this->length);
+}
+
+bool    Digest::operator==(const Digest &other) const
+{
+    return this->length == other.length && std::memcmp(this->bytes, other.bytes, this->length) == 0;
+}
+
+void    Digest::hex(char *out) const
+{
+    Digest::toHex(this->bytes, this->length, out);
+}
+
+std::string Digest::hex() const
+{
+    char    text[2 * maxSize];
+
+    this->hex(text);
+    return std::string(text, 2 * this->length);
+}
+
+bool    Digest::fromHex(const char *text, std::size_t size, Digest &digest)
+{
+    if (size % 2 != 0 || size > 2 * maxSize)
+    {
+        return false;
+    }
+
+    for (std::size_t i = 0; i < size / 2; ++i)
+    {
+        int high = hexValue(text[2 * i]);
+        int low = hexValue(text[2 * i + 1]);
+
+        if (high < 0 || low < 0)
+        {
+            return false;
+        }
+        digest.bytes[i] = static_cast<unsigned char>(high << 4 | low);
+    }
+    digest.length = static_cast<unsigned char>(size / 2);
+    return true;
+}
+
+void    Digest::toHex(const unsigned char *bytes, std::size_t size, char *out)
+{
+    static const char   digits[] = "0123456789abcdef";
+
+    for (std::size_t i = 0; i < size; ++i)
+    {
+        out[2 * i] = digits[bytes[i] >> 4];
+        out[2 * i + 1] = digits[bytes[i] & 0xf];
+    }
+}
@@ -0,0 +1,42 @@
+#include <cstddef>
+#include <string>
+#include "HashBackend.hpp"
+
+#pragma once
+
+/*
+    Binary digest held inline, as Hasher, MultiHasher and CommonUtils::hash produce it: creating,
+    copying or comparing one does not allocate, and it takes half the bytes of its hexadecimal text.
+
+    The protocol is defined over the lowercase hexadecimal text of the digests, that is what it
+    hashes, XORs and multiplies. Hasher::operator<<, CommonUtils::applyXOr and Wire::Writer::add
+    write that text on the stack when they are given a Digest, hex() is the explicit conversion.
+*/
+class Digest
+{
+    public:
+        static const std::size_t    maxSize = HashBackend::maxDigestSize;
+
+        Digest() : length(0) {}
+        // size up to maxSize
+        Digest(const unsigned char *bytes, std::size_t size);
+
+        const unsigned char *data() const { return this->bytes; }
+        std::size_t         size() const { return this->length; }
+        bool                empty() const { return this->length == 0; }
+
+        bool        operator==(const Digest &other) const;
+        bool        operator!=(const Digest &other) const { return !(*this == other); }
+
+        // writes the 2 * size() lowercase hexadecimal digits to out
+        void        hex(char *out) const;
+        std::string hex() const;
+
+        // false when text is not an even number of hexadecimal digits, at most 2 * maxSize
+        static bool fromHex(const char *text, std::size_t size, Digest &digest);
+        static void toHex(const unsigned char *bytes, std::size_t size, char *out);
+
+    private:
+        unsigned char   bytes[maxSize];
+        unsigned char   length;
+};
@@ -29,10 +29,15 @@
     http://www.bloodshed.net
 */
 
+#include <algorithm>
+#include <cstdint>
 #include <cstdlib>
 #include <iostream>
 #include <vector>
+#include <map>
 #include <math.h>
+#include <mutex>
+#include <thread>
 #include "FiniteFieldElement.hpp"
 
 namespace Cryptography
@@ -77,73 +82,383 @@ namespace Cryptography
             }
             return z;
         }
+
+        int BinaryInvMod(int x, int n)
+        {
+            x %= n;
+            if ( x < 0 )
+            {
+                x += n;
+            }
+
+            // invariants: x1*x == u and x2*x == v (mod n)
+            long long u = x, v = n;
+            long long x1 = 1, x2 = 0;
+            while ( u != 1 && v != 1 )
+            {
+                if ( u == 0 || v == 0 )
+                {
+                    // gcd(x, n) != 1
+                    return 0;
+                }
+                while ( (u & 1) == 0 )
+                {
+                    u >>= 1;
+                    x1 = (x1 & 1) ? (x1 + n) >> 1 : x1 >> 1;
+                }
+                while ( (v & 1) == 0 )
+                {
+                    v >>= 1;
+                    x2 = (x2 & 1) ? (x2 + n) >> 1 : x2 >> 1;
+                }
+                if ( u >= v )
+                {
+                    u -= v;
+                    x1 -= x2;
+                    if ( x1 < 0 ) x1 += n;
+                }
+                else
+                {
+                    v -= u;
+                    x2 -= x1;
+                    if ( x2 < 0 ) x2 += n;
+                }
+            }
+            return static_cast<int>(u == 1 ? x1 : x2);
+        }
+
+        void NAF(const std::uint64_t* k, int limbs, int width, std::vector<signed char>& digits)
+        {
+            // one spare limb for the carry of the negative digits
+            std::vector<std::uint64_t> b(k, k + limbs);
+            b.push_back(0);
+
+            const std::uint64_t window = std::uint64_t(1) << width;
+
+            digits.clear();
+            digits.reserve(64*b.size());
+            while ( std::find_if(b.begin(), b.end(), [](std::uint64_t limb) { return limb != 0; }) != b.end() )
+            {
+                int d = 0;
+                if ( b[0] & 1 )
+                {
+                    d = static_cast<int>(b[0] & (window - 1));
+                    if ( d >= static_cast<int>(window/2) )
+                    {
+                        d -= static_cast<int>(window);
+                        // b -= d
+                        for ( std::size_t n = 0, carry = static_cast<std::size_t>(-d); carry != 0 && n < b.size(); ++n )
+                        {
+                            b[n] += carry;
+                            carry = (b[n] < carry) ? 1 : 0;
+                        }
+                    }
+                    else
+                    {
+                        b[0] -= d;
+                    }
+                }
+                digits.push_back(static_cast<signed char>(d));
+
+                // b >>= 1
+                for ( std::size_t n = 0; n + 1 < b.size(); ++n )
+                {
+                    b[n] = (b[n] >> 1) | (b[n+1] << 63);
+                }
+                b.back() >>= 1;
+            }
+        }
+    }
+
+    template<int P, typename F>
+    EllipticCurve<P, F>::EllipticCurve(int a, int b)
+    : m_table_(),
+      a_(a),
+      b_(b)
+    {
+    }
+
+    template<int P, typename F>
+    EllipticCurve<P, F>::EllipticCurve(const ffe_t& a, const ffe_t& b)
+    : m_table_(),
+      a_(a),
+      b_(b)
+    {
     }
 
-    template<int P>
-    EllipticCurve<P>::EllipticCurve(int a, int b)
-    : a_(a),
-      b_(b),
-      m_table_(),
-      table_filled_(false)
+    template<int P, typename F>
+    void    EllipticCurve<P, F>::CalculatePoints(unsigned int threads)
     {
+        std::atomic_store(&m_table_, SharedTable(a_.i(), b_.i(), threads));
     }
 
-    template<int P>
-    void    EllipticCurve<P>::CalculatePoints()
+    template<int P, typename F>
+    std::shared_ptr<const typename EllipticCurve<P, F>::m_table_t>  EllipticCurve<P, F>::SharedTable(int a, int b, unsigned int threads)
     {
-        int x_val[P];
-        int y_val[P];
-        for ( int n = 0; n < P; ++n )
+        static std::mutex                                                           lock;
+        static std::map<std::pair<int, int>, std::shared_ptr<const m_table_t> >     tables;
+
+        std::lock_guard<std::mutex> guard(lock);
+        std::shared_ptr<const m_table_t> &shared = tables[std::make_pair(a, b)];
+        if ( shared )
         {
-            int nsq = n*n;
-            x_val[n] = ((n*nsq) + a_.i() * n + b_.i()) % P;
-            y_val[n] = nsq % P;
+            return shared;
         }
 
-        for ( int n = 0; n < P; ++n )
+        // the square roots of every quadratic residue r, the smallest one first in roots[2*r]
+        std::vector<int> roots(2*static_cast<std::size_t>(P), -1);
+        for ( int m = 0; m < P; ++m )
         {
-            for ( int m = 0; m < P; ++m )
+            std::size_t r = static_cast<std::size_t>((static_cast<long long>(m)*m) % P);
+            if ( roots[2*r] < 0 )
+            {
+                roots[2*r] = m;
+            }
+            else if ( roots[2*r+1] < 0 )
             {
-                if ( x_val[n] == y_val[m] )
+                roots[2*r+1] = m;
+            }
+        }
+
+        // the points of x in [begin, end), by increasing x then y
+        auto enumerate = [a, b, &roots](int begin, int end, m_table_t& points)
+        {
+            for ( int n = begin; n < end; ++n )
+            {
+                long long x = n;
+                std::size_t r = static_cast<std::size_t>(((x*x % P)*x + static_cast<long long>(a)*x + b) % P);
+                for ( std::size_t k = 2*r; k < 2*r + 2 && roots[k] >= 0; ++k )
                 {
-                    m_table_.push_back(Point(n,m,*this));
+                    points.push_back(Point(n, roots[k]));
                 }
             }
+        };
+
+        threads = std::max(1u, std::min(threads, static_cast<unsigned int>(P/4096 + 1)));
+
+        std::vector<m_table_t>      parts(threads);
+        std::vector<std::thread>    workers;
+        int chunk = (P + static_cast<int>(threads) - 1) / static_cast<int>(threads);
+
+        for ( unsigned int t = 1; t < threads; ++t )
+        {
+            int begin = std::min(P, static_cast<int>(t)*chunk);
+            workers.push_back(std::thread(enumerate, begin, std::min(P, begin + chunk), std::ref(parts[t])));
+        }
+        enumerate(0, std::min(P, chunk), parts[0]);
+
+        std::shared_ptr<m_table_t> table = std::make_shared<m_table_t>();
+        for ( unsigned int t = 0; t < threads; ++t )
+        {
+            if ( t > 0 )
+            {
+                workers[t-1].join();
+            }
+            table->insert(table->end(), parts[t].begin(), parts[t].end());
         }
 
-        table_filled_ = true;
+        shared = table;
+        return shared;
     }
 
-    template<int P>
-    typename EllipticCurve<P>::Point   EllipticCurve<P>::operator[](int n)
+    template<int P, typename F>
+    typename EllipticCurve<P, F>::Point   EllipticCurve<P, F>::operator[](int n)
     {
-        if ( !table_filled_ )
+        std::shared_ptr<const m_table_t> table = std::atomic_load(&m_table_);
+        if ( !table )
         {
             CalculatePoints();
+            table = std::atomic_load(&m_table_);
         }
 
-        return m_table_[n];
+        Point point = (*table)[n];
+        point.ec_ = this;
+        return point;
     }
 
-    template<int P>
-    void    EllipticCurve<P>::Point::addDouble(int m, Point& acc)
+    template<int P, typename F>
+    typename EllipticCurve<P, F>::Point::Jacobian  EllipticCurve<P, F>::Point::toJacobian() const
     {
-        if ( m > 0 )
+        Jacobian j;
+        j.X = x_;
+        j.Y = y_;
+        j.Z = 1;
+        return j;
+    }
+
+    template<int P, typename F>
+    typename EllipticCurve<P, F>::Point    EllipticCurve<P, F>::Point::fromJacobian(const Jacobian& j) const
+    {
+        if ( j.isZero() )
         {
-            Point r = acc;
-            for ( int n=0; n < m; ++n )
+            return Point(0, 0, *ec_);
+        }
+
+        // the only inversion of a whole scalar multiplication
+        ffe_t zInv = ffe_t(1) / j.Z;
+        ffe_t zInv2 = zInv*zInv;
+        return Point(j.X*zInv2, j.Y*zInv2*zInv, *ec_);
+    }
+
+    template<int P, typename F>
+    void    EllipticCurve<P, F>::Point::fromJacobian(const std::vector<Jacobian>& js, std::vector<Point>& points) const
+    {
+        std::vector<ffe_t> zInv(js.size());
+        for ( std::size_t n = 0; n < js.size(); ++n )
+        {
+            if ( !js[n].isZero() )
             {
-                r += r;     // doubling step
+                zInv[n] = js[n].Z;
             }
-            acc = r;
         }
+        BatchInverse(zInv.data(), zInv.size());
+
+        points.clear();
+        points.reserve(js.size());
+        for ( std::size_t n = 0; n < js.size(); ++n )
+        {
+            if ( js[n].isZero() )
+            {
+                points.push_back(Point(0, 0, *ec_));
+                continue;
+            }
+            ffe_t zInv2 = zInv[n]*zInv[n];
+            points.push_back(Point(js[n].X*zInv2, js[n].Y*zInv2*zInv[n], *ec_));
+        }
+    }
+
+    template<int P, typename F>
+    std::vector<typename EllipticCurve<P, F>::Point>    EllipticCurve<P, F>::Point::multiples(int count) const
+    {
+        std::vector<Jacobian> js;
+        Jacobian base = toJacobian();
+        Jacobian acc = base;
+
+        js.reserve(count > 0 ? count : 0);
+        for ( int n = 0; n < count; ++n )
+        {
+            js.push_back(acc);
+            addJacobian(acc, base, acc);
+        }
+
+        std::vector<Point> points;
+        fromJacobian(js, points);
+        return points;
+    }
+
+    template<int P, typename F>
+    void    EllipticCurve<P, F>::Point::doubleJacobian(Jacobian& j) const
+    {
+        if ( j.isZero() )
+        {
+            return;
+        }
+        // y == -y
+        if ( j.Y == 0 )
+        {
+            j.X = j.Y = 0;
+            return;
+        }
+
+        ffe_t yy = j.Y*j.Y;
+        ffe_t zz = j.Z*j.Z;
+        // numerator of the tangent slope, 3x^2 + a scaled by Z^4
+        ffe_t m = 3*(j.X*j.X);
+        if ( ec_->a_ != 0 )
+        {
+            m = m + ec_->a_*zz*zz;
+        }
+
+        // add() maps a null slope to the identity
+        if ( detail::LegacyGroupLaw<F>::value && m == 0 )
+        {
+            j.X = j.Y = 0;
+            return;
+        }
+
+        ffe_t s = 4*(j.X*yy);
+        ffe_t x = m*m - 2*s;
+
+        j.Z = 2*(j.Y*j.Z);
+        j.Y = m*(s - x) - 8*(yy*yy);
+        j.X = x;
     }
 
-    template<int P>
-    typename EllipticCurve<P>::Point    EllipticCurve<P>::Point::scalarMultiply(int k, const Point& a)
+    template<int P, typename F>
+    void    EllipticCurve<P, F>::Point::addJacobian(const Jacobian& j1, const Jacobian& j2, Jacobian& jR) const
     {
-        Point acc = a;
-        Point res = Point(0, 0, *ec_);
+        // special cases involving the additive identity
+        if ( j1.isZero() )
+        {
+            jR = j2;
+            return;
+        }
+        if ( j2.isZero() )
+        {
+            jR = j1;
+            return;
+        }
+
+        // bring both points to the same denominators
+        ffe_t z1z1 = j1.Z*j1.Z;
+        ffe_t z2z2 = j2.Z*j2.Z;
+        ffe_t u1 = j1.X*z2z2;
+        ffe_t u2 = j2.X*z1z1;
+        ffe_t s1 = j1.Y*z2z2*j2.Z;
+        ffe_t s2 = j2.Y*z1z1*j1.Z;
+
+        // the group law only gives the identity for P + (-P)
+        if ( s1 == -s2 && (detail::LegacyGroupLaw<F>::value || u1 == u2) )
+        {
+            jR.X = jR.Y = 0;
+            return;
+        }
+        if ( u1 == u2 && s1 == s2 )
+        {
+            //2P
+            jR = j1;
+            doubleJacobian(jR);
+            return;
+        }
+
+        //P+Q
+        ffe_t h = u2 - u1;
+        ffe_t r = s2 - s1;
+
+        // add() maps a null slope, or an impossible division, to the identity
+        if ( h == 0 || (detail::LegacyGroupLaw<F>::value && r == 0) )
+        {
+            jR.X = jR.Y = 0;
+            return;
+        }
+
+        ffe_t hh = h*h;
+        ffe_t hhh = hh*h;
+        ffe_t v = u1*hh;
+        ffe_t x = r*r - hhh - 2*v;
+
+        ffe_t y = r*(v - x) - s1*hhh;
+
+        // jR may be one of the operands
+        jR.Z = h*j1.Z*j2.Z;
+        jR.Y = y;
+        jR.X = x;
+    }
+
+    template<int P, typename F>
+    void    EllipticCurve<P, F>::Point::addDouble(int m, Jacobian& acc) const
+    {
+        for ( int n=0; n < m; ++n )
+        {
+            doubleJacobian(acc);    // doubling step
+        }
+    }
+
+    template<int P, typename F>
+    typename EllipticCurve<P, F>::Point    EllipticCurve<P, F>::Point::scalarMultiply(int k, const Point& a)
+    {
+        Jacobian acc = a.toJacobian();
+        Jacobian res = Point(0, 0, *ec_).toJacobian();
         int i = 0, j = 0;
         int b = std::abs(k); // Infinite loop for negative numbers.
 
@@ -153,17 +468,65 @@ namespace Cryptography
             {
                 // bit is set; acc = 2^(i-j)*acc
                 addDouble(i - j, acc);
-                res += acc;
+                addJacobian(res, acc, res);
                 j = i;  // last bit set
             }
             b >>= 1;
             ++i;
         }
-        return res;
+        return fromJacobian(res);
+    }
+
+    template<int P, typename F>
+    typename EllipticCurve<P, F>::Point    EllipticCurve<P, F>::Point::windowedMultiply(int k, const Point& a, int width)
+    {
+        std::uint64_t b = static_cast<std::uint64_t>(std::abs(k)); // same as scalarMultiply for negative numbers
+        return windowedMultiply(&b, 1, a, width);
+    }
+
+    template<int P, typename F>
+    typename EllipticCurve<P, F>::Point    EllipticCurve<P, F>::Point::windowedMultiply(const std::uint64_t* k, int limbs, const Point& a, int width)
+    {
+        // beyond 8 the table costs more than the additions it saves
+        width = std::min(std::max(width, 2), 8);
+
+        // NAF digits, least significant first
+        std::vector<signed char> digits;
+        detail::NAF(k, limbs, width, digits);
+
+        // odd multiples a, 3a, 5a, ...
+        std::vector<Jacobian> table(std::size_t(1) << (width - 2));
+        table[0] = a.toJacobian();
+        if ( table.size() > 1 )
+        {
+            Jacobian twice = table[0];
+            doubleJacobian(twice);
+            for ( std::size_t n = 1; n < table.size(); ++n )
+            {
+                addJacobian(table[n-1], twice, table[n]);
+            }
+        }
+
+        Jacobian res = Point(0, 0, *ec_).toJacobian();
+        for ( int n = static_cast<int>(digits.size()) - 1; n >= 0; --n )
+        {
+            doubleJacobian(res);
+            if ( digits[n] > 0 )
+            {
+                addJacobian(res, table[digits[n]/2], res);
+            }
+            else if ( digits[n] < 0 )
+            {
+                Jacobian negated = table[-digits[n]/2];
+                negated.Y = -negated.Y;
+                addJacobian(res, negated, res);
+            }
+        }
+        return fromJacobian(res);
     }
 
-    template<int P>
-    void    EllipticCurve<P>::Point::add(ffe_t x1, ffe_t y1, ffe_t x2, ffe_t y2, ffe_t & xR, ffe_t & yR) const
+    template<int P, typename F>
+    void    EllipticCurve<P, F>::Point::add(ffe_t x1, ffe_t y1, ffe_t x2, ffe_t y2, ffe_t & xR, ffe_t & yR) const
     {
          // special cases involving the additive identity
         if ( x1 == 0 && y1 == 0 )
@@ -178,7 +541,8 @@ namespace Cryptography
             yR = y1;
             return;
         }
-        if ( y1 == -y2 )
+        // the group law only gives the identity for P + (-P)
+        if ( y1 == -y2 && (detail::LegacyGroupLaw<F>::value || x1 == x2) )
         {
             xR = yR = 0;
             return;
@@ -189,7 +553,7 @@ namespace Cryptography
         if ( x1 == x2 && y1 == y2 )
         {
             //2P
-            s = (3*(x1.i()*x1.i()) + ec_->a()) / (2*y1);
+            s = (3*(x1*x1) + ec_->a()) / (2*y1);
             xR = ((s*s) - 2*x1);
         }
         else
@@ -199,7 +563,7 @@ namespace Cryptography
             xR = ((s*s) - x1 - x2);
         }
 
-        if ( s != 0 )
+        if ( s != 0 || !detail::LegacyGroupLaw<F>::value )
         {
             yR = (-y1 + s*(x1 - xR));
         }
@@ -209,8 +573,8 @@ namespace Cryptography
         }
     }
 
-    template<int P>
-    unsigned int     EllipticCurve<P>::Point::Order(unsigned int maxPeriod) const
+    template<int P, typename F>
+    unsigned int     EllipticCurve<P, F>::Point::Order(unsigned int maxPeriod) const
     {
         Point r = *this;
         unsigned int n = 0;
@@ -223,8 +587,8 @@ namespace Cryptography
         return n;
     }
                                
-    template<int T>
-    std::ostream& operator<<(std::ostream& os, const EllipticCurve<T>& EllipticCurve)
+    template<int T, typename G>
+    std::ostream& operator<<(std::ostream& os, const EllipticCurve<T, G>& EllipticCurve)
     {
         os << "y^2 mod " << T << " = (x^3" << std::showpos;
         if ( EllipticCurve.a_ != 0 )
@@ -241,14 +605,15 @@ namespace Cryptography
         return os;
     }
 
-    template<int P>
-    std::ostream&    EllipticCurve<P>::PrintTable(std::ostream &os, int columns)
+    template<int P, typename F>
+    std::ostream&    EllipticCurve<P, F>::PrintTable(std::ostream &os, int columns)
     {
-        if ( table_filled_ )
+        std::shared_ptr<const m_table_t> table = std::atomic_load(&m_table_);
+        if ( table )
         {
             int col = 0;
-            typename EllipticCurve<P>::m_table_t::iterator iter = m_table_.begin();
-            for ( ; iter!=m_table_.end(); ++iter )
+            typename EllipticCurve<P, F>::m_table_t::const_iterator iter = table->begin();
+            for ( ; iter!=table->end(); ++iter )
             {
                 os << "(" << (*iter).x_.i() << ", " << (*iter).y_.i() << ") ";
                 if ( ++col > columns )
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstdint>
+#include <memory>
 #include <ostream>
 #include <vector>
 
@@ -12,6 +14,46 @@ namespace Cryptography
             int EGCD(int a, int b, int& u, int &v);
             
             int InvMod(int x, int n); // Solve linear congruence equation x * z == 1 (mod n) for z
+
+            // Same as InvMod with shifts and subtractions instead of divisions, n has to be odd
+            // returns z in [0, n), 0 when x has no inverse
+            int BinaryInvMod(int x, int n);
+
+            // fields up to this order invert through a table
+            const int InverseTableLimit = 1 << 16;
+
+            // the inverses of 0..P-1 (0 for 0), computed once per process
+            template<int P>
+            const std::vector<int>& InverseTable()
+            {
+                struct Table
+                {
+                    std::vector<int> inverses;
+                    Table() : inverses(P)
+                    {
+                        for ( int x = 0; x < P; ++x )
+                        {
+                            inverses[x] = (P % 2 == 1) ? BinaryInvMod(x, P) : InvMod(x, P);
+                        }
+                    }
+                };
+                static const Table table;
+                return table.inverses;
+            }
+
+            // x^-1 mod P for x in [0, P), 0 for 0
+            template<int P>
+            int Inverse(int x)
+            {
+                if ( P <= InverseTableLimit )
+                {
+                    return InverseTable<P>()[x];
+                }
+                return (P % 2 == 1) ? BinaryInvMod(x, P) : InvMod(x, P);
+            }
+
+            // width-w NAF digits of the little endian limbs of k, least significant first
+            void NAF(const std::uint64_t* k, int limbs, int width, std::vector<signed char>& digits);
         }
         
         /*
@@ -99,7 +141,7 @@ namespace Cryptography
                 // a / b
                 friend FiniteFieldElement<P> operator/(const FiniteFieldElement<P>& lhs, const FiniteFieldElement<P>& rhs)
                 {
-                    return FiniteFieldElement<P>( lhs.i_ * detail::InvMod(rhs.i_,P));
+                    return FiniteFieldElement<P>( lhs.i_ * detail::Inverse<P>(rhs.i_));
                 }
                 // a + b
                 friend FiniteFieldElement<P> operator+(const FiniteFieldElement<P>& lhs, const FiniteFieldElement<P>& rhs)
@@ -132,32 +174,83 @@ namespace Cryptography
                     return FiniteFieldElement<P>( lhs.i_ * rhs.i_);
                 }
                 // ostream handler
-                template<int T>
-                friend  std::ostream&    operator<<(std::ostream& os, const FiniteFieldElement<T>& g)
+                friend  std::ostream&    operator<<(std::ostream& os, const FiniteFieldElement<P>& g)
                 {
                     return os << g.i_;
                 }
         };
 
+        namespace   detail
+        {
+            // whether the curve arithmetic keeps the shortcuts of the original add(): y1 == -y2 or a null
+            // slope give the identity. The values of the protocol depend on them, so only the int field
+            // keeps them, any other field follows the group law
+            template<typename F>
+            struct  LegacyGroupLaw
+            {
+                static const bool value = false;
+            };
+
+            template<int P>
+            struct  LegacyGroupLaw<FiniteFieldElement<P> >
+            {
+                static const bool value = true;
+            };
+        }
+
+        /*
+            Montgomery's trick: replaces each of the count values by its inverse (0 stays 0)
+            for a single inversion and 3 multiplications per value
+            F is FiniteFieldElement or any type with the same operators
+        */
+        template<typename F>
+        void    BatchInverse(F* values, std::size_t count)
+        {
+            // prefix[n] is the product of the non zero values before n
+            std::vector<F> prefix(count);
+            F acc(1);
+            for ( std::size_t n = 0; n < count; ++n )
+            {
+                prefix[n] = acc;
+                if ( values[n] != 0 )
+                {
+                    acc = acc * values[n];
+                }
+            }
+
+            F inv = F(1) / acc;
+            for ( std::size_t n = count; n-- > 0; )
+            {
+                if ( values[n] != 0 )
+                {
+                    F value = values[n];
+                    values[n] = inv * prefix[n];
+                    inv = inv * value;
+                }
+            }
+        }
+
         /*
             Elliptic Curve over a finite field of order P:
             y^2 mod P = x^3 + ax + b mod P
 
-            NOTE: this implementation is simple and uses normal machine integers for its calculations.
-                  No special "big integer" manipulation is supported so anything _big_ won't work.
-                  However, it is a complete finite field EC implementation in that it can be used
-                  to learn and understand the behaviour of these curves and in particular to experiment with them
-                  for their use in cryptography
+            NOTE: with the default FiniteFieldElement the elements are machine integers, so P has to stay
+                  small (products of two elements must fit in an int), and the additions keep the shortcuts
+                  the protocol curve relies on (see detail::LegacyGroupLaw). BigFieldElement covers 256-bit
+                  curves such as secp256k1 and P-256, with the exact group law; their points come from
+                  point(x, y) and are multiplied by scalars of any size through multiplied()
 
             Template parameter P is the order of the finite field Fp over which this curve is defined
+            Template parameter F is the type of the elements of Fp: any type with the arithmetic
+            operators of FiniteFieldElement, such as the multi-limb BigFieldElement for which P is 0
         */
-        template<int P>
+        template<int P, typename F = FiniteFieldElement<P> >
         class   EllipticCurve
         {
             public:
                 // this curve is defined over the finite field (Galois field) Fp, this is the
                 // typedef of elements in it
-                typedef FiniteFieldElement<P> ffe_t;
+                typedef F ffe_t;
 
                 /*
                     A point, or group element, on the EC, consisting of two elements of the field FP
@@ -166,15 +259,36 @@ namespace Cryptography
                 */
                 class   Point
                 {
-                    friend  class   EllipticCurve<P>;
-                    typedef FiniteFieldElement<P> ffe_t;
+                    friend  class   EllipticCurve<P, F>;
+                    typedef F ffe_t;
                     ffe_t  x_;
                     ffe_t  y_;
                     EllipticCurve    *ec_;
 
+                    // Jacobian coordinates: the affine point is (X/Z^2, Y/Z^3)
+                    // used by the multiplier so that only the final conversion needs an inversion
+                    struct  Jacobian
+                    {
+                        ffe_t   X;
+                        ffe_t   Y;
+                        ffe_t   Z;
+
+                        // (0,0) is the additive identity, as in affine coordinates
+                        bool    isZero() const { return X == 0 && Y == 0; }
+                    };
+
+                    Jacobian    toJacobian() const;
+                    Point       fromJacobian(const Jacobian& j) const;
+                    // fromJacobian of every point for a single inversion
+                    void        fromJacobian(const std::vector<Jacobian>& js, std::vector<Point>& points) const;
+
+                    // same results, including the special cases of detail::LegacyGroupLaw, as add() on the affine points
+                    void    doubleJacobian(Jacobian& j) const;
+                    void    addJacobian(const Jacobian& j1, const Jacobian& j2, Jacobian& jR) const;
+
                     // core of the doubling multiplier algorithm (see below)
                     // multiplies acc by m as a series of "2*acc's"
-                    void   addDouble(int m, Point& acc);
+                    void   addDouble(int m, Jacobian& acc) const;
 
                     // doubling multiplier algorithm
                     // multiplies a by k by expanding in multiplies by 2
@@ -182,6 +296,11 @@ namespace Cryptography
                     // between the "1s" of the binary form of the input scalar k
                     Point scalarMultiply(int k, const Point& a);
 
+                    // width-w NAF multiplier: signed digits with at most one non zero in any w consecutive ones,
+                    // each non zero digit adds one of the precomputed odd multiples a, 3a, ..., (2^(w-1)-1)a or its negation
+                    Point windowedMultiply(int k, const Point& a, int width);
+                    Point windowedMultiply(const std::uint64_t* k, int limbs, const Point& a, int width);
+
                     // adding two points on the curve
                     void    add(ffe_t x1, ffe_t y1, ffe_t x2, ffe_t y2, ffe_t & xR, ffe_t & yR) const;
 
@@ -191,13 +310,13 @@ namespace Cryptography
                       ec_(0)
                     {}
 
-                    Point(int x, int y, EllipticCurve<P> & EllipticCurve)
+                    Point(int x, int y, EllipticCurve<P, F> & EllipticCurve)
                      : x_(x),
                        y_(y),
                        ec_(&EllipticCurve)
                     {}
 
-                    Point(const ffe_t& x, const ffe_t& y, EllipticCurve<P> & EllipticCurve)
+                    Point(const ffe_t& x, const ffe_t& y, EllipticCurve<P, F> & EllipticCurve)
                      : x_(x),
                        y_(y),
                        ec_(&EllipticCurve)
@@ -267,6 +386,16 @@ namespace Cryptography
                     {
                         return (*this = scalarMultiply(k,*this));
                     }
+                    // k*a with each algorithm, to compare them. add() maps some sums to the identity that the
+                    // group law would not, so the NAF adds in another order and lands elsewhere for a few
+                    // pairs (8396 of the 267 points times k < 952 on the protocol curve): the protocol only
+                    // multiplies with the double-and-add
+                    Point   binaryMultiplied(int k) const { return Point(*this).scalarMultiply(k,*this); }
+                    Point   windowMultiplied(int k, int width) const { return Point(*this).windowedMultiply(k,*this,width); }
+                    // k*a for a scalar of any size given as little endian 64 bits limbs, by the NAF as windowMultiplied
+                    Point   multiplied(const std::uint64_t* k, int limbs, int width = 4) const { return Point(*this).windowedMultiply(k,limbs,*this,width); }
+                    // a, 2a, ..., count*a as by repeated +=, normalized together for a single inversion
+                    std::vector<Point>  multiples(int count) const;
                     // ostream handler: print this point
                     friend std::ostream& operator <<(std::ostream& os, const Point& p)
                     {
@@ -276,49 +405,60 @@ namespace Cryptography
 
                 // ==================================================== EllipticCurve impl
 
-                typedef EllipticCurve<P> this_t;
-                typedef class EllipticCurve<P>::Point point_t;
+                typedef EllipticCurve<P, F> this_t;
+                typedef class EllipticCurve<P, F>::Point point_t;
 
                 // ctor
                 // Initialize EC as y^2 = x^3 + ax + b
                 EllipticCurve(int a, int b);
+                // ctor, for parameters that do not fit in an int
+                EllipticCurve(const ffe_t& a, const ffe_t& b);
 
-                // Calculate *all* the points (group elements) for this EC
+                // Calculate *all* the points (group elements) for this EC, in O(P) with a table of square roots
+                // (P has to be prime), sorted by x then y; threads share the enumeration of the x values
+                // The table is computed once per process for given a and b, every curve with them shares it
                 //NOTE: if the order of this curve is large this could take some time...
-                void    CalculatePoints();
+                void    CalculatePoints(unsigned int threads = 1);
 
-                // get a point (group element) on the curve
+                // get a point (group element) on the curve, safe to call from several threads
                 Point   operator[](int n);
 
+                // the point (x, y), which has to satisfy the equation of the curve
+                // the way to get points when the curve is too big for CalculatePoints
+                Point   point(const ffe_t& x, const ffe_t& y) { return Point(x, y, *this); }
+
                 // number of elements in this group
-                std::size_t  Size() const { return m_table_.size(); }
+                std::size_t  Size() const { std::shared_ptr<const m_table_t> table = std::atomic_load(&m_table_); return table ? table->size() : 0; }
 
                 // the degree P of this EC
                 int     Degree() const { return P; }
 
                 // the parameter a (as an element of Fp)
-                FiniteFieldElement<P>  a() const { return a_; }
+                ffe_t  a() const { return a_; }
 
                 // the paramter b (as an element of Fp)
-                FiniteFieldElement<P>  b() const { return b_; }
+                ffe_t  b() const { return b_; }
 
                 // ostream handler: print this curve in human readable form
-                template<int T>
-                friend std::ostream& operator <<(std::ostream& os, const EllipticCurve<T>& EllipticCurve);
+                template<int T, typename G>
+                friend std::ostream& operator <<(std::ostream& os, const EllipticCurve<T, G>& EllipticCurve);
                 // print all the elements of the EC group
                 std::ostream&    PrintTable(std::ostream &os, int columns=4);
 
                 private:
                     typedef std::vector<Point>  m_table_t;
 
-                    m_table_t                   m_table_;   // table of points
-                    FiniteFieldElement<P>       a_;         // paramter a of the EC equation
-                    FiniteFieldElement<P>       b_;         // parameter b of the EC equation
-                    bool    table_filled_;                  // true if the table has been calculated
+                    // the table of the curve with parameters a and b, computed by the first caller
+                    // its points are not bound to a curve, operator[] binds them to the caller
+                    static std::shared_ptr<const m_table_t> SharedTable(int a, int b, unsigned int threads);
+
+                    std::shared_ptr<const m_table_t>    m_table_;   // table of points, null until calculated
+                    ffe_t                               a_;         // paramter a of the EC equation
+                    ffe_t                               b_;         // parameter b of the EC equation
         };
 
-        template<int T>
-            typename EllipticCurve<T>::Point EllipticCurve<T>::Point::ONE(0,0);
+        template<int T, typename G>
+            typename EllipticCurve<T, G>::Point EllipticCurve<T, G>::Point::ONE(0,0);
 }
 
 namespace   utils
@@ -0,0 +1,993 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <type_traits>
+#include <vector>
+#include <QCryptographicHash>
+#include "HashBackend.hpp"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SCAE_HASH_X86
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+namespace HashBackend
+{
+    namespace
+    {
+        struct Cpu
+        {
+            bool    sse41 = false;
+            bool    sha = false;
+
+            Cpu()
+            {
+#ifdef SCAE_HASH_X86
+                unsigned int eax, ebx, ecx, edx;
+
+                if (__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+                {
+                    this->sse41 = (ecx & bit_SSE4_1) != 0;
+                }
+                if (__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx))
+                {
+                    this->sha = this->sse41 && (ebx & (1u << 29)) != 0;
+                }
+#endif
+            }
+        };
+
+        const Cpu   &cpu()
+        {
+            static const Cpu detected;
+            return detected;
+        }
+
+        inline uint32_t rotr(uint32_t x, int n)
+        {
+            return (x >> n) | (x << (32 - n));
+        }
+
+        inline uint32_t loadBigEndian(const unsigned char *p)
+        {
+            return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) | (static_cast<uint32_t>(p[2]) << 8) | p[3];
+        }
+
+        inline uint32_t loadLittleEndian(const unsigned char *p)
+        {
+            return p[0] | (static_cast<uint32_t>(p[1]) << 8) | (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+        }
+
+        // MD5, through Qt like before
+        class QtBackend : public Backend
+        {
+            public:
+                explicit QtBackend(QCryptographicHash::Algorithm algorithm) : hash(algorithm) {}
+
+                void        update(const char *data, std::size_t size) override { this->hash.addData(data, static_cast<int>(size)); }
+                void        finalize(unsigned char *digest) override
+                {
+                    QByteArray result = this->hash.result();
+                    std::memcpy(digest, result.constData(), result.size());
+                }
+                std::size_t digestSize() const override { return 16; }
+
+            private:
+                QCryptographicHash  hash;
+        };
+
+        // SHA-256 (FIPS 180-4), the compression of whole 64 bytes blocks is the only part depending on the CPU
+        using Sha256Compress = void (*)(uint32_t state[8], const unsigned char *blocks, std::size_t count);
+
+        const uint32_t  sha256K[64] = {
+            0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+            0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+            0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+            0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+            0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+            0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+            0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+            0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+        };
+
+        // also the IV of BLAKE3
+        const uint32_t  sha256Iv[8] = { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+
+        void    sha256Portable(uint32_t state[8], const unsigned char *blocks, std::size_t count)
+        {
+            for (; count > 0; --count, blocks += 64)
+            {
+                uint32_t w[64];
+
+                for (int i = 0; i < 16; ++i)
+                {
+                    w[i] = loadBigEndian(blocks + 4 * i);
+                }
+                for (int i = 16; i < 64; ++i)
+                {
+                    uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+                    uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+                    w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+                }
+
+                uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+                uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+
+                for (int i = 0; i < 64; ++i)
+                {
+                    uint32_t t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + sha256K[i] + w[i];
+                    uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+
+                    h = g;
+                    g = f;
+                    f = e;
+                    e = d + t1;
+                    d = c;
+                    c = b;
+                    b = a;
+                    a = t1 + t2;
+                }
+
+                state[0] += a;
+                state[1] += b;
+                state[2] += c;
+                state[3] += d;
+                state[4] += e;
+                state[5] += f;
+                state[6] += g;
+                state[7] += h;
+            }
+        }
+
+#ifdef SCAE_HASH_X86
+        // SHA extensions: sha256rnds2 does two rounds on the state split in ABEF and CDGH,
+        // sha256msg1/msg2 extend the message schedule four words at a time
+        __attribute__((target("sha,sse4.1")))
+        void    sha256ShaNi(uint32_t state[8], const unsigned char *blocks, std::size_t count)
+        {
+            const __m128i   byteSwap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+            __m128i         message[4];
+
+            __m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(state)), 0xB1);
+            __m128i state1 = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(state + 4)), 0x1B);
+            __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);      // ABEF
+            state1 = _mm_blend_epi16(state1, tmp, 0xF0);            // CDGH
+
+            for (; count > 0; --count, blocks += 64)
+            {
+                __m128i abef = state0;
+                __m128i cdgh = state1;
+
+                // 16 groups of 4 rounds
+                for (int i = 0; i < 16; ++i)
+                {
+                    __m128i &current = message[i & 3];
+
+                    if (i < 4)
+                    {
+                        current = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(blocks + 16 * i)), byteSwap);
+                    }
+
+                    __m128i words = _mm_add_epi32(current, _mm_loadu_si128(reinterpret_cast<const __m128i *>(sha256K + 4 * i)));
+                    state1 = _mm_sha256rnds2_epu32(state1, state0, words);
+
+                    if (i >= 3 && i < 15)
+                    {
+                        __m128i &next = message[(i + 1) & 3];
+
+                        next = _mm_add_epi32(next, _mm_alignr_epi8(current, message[(i + 3) & 3], 4));
+                        next = _mm_sha256msg2_epu32(next, current);
+                    }
+
+                    state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(words, 0x0E));
+
+                    if (i >= 1 && i < 13)
+                    {
+                        __m128i &previous = message[(i + 3) & 3];
+                        previous = _mm_sha256msg1_epu32(previous, current);
+                    }
+                }
+
+                state0 = _mm_add_epi32(state0, abef);
+                state1 = _mm_add_epi32(state1, cdgh);
+            }
+
+            tmp = _mm_shuffle_epi32(state0, 0x1B);
+            state1 = _mm_shuffle_epi32(state1, 0xB1);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(state), _mm_blend_epi16(tmp, state1, 0xF0));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(state + 4), _mm_alignr_epi8(state1, tmp, 8));
+        }
+#endif
+
+        Sha256Compress  sha256Compress()
+        {
+#ifdef SCAE_HASH_X86
+            if (cpu().sha)
+            {
+                return sha256ShaNi;
+            }
+#endif
+            return sha256Portable;
+        }
+
+        class Sha256Backend : public Backend
+        {
+            public:
+                Sha256Backend() : compress(sha256Compress())
+                {
+                    std::memcpy(this->state, sha256Iv, sizeof(this->state));
+                }
+
+                void    update(const char *data, std::size_t size) override
+                {
+                    const unsigned char *input = reinterpret_cast<const unsigned char *>(data);
+
+                    this->length += size;
+                    if (this->buffered > 0)
+                    {
+                        std::size_t take = std::min(size, sizeof(this->buffer) - this->buffered);
+
+                        std::memcpy(this->buffer + this->buffered, input, take);
+                        this->buffered += take;
+                        input += take;
+                        size -= take;
+                        if (this->buffered < sizeof(this->buffer))
+                        {
+                            return;
+                        }
+                        this->compress(this->state, this->buffer, 1);
+                        this->buffered = 0;
+                    }
+                    if (size >= 64)
+                    {
+                        this->compress(this->state, input, size / 64);
+                        input += size & ~static_cast<std::size_t>(63);
+                        size &= 63;
+                    }
+                    std::memcpy(this->buffer, input, size);
+                    this->buffered = size;
+                }
+
+                void    finalize(unsigned char *digest) override
+                {
+                    uint64_t bits = static_cast<uint64_t>(this->length) * 8;
+
+                    // 0x80, zeros up to 56 bytes modulo 64, then the length in bits
+                    this->buffer[this->buffered++] = 0x80;
+                    if (this->buffered > 56)
+                    {
+                        std::memset(this->buffer + this->buffered, 0, 64 - this->buffered);
+                        this->compress(this->state, this->buffer, 1);
+                        this->buffered = 0;
+                    }
+                    std::memset(this->buffer + this->buffered, 0, 56 - this->buffered);
+                    for (int i = 0; i < 8; ++i)
+                    {
+                        this->buffer[63 - i] = static_cast<unsigned char>(bits >> (8 * i));
+                    }
+                    this->compress(this->state, this->buffer, 1);
+
+                    for (int i = 0; i < 8; ++i)
+                    {
+                        digest[4 * i] = static_cast<unsigned char>(this->state[i] >> 24);
+                        digest[4 * i + 1] = static_cast<unsigned char>(this->state[i] >> 16);
+                        digest[4 * i + 2] = static_cast<unsigned char>(this->state[i] >> 8);
+                        digest[4 * i + 3] = static_cast<unsigned char>(this->state[i]);
+                    }
+                }
+
+                std::size_t digestSize() const override { return 32; }
+
+            private:
+                Sha256Compress  compress;
+                uint32_t        state[8];
+                unsigned char   buffer[64];
+                std::size_t     buffered = 0;
+                std::size_t     length = 0;
+        };
+
+        // BLAKE3 with the default 32 bytes output, no key and no derivation
+        const uint32_t      ChunkStart = 1;
+        const uint32_t      ChunkEnd = 2;
+        const uint32_t      Parent = 4;
+        const uint32_t      Root = 8;
+
+        const std::size_t   blake3ChunkSize = 1024;
+
+        // message words of each of the 7 rounds, the permutation already applied
+        const unsigned char blake3Schedule[7][16] = {
+            { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 },
+            { 2, 6, 3, 10, 7, 0, 4, 13, 1, 11, 12, 5, 9, 14, 15, 8 },
+            { 3, 4, 10, 12, 13, 2, 7, 14, 6, 5, 9, 0, 11, 15, 8, 1 },
+            { 10, 7, 12, 9, 14, 3, 13, 15, 4, 0, 11, 2, 5, 8, 1, 6 },
+            { 12, 13, 9, 11, 15, 10, 14, 8, 7, 2, 5, 3, 0, 1, 6, 4 },
+            { 9, 14, 11, 5, 8, 12, 15, 1, 13, 3, 0, 10, 2, 6, 4, 7 },
+            { 11, 15, 5, 0, 1, 9, 8, 6, 14, 10, 2, 12, 3, 4, 7, 13 }
+        };
+
+        // compresses one 64 bytes block into the next chaining value, cv and out may be the same
+        using Blake3Compress = void (*)(const uint32_t cv[8], const unsigned char block[64], uint64_t counter, uint32_t length, uint32_t flags, uint32_t out[8]);
+
+        inline void blake3G(uint32_t *v, int a, int b, int c, int d, uint32_t x, uint32_t y)
+        {
+            v[a] = v[a] + v[b] + x;
+            v[d] = rotr(v[d] ^ v[a], 16);
+            v[c] = v[c] + v[d];
+            v[b] = rotr(v[b] ^ v[c], 12);
+            v[a] = v[a] + v[b] + y;
+            v[d] = rotr(v[d] ^ v[a], 8);
+            v[c] = v[c] + v[d];
+            v[b] = rotr(v[b] ^ v[c], 7);
+        }
+
+        void    blake3Portable(const uint32_t cv[8], const unsigned char block[64], uint64_t counter, uint32_t length, uint32_t flags, uint32_t out[8])
+        {
+            uint32_t m[16];
+            uint32_t v[16] = {
+                cv[0], cv[1], cv[2], cv[3], cv[4], cv[5], cv[6], cv[7],
+                sha256Iv[0], sha256Iv[1], sha256Iv[2], sha256Iv[3],
+                static_cast<uint32_t>(counter), static_cast<uint32_t>(counter >> 32), length, flags
+            };
+
+            for (int i = 0; i < 16; ++i)
+            {
+                m[i] = loadLittleEndian(block + 4 * i);
+            }
+
+            for (const unsigned char *s : blake3Schedule)
+            {
+                blake3G(v, 0, 4, 8, 12, m[s[0]], m[s[1]]);
+                blake3G(v, 1, 5, 9, 13, m[s[2]], m[s[3]]);
+                blake3G(v, 2, 6, 10, 14, m[s[4]], m[s[5]]);
+                blake3G(v, 3, 7, 11, 15, m[s[6]], m[s[7]]);
+                blake3G(v, 0, 5, 10, 15, m[s[8]], m[s[9]]);
+                blake3G(v, 1, 6, 11, 12, m[s[10]], m[s[11]]);
+                blake3G(v, 2, 7, 8, 13, m[s[12]], m[s[13]]);
+                blake3G(v, 3, 4, 9, 14, m[s[14]], m[s[15]]);
+            }
+
+            for (int i = 0; i < 8; ++i)
+            {
+                out[i] = v[i] ^ v[i + 8];
+            }
+        }
+
+#ifdef SCAE_HASH_X86
+        // the four G of a half round side by side, one row of the state per register
+        __attribute__((target("sse4.1")))
+        inline void blake3G4(__m128i &row0, __m128i &row1, __m128i &row2, __m128i &row3, __m128i x, __m128i y)
+        {
+            const __m128i   rotate16 = _mm_set_epi8(13, 12, 15, 14, 9, 8, 11, 10, 5, 4, 7, 6, 1, 0, 3, 2);
+            const __m128i   rotate8 = _mm_set_epi8(12, 15, 14, 13, 8, 11, 10, 9, 4, 7, 6, 5, 0, 3, 2, 1);
+
+            row0 = _mm_add_epi32(_mm_add_epi32(row0, row1), x);
+            row3 = _mm_shuffle_epi8(_mm_xor_si128(row3, row0), rotate16);
+            row2 = _mm_add_epi32(row2, row3);
+            row1 = _mm_xor_si128(row1, row2);
+            row1 = _mm_or_si128(_mm_srli_epi32(row1, 12), _mm_slli_epi32(row1, 20));
+            row0 = _mm_add_epi32(_mm_add_epi32(row0, row1), y);
+            row3 = _mm_shuffle_epi8(_mm_xor_si128(row3, row0), rotate8);
+            row2 = _mm_add_epi32(row2, row3);
+            row1 = _mm_xor_si128(row1, row2);
+            row1 = _mm_or_si128(_mm_srli_epi32(row1, 7), _mm_slli_epi32(row1, 25));
+        }
+
+        // the diagonal half round rotates rows 1 to 3 into columns first
+        __attribute__((target("sse4.1")))
+        void    blake3Sse41(const uint32_t cv[8], const unsigned char block[64], uint64_t counter, uint32_t length, uint32_t flags, uint32_t out[8])
+        {
+            uint32_t    m[16];
+
+            std::memcpy(m, block, sizeof(m));   // x86 is little endian
+
+            __m128i row0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(cv));
+            __m128i row1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(cv + 4));
+            __m128i row2 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(sha256Iv));
+            __m128i row3 = _mm_set_epi32(static_cast<int>(flags), static_cast<int>(length), static_cast<int>(counter >> 32), static_cast<int>(counter));
+
+            for (const unsigned char *s : blake3Schedule)
+            {
+                blake3G4(row0, row1, row2, row3, _mm_set_epi32(m[s[6]], m[s[4]], m[s[2]], m[s[0]]), _mm_set_epi32(m[s[7]], m[s[5]], m[s[3]], m[s[1]]));
+
+                row1 = _mm_shuffle_epi32(row1, 0x39);
+                row2 = _mm_shuffle_epi32(row2, 0x4E);
+                row3 = _mm_shuffle_epi32(row3, 0x93);
+
+                blake3G4(row0, row1, row2, row3, _mm_set_epi32(m[s[14]], m[s[12]], m[s[10]], m[s[8]]), _mm_set_epi32(m[s[15]], m[s[13]], m[s[11]], m[s[9]]));
+
+                row1 = _mm_shuffle_epi32(row1, 0x93);
+                row2 = _mm_shuffle_epi32(row2, 0x4E);
+                row3 = _mm_shuffle_epi32(row3, 0x39);
+            }
+
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out), _mm_xor_si128(row0, row2));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 4), _mm_xor_si128(row1, row3));
+        }
+#endif
+
+        Blake3Compress  blake3Compress()
+        {
+#ifdef SCAE_HASH_X86
+            if (cpu().sse41)
+            {
+                return blake3Sse41;
+            }
+#endif
+            return blake3Portable;
+        }
+
+        // inputs are hashed chunk by chunk, the chaining values of the finished chunks being merged
+        // in a stack as the binary tree of the specification fills up
+        class Blake3Backend : public Backend
+        {
+            public:
+                Blake3Backend() : compress(blake3Compress())
+                {
+                    this->startChunk();
+                }
+
+                void    update(const char *data, std::size_t size) override
+                {
+                    const unsigned char *input = reinterpret_cast<const unsigned char *>(data);
+
+                    while (size > 0)
+                    {
+                        // the last block of a chunk is only known to be the last one when more input comes
+                        if (this->chunkLength() == blake3ChunkSize)
+                        {
+                            uint32_t cv[8];
+
+                            this->compress(this->cv, this->block, this->chunk, static_cast<uint32_t>(this->blockLength), this->chunkFlags() | ChunkEnd, cv);
+                            this->pushChunk(cv);
+                            ++this->chunk;
+                            this->startChunk();
+                        }
+
+                        if (this->blockLength == sizeof(this->block))
+                        {
+                            this->compress(this->cv, this->block, this->chunk, sizeof(this->block), this->chunkFlags(), this->cv);
+                            ++this->blocks;
+                            this->blockLength = 0;
+                        }
+
+                        std::size_t take = std::min(size, sizeof(this->block) - this->blockLength);
+
+                        std::memcpy(this->block + this->blockLength, input, take);
+                        this->blockLength += take;
+                        input += take;
+                        size -= take;
+                    }
+                }
+
+                void    finalize(unsigned char *digest) override
+                {
+                    uint32_t        cv[8];
+                    uint32_t        flags = this->chunkFlags() | ChunkEnd;
+                    unsigned char   parent[64];
+
+                    std::memset(this->block + this->blockLength, 0, sizeof(this->block) - this->blockLength);
+
+                    // the output of the last chunk goes up through every pending parent, the last compression being the root
+                    if (this->depth == 0)
+                    {
+                        this->compress(this->cv, this->block, this->chunk, static_cast<uint32_t>(this->blockLength), flags | Root, cv);
+                    }
+                    else
+                    {
+                        this->compress(this->cv, this->block, this->chunk, static_cast<uint32_t>(this->blockLength), flags, cv);
+                        for (std::size_t i = this->depth; i > 0; --i)
+                        {
+                            std::memcpy(parent, this->stack[i - 1], 32);
+                            this->storeWords(cv, parent + 32);
+                            this->compress(sha256Iv, parent, 0, sizeof(parent), Parent | (i == 1 ? Root : 0u), cv);
+                        }
+                    }
+
+                    this->storeWords(cv, digest);
+                }
+
+                std::size_t digestSize() const override { return 32; }
+
+            private:
+                void        startChunk()
+                {
+                    std::memcpy(this->cv, sha256Iv, sizeof(this->cv));
+                    this->blocks = 0;
+                    this->blockLength = 0;
+                }
+
+                std::size_t chunkLength() const { return this->blocks * sizeof(this->block) + this->blockLength; }
+                uint32_t    chunkFlags() const { return this->blocks == 0 ? ChunkStart : 0u; }
+
+                // merges the chaining values of complete subtrees, one per trailing zero of the chunk count
+                void        pushChunk(const uint32_t cv[8])
+                {
+                    unsigned char   parent[64];
+                    uint32_t        merged[8];
+
+                    std::memcpy(merged, cv, sizeof(merged));
+                    for (uint64_t total = this->chunk + 1; (total & 1) == 0; total >>= 1)
+                    {
+                        std::memcpy(parent, this->stack[--this->depth], 32);
+                        this->storeWords(merged, parent + 32);
+                        this->compress(sha256Iv, parent, 0, sizeof(parent), Parent, merged);
+                    }
+                    this->storeWords(merged, this->stack[this->depth++]);
+                }
+
+                static void storeWords(const uint32_t words[8], unsigned char *bytes)
+                {
+                    for (int i = 0; i < 8; ++i)
+                    {
+                        bytes[4 * i] = static_cast<unsigned char>(words[i]);
+                        bytes[4 * i + 1] = static_cast<unsigned char>(words[i] >> 8);
+                        bytes[4 * i + 2] = static_cast<unsigned char>(words[i] >> 16);
+                        bytes[4 * i + 3] = static_cast<unsigned char>(words[i] >> 24);
+                    }
+                }
+
+                Blake3Compress  compress;
+                uint32_t        cv[8];
+                unsigned char   block[64];
+                std::size_t     blockLength = 0;
+                std::size_t     blocks = 0;
+                uint64_t        chunk = 0;
+                unsigned char   stack[54][32];      // enough for 2^64 bytes
+                std::size_t     depth = 0;
+        };
+
+#ifdef SCAE_HASH_X86
+        /*
+            Multi-buffer MD5 and SHA-256: lane l of every vector works on message l of a group,
+            the current block of every message being transposed so that word w of all of them
+            forms one vector. The kernels are written once with the GCC vector extensions and
+            compiled for SSE2 (4 lanes), AVX2 (8) and AVX-512F (16) by inlining them in functions
+            built for each target. Messages of a group may have different lengths: a lane keeps
+            its state once its message has no block left.
+        */
+        typedef uint32_t    Lanes4 __attribute__((vector_size(16)));
+        typedef uint32_t    Lanes8 __attribute__((vector_size(32)));
+        typedef uint32_t    Lanes16 __attribute__((vector_size(64)));
+
+        const std::size_t   maxLanes = 16;
+
+        // messages padded to whole blocks, unused lanes having no block
+        struct Group
+        {
+            const unsigned char *messages[maxLanes];
+            uint32_t            blocks[maxLanes];
+        };
+
+        using GroupKernel = void (*)(const Group &group, unsigned char *digests);
+
+        const uint32_t  md5K[64] = {
+            0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+            0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+            0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+            0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+            0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+            0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+            0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+            0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391
+        };
+
+        const int       md5Shift[4][4] = { { 7, 12, 17, 22 }, { 5, 9, 14, 20 }, { 4, 11, 16, 23 }, { 6, 10, 15, 21 } };
+
+        const uint32_t  md5Iv[4] = { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476 };
+
+        // word w of block b of every lane, in the byte order of the algorithm
+        template<typename V, std::size_t L>
+        __attribute__((always_inline)) inline void transpose(const Group &group, std::size_t b, bool bigEndian, V words[16])
+        {
+            for (std::size_t l = 0; l < L; ++l)
+            {
+                const unsigned char *block = group.messages[l] + 64 * (b < group.blocks[l] ? b : 0);
+
+                for (int w = 0; w < 16; ++w)
+                {
+                    words[w][l] = bigEndian ? loadBigEndian(block + 4 * w) : loadLittleEndian(block + 4 * w);
+                }
+            }
+        }
+
+        // lanes whose message still has block b
+        template<typename V, std::size_t L>
+        __attribute__((always_inline)) inline void active(const Group &group, std::size_t b, V &mask)
+        {
+            for (std::size_t l = 0; l < L; ++l)
+            {
+                mask[l] = b < group.blocks[l] ? 0xffffffffu : 0;
+            }
+        }
+
+        template<typename V, std::size_t L>
+        __attribute__((always_inline)) inline void md5Lanes(const Group &group, unsigned char *digests)
+        {
+            std::size_t blocks = *std::max_element(group.blocks, group.blocks + L);
+            V           state[4];
+            V           m[16];
+
+            for (int i = 0; i < 4; ++i)
+            {
+                state[i] = V{} + md5Iv[i];
+            }
+
+            for (std::size_t b = 0; b < blocks; ++b)
+            {
+                V mask;
+                V a = state[0], bb = state[1], c = state[2], d = state[3];
+
+                active<V, L>(group, b, mask);
+                transpose<V, L>(group, b, false, m);
+
+#pragma GCC unroll 64
+                for (int i = 0; i < 64; ++i)
+                {
+                    V   f;
+                    int g;
+
+                    if (i < 16)
+                    {
+                        f = d ^ (bb & (c ^ d));
+                        g = i;
+                    }
+                    else if (i < 32)
+                    {
+                        f = c ^ (d & (bb ^ c));
+                        g = (5 * i + 1) & 15;
+                    }
+                    else if (i < 48)
+                    {
+                        f = bb ^ c ^ d;
+                        g = (3 * i + 5) & 15;
+                    }
+                    else
+                    {
+                        f = c ^ (bb | ~d);
+                        g = (7 * i) & 15;
+                    }
+
+                    int shift = md5Shift[i >> 4][i & 3];
+
+                    f = f + a + md5K[i] + m[g];
+                    a = d;
+                    d = c;
+                    c = bb;
+                    bb = bb + ((f << shift) | (f >> (32 - shift)));
+                }
+
+                state[0] += (a & mask);
+                state[1] += (bb & mask);
+                state[2] += (c & mask);
+                state[3] += (d & mask);
+            }
+
+            for (std::size_t l = 0; l < L; ++l)
+            {
+                for (int i = 0; i < 4; ++i)
+                {
+                    for (int j = 0; j < 4; ++j)
+                    {
+                        digests[16 * l + 4 * i + j] = static_cast<unsigned char>(state[i][l] >> (8 * j));
+                    }
+                }
+            }
+        }
+
+        template<typename V, std::size_t L>
+        __attribute__((always_inline)) inline void sha256Lanes(const Group &group, unsigned char *digests)
+        {
+            std::size_t blocks = *std::max_element(group.blocks, group.blocks + L);
+            V           state[8];
+            V           w[64];
+
+            for (int i = 0; i < 8; ++i)
+            {
+                state[i] = V{} + sha256Iv[i];
+            }
+
+            for (std::size_t b = 0; b < blocks; ++b)
+            {
+                V mask;
+
+                active<V, L>(group, b, mask);
+                transpose<V, L>(group, b, true, w);
+                for (int i = 16; i < 64; ++i)
+                {
+                    V s0 = ((w[i - 15] >> 7) | (w[i - 15] << 25)) ^ ((w[i - 15] >> 18) | (w[i - 15] << 14)) ^ (w[i - 15] >> 3);
+                    V s1 = ((w[i - 2] >> 17) | (w[i - 2] << 15)) ^ ((w[i - 2] >> 19) | (w[i - 2] << 13)) ^ (w[i - 2] >> 10);
+                    w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+                }
+
+                V a = state[0], bb = state[1], c = state[2], d = state[3];
+                V e = state[4], f = state[5], g = state[6], h = state[7];
+
+                for (int i = 0; i < 64; ++i)
+                {
+                    V s1 = ((e >> 6) | (e << 26)) ^ ((e >> 11) | (e << 21)) ^ ((e >> 25) | (e << 7));
+                    V s0 = ((a >> 2) | (a << 30)) ^ ((a >> 13) | (a << 19)) ^ ((a >> 22) | (a << 10));
+                    V t1 = h + s1 + (g ^ (e & (f ^ g))) + sha256K[i] + w[i];
+                    V t2 = s0 + ((a & bb) | (c & (a | bb)));
+
+                    h = g;
+                    g = f;
+                    f = e;
+                    e = d + t1;
+                    d = c;
+                    c = bb;
+                    bb = a;
+                    a = t1 + t2;
+                }
+
+                state[0] += (a & mask);
+                state[1] += (bb & mask);
+                state[2] += (c & mask);
+                state[3] += (d & mask);
+                state[4] += (e & mask);
+                state[5] += (f & mask);
+                state[6] += (g & mask);
+                state[7] += (h & mask);
+            }
+
+            for (std::size_t l = 0; l < L; ++l)
+            {
+                for (int i = 0; i < 8; ++i)
+                {
+                    for (int j = 0; j < 4; ++j)
+                    {
+                        digests[32 * l + 4 * i + j] = static_cast<unsigned char>(state[i][l] >> (24 - 8 * j));
+                    }
+                }
+            }
+        }
+
+        void    md5Sse2(const Group &group, unsigned char *digests) { md5Lanes<Lanes4, 4>(group, digests); }
+        void    sha256Sse2(const Group &group, unsigned char *digests) { sha256Lanes<Lanes4, 4>(group, digests); }
+
+        __attribute__((target("avx2")))
+        void    md5Avx2(const Group &group, unsigned char *digests) { md5Lanes<Lanes8, 8>(group, digests); }
+        __attribute__((target("avx2")))
+        void    sha256Avx2(const Group &group, unsigned char *digests) { sha256Lanes<Lanes8, 8>(group, digests); }
+
+        __attribute__((target("avx512f")))
+        void    md5Avx512(const Group &group, unsigned char *digests) { md5Lanes<Lanes16, 16>(group, digests); }
+        __attribute__((target("avx512f")))
+        void    sha256Avx512(const Group &group, unsigned char *digests) { sha256Lanes<Lanes16, 16>(group, digests); }
+
+        struct LaneKernel
+        {
+            std::size_t lanes;
+            GroupKernel md5;
+            GroupKernel sha256;
+            const char  *path;
+        };
+
+        // from the narrowest to the widest the CPU supports: a group is hashed by the narrowest one it fills
+        struct LaneKernels
+        {
+            LaneKernel  kernels[3];
+            std::size_t count = 0;
+
+            LaneKernels()
+            {
+                __builtin_cpu_init();
+                this->kernels[this->count++] = LaneKernel{ 4, md5Sse2, sha256Sse2, "sse2" };
+                if (__builtin_cpu_supports("avx2"))
+                {
+                    this->kernels[this->count++] = LaneKernel{ 8, md5Avx2, sha256Avx2, "avx2" };
+                }
+                if (__builtin_cpu_supports("avx512f"))
+                {
+                    this->kernels[this->count++] = LaneKernel{ 16, md5Avx512, sha256Avx512, "avx512f" };
+                }
+            }
+
+            const LaneKernel    &widest() const { return this->kernels[this->count - 1]; }
+
+            const LaneKernel    &fitting(std::size_t messages) const
+            {
+                for (std::size_t i = 0; i + 1 < this->count; ++i)
+                {
+                    if (messages <= this->kernels[i].lanes)
+                    {
+                        return this->kernels[i];
+                    }
+                }
+                return this->widest();
+            }
+        };
+
+        const LaneKernels   &laneKernels()
+        {
+            static const LaneKernels supported;
+            return supported;
+        }
+
+        // SHA-NI hashes one message faster than the lane kernels hash a group of less than 8
+        const std::size_t   shaNiGroup = 8;
+#endif
+
+        static_assert(sizeof(QtBackend) <= storageSize && sizeof(Sha256Backend) <= storageSize && sizeof(Blake3Backend) <= storageSize, "HashBackend::storageSize is too small");
+    }
+
+    Backend     *create(Algorithm algorithm, void *storage)
+    {
+        switch (algorithm)
+        {
+            case Algorithm::Sha256:
+                return new (storage) Sha256Backend();
+            case Algorithm::Blake3:
+                return new (storage) Blake3Backend();
+            case Algorithm::Md5:
+                break;
+        }
+        return new (storage) QtBackend(QCryptographicHash::Algorithm::Md5);
+    }
+
+    std::size_t digestSize(Algorithm algorithm)
+    {
+        return algorithm == Algorithm::Md5 ? 16 : 32;
+    }
+
+    std::size_t lanes(Algorithm algorithm)
+    {
+#ifdef SCAE_HASH_X86
+        if (algorithm == Algorithm::Md5 || algorithm == Algorithm::Sha256)
+        {
+            return laneKernels().widest().lanes;
+        }
+#endif
+        (void)algorithm;
+        return 1;
+    }
+
+    void        hashMany(Algorithm algorithm, const char *data, const std::size_t *offsets, std::size_t count, unsigned char *digests)
+    {
+        typename std::aligned_storage<storageSize, 16>::type storage;
+
+        std::size_t size = digestSize(algorithm);
+        std::size_t first = 0;
+
+#ifdef SCAE_HASH_X86
+        if (lanes(algorithm) > 1)
+        {
+            static const unsigned char  none[64] = {};
+            std::vector<unsigned char>  padded;
+            unsigned char               laneDigests[maxLanes * maxDigestSize];
+            std::size_t                 smallest = 2;
+
+            if (algorithm == Algorithm::Sha256 && cpu().sha)
+            {
+                smallest = (laneKernels().widest().lanes >= shaNiGroup) ? shaNiGroup : count + 1;
+            }
+
+            while (count - first >= smallest)
+            {
+                const LaneKernel    &kernel = laneKernels().fitting(count - first);
+                std::size_t         n = std::min(kernel.lanes, count - first);
+                std::size_t         total = 0;
+                Group               group;
+
+                for (std::size_t l = 0; l < n; ++l)
+                {
+                    total += ((offsets[first + l + 1] - offsets[first + l] + 8) / 64 + 1) * 64;
+                }
+                padded.assign(total, 0);
+
+                // 0x80, zeros, then the length in bits: little endian for MD5, big endian for SHA-256
+                unsigned char *out = padded.data();
+                for (std::size_t l = 0; l < maxLanes; ++l)
+                {
+                    if (l >= n)
+                    {
+                        group.messages[l] = none;
+                        group.blocks[l] = 0;
+                        continue;
+                    }
+
+                    std::size_t length = offsets[first + l + 1] - offsets[first + l];
+                    std::size_t blocks = (length + 8) / 64 + 1;
+                    uint64_t    bits = static_cast<uint64_t>(length) * 8;
+
+                    std::memcpy(out, data + offsets[first + l], length);
+                    out[length] = 0x80;
+                    for (int i = 0; i < 8; ++i)
+                    {
+                        out[blocks * 64 - (algorithm == Algorithm::Md5 ? 8 - i : 1 + i)] = static_cast<unsigned char>(bits >> (8 * i));
+                    }
+
+                    group.messages[l] = out;
+                    group.blocks[l] = static_cast<uint32_t>(blocks);
+                    out += blocks * 64;
+                }
+
+                (algorithm == Algorithm::Md5 ? kernel.md5 : kernel.sha256)(group, laneDigests);
+                std::memcpy(digests + first * size, laneDigests, n * size);
+                first += n;
+            }
+        }
+#endif
+
+        // what is left is hashed one message at a time
+        for (; first < count; ++first)
+        {
+            Backend *backend = create(algorithm, &storage);
+
+            backend->update(data + offsets[first], offsets[first + 1] - offsets[first]);
+            backend->finalize(digests + first * size);
+            backend->~Backend();
+        }
+    }
+
+    const char  *lanesImplementation(Algorithm algorithm)
+    {
+#ifdef SCAE_HASH_X86
+        if (lanes(algorithm) > 1)
+        {
+            return laneKernels().widest().path;
+        }
+#endif
+        return implementation(algorithm);
+    }
+
+    const char  *implementation(Algorithm algorithm)
+    {
+        switch (algorithm)
+        {
+            case Algorithm::Sha256:
+                return sha256Compress() == sha256Portable ? "portable" : "sha-ni";
+            case Algorithm::Blake3:
+                return blake3Compress() == blake3Portable ? "portable" : "sse4.1";
+            case Algorithm::Md5:
+                break;
+        }
+        return "qt";
+    }
+
+    const char  *name(Algorithm algorithm)
+    {
+        switch (algorithm)
+        {
+            case Algorithm::Sha256:
+                return "sha256";
+            case Algorithm::Blake3:
+                return "blake3";
+            case Algorithm::Md5:
+                break;
+        }
+        return "md5";
+    }
+
+    bool        parse(const std::string &text, Algorithm &algorithm)
+    {
+        for (Algorithm candidate : { Algorithm::Md5, Algorithm::Sha256, Algorithm::Blake3 })
+        {
+            if (text == name(candidate))
+            {
+                algorithm = candidate;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    Algorithm   defaultAlgorithm()
+    {
+        static const Algorithm configured = []() {
+            Algorithm   algorithm = Algorithm::Md5;
+            const char  *text = std::getenv("SCAE_HASH");
+
+            if (text != nullptr && *text != '\0' && !parse(text, algorithm))
+            {
+                std::cerr << "Unknown SCAE_HASH \"" << text << "\", using md5" << std::endl;
+            }
+            return algorithm;
+        }();
+
+        return configured;
+    }
+}
@@ -0,0 +1,63 @@
+#include <cstddef>
+#include <string>
+
+#pragma once
+
+/*
+    Hash functions behind CommonUtils::hash and Hasher.
+
+    MD5 goes through QCryptographicHash. SHA-256 uses the SHA extensions of the CPU when CPUID
+    reports them and portable code otherwise, BLAKE3 compresses with SSE4.1 or portable code.
+    Every implementation of an algorithm gives the same digest, only its speed changes.
+
+    The hashes are part of the protocol: the Client, the Gateway and the Server of a deployment
+    must use the same algorithm, read from the SCAE_HASH environment variable (md5, sha256 or
+    blake3, md5 when it is not set).
+*/
+namespace HashBackend
+{
+    enum class Algorithm
+    {
+        Md5,
+        Sha256,
+        Blake3
+    };
+
+    class Backend
+    {
+        public:
+            virtual ~Backend() = default;
+
+            virtual void        update(const char *data, std::size_t size) = 0;
+            // writes digestSize() bytes to digest, nothing can be added afterwards
+            virtual void        finalize(unsigned char *digest) = 0;
+            virtual std::size_t digestSize() const = 0;
+    };
+
+    const std::size_t   maxDigestSize = 32;
+    const std::size_t   storageSize = 2048;     // what create() needs for any backend, 16 bytes aligned
+
+    // constructs the fastest backend of algorithm in storage, the caller destroys it
+    Backend     *create(Algorithm algorithm, void *storage);
+
+    // name of the implementation create() picks, for the logs and benchmarks
+    const char  *implementation(Algorithm algorithm);
+
+    std::size_t digestSize(Algorithm algorithm);
+
+    /*
+        Multi-buffer hashing of independent messages, message i being data[offsets[i], offsets[i + 1])
+        and its digest written at digests + i * digestSize(algorithm). MD5 and SHA-256 messages
+        are hashed lanes() at a time in the SIMD lanes of the CPU (4 with SSE2, 8 with AVX2,
+        16 with AVX-512F), the other algorithms one after the other.
+    */
+    void        hashMany(Algorithm algorithm, const char *data, const std::size_t *offsets, std::size_t count, unsigned char *digests);
+    std::size_t lanes(Algorithm algorithm);
+    const char  *lanesImplementation(Algorithm algorithm);
+
+    const char  *name(Algorithm algorithm);
+    bool        parse(const std::string &name, Algorithm &algorithm);
+
+    // the algorithm of the deployment, SCAE_HASH being read on first use
+    Algorithm   defaultAlgorithm();
+}
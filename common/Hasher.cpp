@@ -0,0 +1,40 @@
+#include "Hasher.hpp"
+
+Hasher::Hasher(const char *operationName, HashBackend::Algorithm algorithm) : backend(HashBackend::create(algorithm, &this->storage)), timer(operationName, "_hash")
+{}
+
+Hasher::~Hasher()
+{
+    this->backend->~Backend();
+}
+
+Hasher  &Hasher::update(const char *data, std::size_t size)
+{
+    this->backend->update(data, size);
+    return *this;
+}
+
+Hasher  &Hasher::update(const Digest &field)
+{
+    char    text[2 * Digest::maxSize];
+
+    field.hex(text);
+    return this->update(text, 2 * field.size());
+}
+
+Digest  Hasher::finalize()
+{
+    unsigned char   digest[HashBackend::maxDigestSize];
+
+    this->backend->finalize(digest);
+    this->timer.stop();
+    return Digest(digest, this->backend->digestSize());
+}
+
+std::string Hasher::toHex(const unsigned char *digest, std::size_t size)
+{
+    std::string hex(size * 2, '\0');
+
+    Digest::toHex(digest, size, &hex[0]);
+    return hex;
+}
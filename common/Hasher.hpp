@@ -0,0 +1,38 @@
+#include <string>
+#include <type_traits>
+#include "Digest.hpp"
+#include "HashBackend.hpp"
+#include "QTimings.h"
+
+#pragma once
+
+// Incremental hash of the fields of a protocol value, fed one by one instead of being
+// concatenated first: (Hasher("hash-c1") << cid << random << wP).finalize()
+// equals hash(cid + random + wP, "hash-c1")
+class Hasher
+{
+    public:
+        // a non empty operationName, a string literal, times the hash as "<operationName>_hash" like CommonUtils::hash
+        explicit Hasher(const char *operationName = "", HashBackend::Algorithm algorithm = HashBackend::defaultAlgorithm());
+        ~Hasher();
+        Hasher(const Hasher &) = delete;
+        Hasher &operator=(const Hasher &) = delete;
+
+        Hasher      &update(const char *data, std::size_t size);
+        Hasher      &update(const std::string &field) { return this->update(field.data(), field.size()); }
+        // a digest field is hashed as its hexadecimal text, see Digest
+        Hasher      &update(const Digest &field);
+        Hasher      &operator<<(const std::string &field) { return this->update(field); }
+        Hasher      &operator<<(const Digest &field) { return this->update(field); }
+
+        // nothing can be added afterwards
+        Digest      finalize();
+
+        static std::string  toHex(const unsigned char *digest, std::size_t size);
+
+    private:
+        // the backend lives in the Hasher itself, hashing does not allocate
+        std::aligned_storage<HashBackend::storageSize, 16>::type    storage;
+        HashBackend::Backend                                        *backend;
+        QTimings::Timer                                             timer;
+};
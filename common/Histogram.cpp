@@ -0,0 +1,75 @@
+#include <algorithm>
+#include <cmath>
+#include "Histogram.hpp"
+
+Histogram::Histogram() : sum(0)
+{
+    for (std::atomic<uint64_t> &count : this->counts)
+    {
+        count.store(0, std::memory_order_relaxed);
+    }
+}
+
+void    Histogram::addTo(std::vector<uint64_t> &totals) const
+{
+    for (std::size_t i = 0; i < bucketCount; ++i)
+    {
+        totals[i] += this->counts[i].load(std::memory_order_relaxed);
+    }
+}
+
+std::size_t Histogram::index(uint64_t value)
+{
+    if (value < 256)
+    {
+        return static_cast<std::size_t>(value);
+    }
+
+    // the 8 leading bits of the value: the power of two, then one of its 128 buckets
+    int shift = 63 - __builtin_clzll(value) - 7;
+    if (shift > 35)
+    {
+        return bucketCount - 1;
+    }
+    return 256 + static_cast<std::size_t>(shift - 1) * 128 + static_cast<std::size_t>((value >> shift) - 128);
+}
+
+uint64_t    Histogram::highest(std::size_t index)
+{
+    if (index < 256)
+    {
+        return index;
+    }
+
+    int         shift = static_cast<int>((index - 256) / 128) + 1;
+    uint64_t    lowest = (128 + (index - 256) % 128) << shift;
+
+    return lowest + (uint64_t(1) << shift) - 1;
+}
+
+uint64_t    Histogram::percentile(const std::vector<uint64_t> &totals, double fraction)
+{
+    uint64_t total = 0;
+
+    for (uint64_t count : totals)
+    {
+        total += count;
+    }
+    if (total == 0)
+    {
+        return 0;
+    }
+
+    uint64_t rank = std::max<uint64_t>(static_cast<uint64_t>(std::ceil(fraction * static_cast<double>(total))), 1);
+    uint64_t seen = 0;
+
+    for (std::size_t i = 0; i < totals.size(); ++i)
+    {
+        seen += totals[i];
+        if (seen >= rank)
+        {
+            return Histogram::highest(i);
+        }
+    }
+    return Histogram::highest(totals.size() - 1);
+}
@@ -0,0 +1,47 @@
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#pragma once
+
+/*
+    Fixed size log-linear histogram of durations in nanoseconds, after HdrHistogram: values
+    below 256 have their own bucket, every power of two above is split in 128 buckets, so a
+    recorded value is known within 1%. Values from 2^43 ns (about 2.4 hours) share the last bucket.
+
+    A single thread records, any thread may read at the same time: the counters are relaxed
+    atomics, incremented without a read-modify-write since nobody else writes them.
+*/
+class Histogram
+{
+    public:
+        static const std::size_t    bucketCount = 256 + 35 * 128;
+
+        Histogram();
+        Histogram(const Histogram &) = delete;
+        Histogram &operator=(const Histogram &) = delete;
+
+        void    record(uint64_t value)
+        {
+            std::atomic<uint64_t> &count = this->counts[Histogram::index(value)];
+            count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            this->sum.store(this->sum.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+        }
+
+        // sum of the recorded values
+        uint64_t    total() const { return this->sum.load(std::memory_order_relaxed); }
+
+        // adds the counts to totals, which holds bucketCount elements
+        void    addTo(std::vector<uint64_t> &totals) const;
+
+        static std::size_t  index(uint64_t value);
+        // highest value counted in the bucket
+        static uint64_t     highest(std::size_t index);
+        // value that fraction (0.5, 0.99...) of the samples counted in totals do not exceed
+        static uint64_t     percentile(const std::vector<uint64_t> &totals, double fraction);
+
+    private:
+        std::atomic<uint64_t>   counts[bucketCount];
+        std::atomic<uint64_t>   sum;
+};
@@ -0,0 +1,211 @@
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <vector>
+#include "Metrics.hpp"
+#include "Histogram.hpp"
+#include "QTimings.h"
+
+namespace Metrics
+{
+    namespace
+    {
+        struct Family
+        {
+            std::string                                                     type;
+            std::string                                                     help;
+            std::map<std::string, std::unique_ptr<std::atomic<uint64_t>>>   counters;
+            std::map<std::string, std::unique_ptr<std::atomic<int64_t>>>    gauges;
+        };
+
+        struct Sampled
+        {
+            std::string                 help;
+            std::function<double()>     sample;
+        };
+
+        std::mutex                      familiesLock;
+        std::map<std::string, Family>   families;
+
+        // held while the callbacks run, so that removeSampled() waits for them: they may use what their
+        // owner destroys once it returns. Never taken with familiesLock held
+        std::mutex                      samplesLock;
+        std::map<std::string, Sampled>  samples;
+
+        Family  &family(const std::string &name, const char *type, const std::string &help)
+        {
+            Family &found = families[name];
+
+            if (found.type.empty())
+            {
+                found.type = type;
+                found.help = help;
+            }
+            return found;
+        }
+
+        // upper bounds of the latency buckets, in seconds
+        const double    latencyBounds[] = {
+            0.00001, 0.000025, 0.00005, 0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005,
+            0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10
+        };
+
+        void    header(std::ostringstream &out, const std::string &name, const std::string &type, const std::string &help)
+        {
+            out << "# HELP " << name << " " << help << "\n";
+            out << "# TYPE " << name << " " << type << "\n";
+        }
+
+        void    series(std::ostringstream &out, const std::string &name, const std::string &labels)
+        {
+            out << name;
+            if (!labels.empty())
+            {
+                out << "{" << labels << "}";
+            }
+            out << " ";
+        }
+    }
+
+    std::atomic<uint64_t>   &counter(const std::string &name, const std::string &help, const std::string &labels)
+    {
+        std::lock_guard<std::mutex>             lock(familiesLock);
+        std::unique_ptr<std::atomic<uint64_t>>  &value = family(name, "counter", help).counters[labels];
+
+        if (!value)
+        {
+            value.reset(new std::atomic<uint64_t>(0));
+        }
+        return *value;
+    }
+
+    std::atomic<int64_t>    &gauge(const std::string &name, const std::string &help, const std::string &labels)
+    {
+        std::lock_guard<std::mutex>             lock(familiesLock);
+        std::unique_ptr<std::atomic<int64_t>>   &value = family(name, "gauge", help).gauges[labels];
+
+        if (!value)
+        {
+            value.reset(new std::atomic<int64_t>(0));
+        }
+        return *value;
+    }
+
+    void    sampled(const std::string &name, const std::string &help, std::function<double()> sample)
+    {
+        std::lock_guard<std::mutex> lock(samplesLock);
+
+        samples[name] = Sampled{ help, std::move(sample) };
+    }
+
+    void    removeSampled(const std::string &name)
+    {
+        std::lock_guard<std::mutex> lock(samplesLock);
+
+        samples.erase(name);
+    }
+
+    std::string label(const std::string &key, const std::string &value)
+    {
+        std::string escaped = key + "=\"";
+
+        for (char c : value)
+        {
+            if (c == '\\' || c == '"')
+            {
+                escaped += '\\';
+                escaped += c;
+            }
+            else if (c == '\n')
+            {
+                escaped += "\\n";
+            }
+            else
+            {
+                escaped += c;
+            }
+        }
+        return escaped + "\"";
+    }
+
+    std::string render()
+    {
+        std::ostringstream  out;
+
+        out.precision(15);
+        {
+            std::lock_guard<std::mutex> lock(familiesLock);
+
+            for (const auto &entry : families)
+            {
+                const std::string   &name = entry.first;
+                const Family        &family = entry.second;
+
+                if (family.counters.empty() && family.gauges.empty())
+                {
+                    continue;
+                }
+
+                header(out, name, family.type, family.help);
+                for (const auto &counter : family.counters)
+                {
+                    series(out, name, counter.first);
+                    out << counter.second->load(std::memory_order_relaxed) << "\n";
+                }
+                for (const auto &gauge : family.gauges)
+                {
+                    series(out, name, gauge.first);
+                    out << gauge.second->load(std::memory_order_relaxed) << "\n";
+                }
+            }
+        }
+
+        // the callbacks may take other locks, familiesLock is not held anymore
+        {
+            std::lock_guard<std::mutex> lock(samplesLock);
+
+            for (const auto &entry : samples)
+            {
+                header(out, entry.first, "gauge", entry.second.help);
+                series(out, entry.first, "");
+                out << entry.second.sample() << "\n";
+            }
+        }
+
+        // every QTimings step, cumulated over the buckets of its histogram
+        std::vector<QTimings::Distribution> distributions = QTimings::getDistributions();
+        const std::string                   name = "scae_stage_duration_seconds";
+
+        if (!distributions.empty())
+        {
+            header(out, name, "histogram", "Duration of each timed step, by QTimings name.");
+        }
+        for (const QTimings::Distribution &distribution : distributions)
+        {
+            std::string stage = label("stage", distribution.name);
+            uint64_t    cumulated = 0;
+            std::size_t i = 0;
+
+            for (double bound : latencyBounds)
+            {
+                for (; i < distribution.buckets.size() && Histogram::highest(i) <= static_cast<uint64_t>(bound * 1e9); ++i)
+                {
+                    cumulated += distribution.buckets[i];
+                }
+                std::ostringstream le;
+                le << bound;
+                series(out, name + "_bucket", stage + "," + label("le", le.str()));
+                out << cumulated << "\n";
+            }
+            series(out, name + "_bucket", stage + ",le=\"+Inf\"");
+            out << distribution.count << "\n";
+            series(out, name + "_sum", stage);
+            out << distribution.sum / 1e9 << "\n";
+            series(out, name + "_count", stage);
+            out << distribution.count << "\n";
+        }
+
+        return out.str();
+    }
+}
@@ -0,0 +1,43 @@
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+#pragma once
+
+/*
+    Metrics of the process, rendered in the Prometheus text format (which OpenMetrics scrapers
+    also read) together with one latency histogram per QTimings step.
+
+    counter() and gauge() return a reference valid for the life of the process: looking a series
+    up takes a lock, updating it does not, so hot paths keep the reference in a static.
+*/
+namespace Metrics
+{
+    // labels is the text between the braces of the series, built with label()
+    std::atomic<uint64_t>   &counter(const std::string &name, const std::string &help, const std::string &labels = "");
+    std::atomic<int64_t>    &gauge(const std::string &name, const std::string &help, const std::string &labels = "");
+
+    // a gauge whose value is asked to sample at each rendering, until removed
+    void    sampled(const std::string &name, const std::string &help, std::function<double()> sample);
+    // once it returns sample is not running and will not run again, what it uses can be destroyed
+    void    removeSampled(const std::string &name);
+
+    // key="value", the value escaped
+    std::string label(const std::string &key, const std::string &value);
+
+    std::string render();
+
+    // keeps a gauge raised while it lives
+    class InFlight
+    {
+        public:
+            explicit InFlight(std::atomic<int64_t> &gauge) : gauge(gauge) { ++this->gauge; }
+            ~InFlight() { --this->gauge; }
+            InFlight(const InFlight &) = delete;
+            InFlight &operator=(const InFlight &) = delete;
+
+        private:
+            std::atomic<int64_t>    &gauge;
+    };
+}
@@ -0,0 +1,100 @@
+#include <iostream>
+#include <memory>
+#include <QMetaObject>
+#include <QTcpSocket>
+#include "MetricsServer.hpp"
+#include "Metrics.hpp"
+
+// a scrape request is a few hundred bytes, anything larger is not one
+static const int    maxRequestSize = 8192;
+
+MetricsServer::MetricsServer() : server(nullptr)
+{
+    this->moveToThread(&this->thread);
+}
+
+MetricsServer::~MetricsServer()
+{
+    this->stop();
+}
+
+bool    MetricsServer::start(quint16 port)
+{
+    bool    listening = false;
+
+    this->thread.start();
+    QMetaObject::invokeMethod(this, [this, port, &listening]() {
+        this->server = new QTcpServer(this);
+        listening = this->server->listen(QHostAddress::LocalHost, port);
+        if (!listening)
+        {
+            std::cerr << "Could not start metrics endpoint: " << this->server->errorString().toStdString() << std::endl;
+            return;
+        }
+        QObject::connect(this->server, &QTcpServer::newConnection, this, [this]() { this->acceptConnections(); });
+    }, Qt::BlockingQueuedConnection);
+
+    if (!listening)
+    {
+        this->stop();
+    }
+    return listening;
+}
+
+void    MetricsServer::stop()
+{
+    if (!this->thread.isRunning())
+    {
+        return;
+    }
+
+    // the sockets have to be destroyed by the thread they live in
+    QMetaObject::invokeMethod(this, [this]() {
+        const QObjectList pending = this->children();
+        qDeleteAll(pending);
+        this->server = nullptr;
+    }, Qt::BlockingQueuedConnection);
+
+    this->thread.quit();
+    this->thread.wait();
+}
+
+void    MetricsServer::acceptConnections()
+{
+    while (QTcpSocket *socket = this->server->nextPendingConnection())
+    {
+        std::shared_ptr<QByteArray> received = std::make_shared<QByteArray>();
+
+        socket->setParent(this);
+        QObject::connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+        QObject::connect(socket, &QTcpSocket::readyRead, socket, [socket, received]() {
+            received->append(socket->readAll());
+            if (received->size() > maxRequestSize)
+            {
+                socket->abort();
+                return;
+            }
+            if (!received->contains("\r\n\r\n"))
+            {
+                return;
+            }
+
+            QByteArray  status = "404 Not Found";
+            QByteArray  body = "Not Found\n";
+
+            // only the request line matters, the headers are ignored
+            if (received->startsWith("GET /metrics ") || received->startsWith("GET /metrics?"))
+            {
+                status = "200 OK";
+                body = QByteArray::fromStdString(Metrics::render());
+            }
+            received->clear();
+
+            socket->write("HTTP/1.1 " + status + "\r\n"
+                          "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+                          "Content-Length: " + QByteArray::number(body.size()) + "\r\n"
+                          "Connection: close\r\n\r\n" + body);
+            socket->disconnectFromHost();
+        });
+    }
+}
@@ -0,0 +1,23 @@
+#include <QObject>
+#include <QThread>
+#include <QTcpServer>
+
+#pragma once
+
+// Serves Metrics::render() at GET /metrics on the loopback interface, from its own thread
+class MetricsServer : public QObject
+{
+    public:
+        MetricsServer();
+        ~MetricsServer();
+
+        // returns false when the port can not be listened on
+        bool    start(quint16 port);
+        void    stop();
+
+    private:
+        void    acceptConnections();
+
+        QThread     thread;
+        QTcpServer  *server;
+};
@@ -0,0 +1,47 @@
+#include "MultiHasher.hpp"
+#include "QTimings.h"
+
+MultiHasher::MultiHasher(const char *operationName, HashBackend::Algorithm algorithm) : algorithm(algorithm), operationName(operationName)
+{
+    this->data.reserve(256);
+}
+
+MultiHasher &MultiHasher::add()
+{
+    this->offsets.push_back(this->data.size());
+    return *this;
+}
+
+MultiHasher &MultiHasher::update(const char *data, std::size_t size)
+{
+    this->data.append(data, size);
+    return *this;
+}
+
+MultiHasher &MultiHasher::update(const Digest &field)
+{
+    char    text[2 * Digest::maxSize];
+
+    field.hex(text);
+    return this->update(text, 2 * field.size());
+}
+
+std::vector<Digest>     MultiHasher::finalize()
+{
+    std::size_t                 count = this->offsets.size();
+    std::size_t                 size = HashBackend::digestSize(this->algorithm);
+    std::vector<unsigned char>  bytes(count * size);
+    std::vector<Digest>         digests;
+    QTimings::Timer             timer(this->operationName, "_hash");
+
+    this->offsets.push_back(this->data.size());
+    HashBackend::hashMany(this->algorithm, this->data.data(), this->offsets.data(), count, bytes.data());
+    this->offsets.pop_back();
+
+    digests.reserve(count);
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        digests.push_back(Digest(bytes.data() + i * size, size));
+    }
+    return digests;
+}
@@ -0,0 +1,37 @@
+#include <string>
+#include <vector>
+#include "Digest.hpp"
+#include "HashBackend.hpp"
+
+#pragma once
+
+// Hashes of independent messages computed together, in the SIMD lanes of the CPU when the
+// algorithm allows it (see HashBackend::hashMany). Each add() starts a message fed like a Hasher:
+//     MultiHasher hashes("hash-bi");
+//     for (...) hashes.add() << wP << time;
+//     std::vector<Digest> digests = hashes.finalize();
+class MultiHasher
+{
+    public:
+        // a non empty operationName, a string literal, times the hashing as "<operationName>_hash"
+        explicit MultiHasher(const char *operationName = "", HashBackend::Algorithm algorithm = HashBackend::defaultAlgorithm());
+
+        MultiHasher     &add();
+        MultiHasher     &update(const char *data, std::size_t size);
+        MultiHasher     &update(const std::string &field) { return this->update(field.data(), field.size()); }
+        // a digest field is hashed as its hexadecimal text, see Digest
+        MultiHasher     &update(const Digest &field);
+        MultiHasher     &operator<<(const std::string &field) { return this->update(field); }
+        MultiHasher     &operator<<(const Digest &field) { return this->update(field); }
+
+        std::size_t     size() const { return this->offsets.size(); }
+
+        // in the order of add()
+        std::vector<Digest>     finalize();
+
+    private:
+        HashBackend::Algorithm      algorithm;
+        const char                  *operationName;
+        std::string                 data;       // every message one after the other
+        std::vector<std::size_t>    offsets;    // start of each message in data
+};
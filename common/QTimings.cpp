@@ -1,61 +1,335 @@
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
 #include <stdexcept>
 #include <QStringBuilder>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
 #include "QTimings.h"
+#include "Histogram.hpp"
+#include "Trace.hpp"
 
-QTimings    QTimings::sharedInstance;
+namespace
+{
+    // every interned name, an id being its index
+    std::mutex                                      namesLock;
+    std::deque<std::string>                         names;
+    std::unordered_map<std::string, QTimings::Id>   ids;
+
+    // the histograms of one thread, one per timing name
+    class Recorder
+    {
+        public:
+            struct Stage
+            {
+                explicit Stage(const std::string &name) : name(name) {}
+
+                const std::string   name;
+                Histogram           histogram;
+            };
+
+            static const std::size_t    maxStages = 256;
+
+            // owner thread only
+            void    record(QTimings::Id id, qint64 duration)
+            {
+                if (id >= this->index.size())
+                {
+                    this->index.resize(id + 1, nullptr);
+                }
+
+                Stage   *stage = this->index[id];
+
+                if (stage == nullptr)
+                {
+                    std::size_t count = this->published.load(std::memory_order_relaxed);
+                    if (count == maxStages)
+                    {
+                        return;
+                    }
+                    this->stages[count].reset(new Stage(QTimings::nameOf(id)));
+                    stage = this->index[id] = this->stages[count].get();
+                    // the new stage is complete before readers can see it
+                    this->published.store(count + 1, std::memory_order_release);
+                }
+                stage->histogram.record(static_cast<uint64_t>(std::max<qint64>(duration, 0)));
+            }
+
+            // any thread
+            std::size_t size() const { return this->published.load(std::memory_order_acquire); }
+            const Stage &stage(std::size_t i) const { return *this->stages[i]; }
+
+        private:
+            std::vector<Stage *>                        index;      // by id
+            std::unique_ptr<Stage>                      stages[maxStages];
+            std::atomic<std::size_t>                    published{ 0 };
+    };
+
+    // every recorder ever created, kept after their thread exits
+    std::mutex                              recordersLock;
+    std::vector<std::shared_ptr<Recorder>>  recorders;
+
+    Recorder    &localRecorder()
+    {
+        thread_local std::shared_ptr<Recorder> recorder = []() {
+            std::shared_ptr<Recorder> created = std::make_shared<Recorder>();
+            std::lock_guard<std::mutex> lock(recordersLock);
+            recorders.push_back(created);
+            return created;
+        }();
+
+        return *recorder;
+    }
+
+    std::atomic<uint32_t>   &sampling()
+    {
+        static std::atomic<uint32_t>    every([]() {
+            const char  *text = std::getenv("SCAE_TIMINGS_SAMPLING");
+            char        *end = nullptr;
+
+            if (text == nullptr || *text == '\0')
+            {
+                return 1ul;
+            }
+            unsigned long value = std::strtoul(text, &end, 10);
+            if (*end != '\0' || value == 0 || value > UINT32_MAX)
+            {
+                std::cerr << "Invalid SCAE_TIMINGS_SAMPLING \"" << text << "\", timing every call" << std::endl;
+                return 1ul;
+            }
+            return value;
+        }());
+
+        return every;
+    }
+}
+
+thread_local QTimings    QTimings::sharedInstance;
+thread_local QTimings   *QTimings::current = nullptr;
 
-void    QTimings::start(const std::string &name)
+QTimings    &QTimings::getShared()
 {
-    if (!this->timer.isValid())
+    return (QTimings::current != nullptr) ? *QTimings::current : QTimings::sharedInstance;
+}
+
+QTimings::Scope::Scope(QTimings &timings) : previous(QTimings::current)
+{
+    QTimings::current = &timings;
+}
+
+QTimings::Scope::~Scope()
+{
+    QTimings::current = this->previous;
+}
+
+QTimings::TraceScope::TraceScope(QTimings &timings, const std::vector<std::string> &traces) : timings(timings), count(0)
+{
+    for (const std::string &trace : traces)
     {
-        this->timer.start();
+        if (!trace.empty())
+        {
+            this->timings.traces.push_back(trace);
+            ++this->count;
+        }
     }
-    this->starts.emplace(name, this->timer.nsecsElapsed());
 }
 
-void    QTimings::stop(const std::string &name)
+QTimings::TraceScope::~TraceScope()
+{
+    this->timings.traces.resize(this->timings.traces.size() - this->count);
+}
+
+QTimings::Id    QTimings::intern(const std::string &name)
 {
-    try
+    // each thread keeps the ids it already asked for, the shared table is locked once per name
+    thread_local std::unordered_map<std::string, Id>    known;
+
+    auto it = known.find(name);
+    if (it != known.end())
     {
-        qint64 ret = this->starts.at(name);
-        qint64 now = this->timer.nsecsElapsed();
+        return it->second;
+    }
 
-        //this->timings.emplace(name, (now - ret));
-        this->timings2.push_back(std::make_pair(name, (now - ret)));
+    std::lock_guard<std::mutex> lock(namesLock);
+    auto                        found = ids.find(name);
+    Id                          id;
+
+    if (found != ids.end())
+    {
+        id = found->second;
     }
-    catch (std::out_of_range e)
+    else
     {
-        std::cerr << "Not a timing name: " << name << ". Details: " << e.what() << std::endl;
+        id = static_cast<Id>(names.size());
+        names.push_back(name);
+        ids.emplace(name, id);
     }
+    known.emplace(name, id);
+    return id;
+}
+
+QTimings::Id    QTimings::intern(const char *name, const char *suffix)
+{
+    struct Entry
+    {
+        const char          *name;
+        const char          *suffix;
+        const std::string   *full;
+        std::size_t         nameLength;
+        Id                  id;
+    };
+    thread_local Entry  cache[64] = {};
+
+    std::size_t slot = ((reinterpret_cast<std::uintptr_t>(name) >> 3) * 31 + (reinterpret_cast<std::uintptr_t>(suffix) >> 3)) % 64;
+    Entry       &entry = cache[slot];
+
+    // the address alone could be reused by another string, the text is compared as well
+    if (entry.name == name && entry.suffix == suffix
+        && entry.full->compare(0, entry.nameLength, name) == 0
+        && entry.full->compare(entry.nameLength, std::string::npos, suffix) == 0)
+    {
+        return entry.id;
+    }
+
+    std::string full = name;
+    std::size_t nameLength = full.size();
+
+    full += suffix;
+    Id id = QTimings::intern(full);
+    entry = Entry{ name, suffix, &QTimings::nameOf(id), nameLength, id };
+    return id;
+}
+
+const std::string   &QTimings::nameOf(Id id)
+{
+    // a deque does not move its elements, the reference outlives the lock
+    std::lock_guard<std::mutex> lock(namesLock);
+
+    return names.at(id);
+}
+
+void    QTimings::setSampling(uint32_t every)
+{
+    sampling().store(std::max<uint32_t>(every, 1), std::memory_order_relaxed);
+}
+
+uint32_t    QTimings::getSampling()
+{
+    return sampling().load(std::memory_order_relaxed);
+}
+
+#ifndef SCAE_NO_TIMINGS
+void    QTimings::Timer::begin(Id id)
+{
+    uint32_t    every = sampling().load(std::memory_order_relaxed);
+
+    // each step is sampled on its own, a step called every other time is still timed
+    if (every > 1)
+    {
+        thread_local std::vector<uint32_t>  countdowns;
+
+        if (id >= countdowns.size())
+        {
+            countdowns.resize(id + 1, 0);
+        }
+        if (countdowns[id] != 0)
+        {
+            --countdowns[id];
+            return;
+        }
+        countdowns[id] = every - 1;
+    }
+
+    this->timings = &QTimings::getShared();
+    this->id = id;
+    this->started = this->timings->now();
+}
+
+void    QTimings::Timer::stop()
+{
+    if (this->timings != nullptr)
+    {
+        this->timings->finish(this->id, this->started, this->timings->now());
+        this->timings = nullptr;
+    }
+}
+
+void    QTimings::start(Id id)
+{
+    if (id >= this->starts.size())
+    {
+        this->starts.resize(id + 1, -1);
+    }
+    this->starts[id] = this->now();
+}
+
+void    QTimings::stop(Id id)
+{
+    if (id >= this->starts.size() || this->starts[id] < 0)
+    {
+        std::cerr << "Not a timing name: " << QTimings::nameOf(id) << std::endl;
+        return;
+    }
+    this->finish(id, this->starts[id], this->now());
 }
 
 void    QTimings::stopAndStart(const std::string &nameStop, const std::string &nameStart)
+{
+    Id      idStop = QTimings::intern(nameStop);
+    Id      idStart = QTimings::intern(nameStart);
+    qint64  now = this->now();
+
+    if (idStop >= this->starts.size() || this->starts[idStop] < 0)
+    {
+        std::cerr << "Not a timing name: " << nameStop << std::endl;
+    }
+    else
+    {
+        this->finish(idStop, this->starts[idStop], now);
+    }
+    if (idStart >= this->starts.size())
+    {
+        this->starts.resize(idStart + 1, -1);
+    }
+    this->starts[idStart] = now;
+}
+#endif
+
+qint64  QTimings::now()
 {
     if (!this->timer.isValid())
     {
         this->timer.start();
     }
-    qint64 now = this->timer.nsecsElapsed();
-    try
-    {
-        qint64 ret = this->starts.at(nameStop);
+    return this->timer.nsecsElapsed();
+}
 
-        //this->timings.emplace(nameStop, (now - ret));
-        this->timings2.push_back(std::make_pair(nameStop, (now - ret)));
+void    QTimings::finish(Id id, qint64 started, qint64 stopped)
+{
+    if (this->listed.size() < maxListed)
+    {
+        this->listed.push_back(std::make_pair(id, stopped - started));
+    }
+    else
+    {
+        ++this->unlisted;
     }
-    catch (std::out_of_range e)
+    this->record(id, stopped - started);
+    if (!this->traces.empty())
     {
-        std::cerr << "Not a timing name: " << nameStop << ". Details: " << e.what() << std::endl;
+        Trace::span(QTimings::nameOf(id), stopped - started, this->traces);
     }
-    this->starts.emplace(nameStart, now);
 }
 
 void    QTimings::reset()
 {
     this->timer.invalidate();
-    this->timings.clear();
-    this->timings2.clear();
+    this->listed.clear();
+    this->unlisted = 0;
     this->starts.clear();
 }
 
@@ -64,11 +338,83 @@ std::string QTimings::getPPTimings() const
     QString result;
 
     result.append("Timings :\n");
-    for (auto entry : this->timings2)
+    for (auto entry : this->listed)
     {
-        result.append(" - ").append(entry.first.c_str()).append(": ");
+        result.append(" - ").append(QTimings::nameOf(entry.first).c_str()).append(": ");
         result.append(QString::number((((double) entry.second) / 1000000.0))).append(" ms\n");
     }
+    if (this->unlisted > 0)
+    {
+        result.append(" - and ").append(QString::number(static_cast<unsigned long>(this->unlisted))).append(" more, see the distributions\n");
+    }
+
+    return result.toStdString();
+}
+
+void    QTimings::record(Id id, qint64 duration)
+{
+    localRecorder().record(id, duration);
+}
+
+std::vector<QTimings::Distribution>  QTimings::getDistributions()
+{
+    std::map<std::string, std::vector<uint64_t>>    merged;
+    std::map<std::string, uint64_t>                 sums;
+    std::vector<Distribution>                       distributions;
+
+    {
+        std::lock_guard<std::mutex> lock(recordersLock);
+
+        for (const std::shared_ptr<Recorder> &recorder : recorders)
+        {
+            for (std::size_t i = 0, size = recorder->size(); i < size; ++i)
+            {
+                const Recorder::Stage   &stage = recorder->stage(i);
+                std::vector<uint64_t>   &totals = merged[stage.name];
+
+                totals.resize(Histogram::bucketCount, 0);
+                stage.histogram.addTo(totals);
+                sums[stage.name] += stage.histogram.total();
+            }
+        }
+    }
+
+    for (auto &entry : merged)
+    {
+        std::vector<uint64_t>   &totals = entry.second;
+        Distribution            distribution{ entry.first, 0, 0, 0, 0, 0, static_cast<qint64>(sums[entry.first]), std::vector<uint64_t>() };
+
+        for (std::size_t i = 0; i < totals.size(); ++i)
+        {
+            distribution.count += totals[i];
+            if (totals[i] != 0)
+            {
+                distribution.max = static_cast<qint64>(Histogram::highest(i));
+            }
+        }
+        distribution.p50 = static_cast<qint64>(Histogram::percentile(totals, 0.5));
+        distribution.p99 = static_cast<qint64>(Histogram::percentile(totals, 0.99));
+        distribution.p999 = static_cast<qint64>(Histogram::percentile(totals, 0.999));
+        distribution.buckets = std::move(totals);
+        distributions.push_back(std::move(distribution));
+    }
+    return distributions;
+}
+
+std::string QTimings::getPPDistributions()
+{
+    QString result;
+
+    result.append("Distributions (p50 / p99 / p99.9 / max) :\n");
+    for (const Distribution &distribution : QTimings::getDistributions())
+    {
+        result.append(" - ").append(distribution.name.c_str()).append(": ");
+        result.append(QString::number(distribution.count)).append(" samples, ");
+        result.append(QString::number(distribution.p50 / 1000000.0)).append(" / ");
+        result.append(QString::number(distribution.p99 / 1000000.0)).append(" / ");
+        result.append(QString::number(distribution.p999 / 1000000.0)).append(" / ");
+        result.append(QString::number(distribution.max / 1000000.0)).append(" ms\n");
+    }
 
     return result.toStdString();
 }
@@ -1,6 +1,6 @@
 #include <QElapsedTimer>
+#include <cstdint>
 #include <string>
-#include <map>
 #include <vector>
 
 #pragma once
@@ -10,23 +10,133 @@ class QTimings
     public:
         QTimings() = default;
 
-        void    start(const std::string &name);
-        void    stop(const std::string &name);
+        // Interned name of a timed step: timing by id builds no string and looks nothing up by name
+        typedef uint32_t    Id;
+
+        static Id                   intern(const std::string &name);
+        // name followed by suffix, both string literals, cached by their address in the calling thread
+        static Id                   intern(const char *name, const char *suffix);
+        static const std::string    &nameOf(Id id);
+
+        // built with SCAE_NO_TIMINGS nothing is timed, the calls compile to nothing
+#ifdef SCAE_NO_TIMINGS
+        void    start(Id) {}
+        void    stop(Id) {}
+        void    start(const std::string &) {}
+        void    stop(const std::string &) {}
+        void    stopAndStart(const std::string &, const std::string &) {}
+#else
+        void    start(Id id);
+        void    stop(Id id);
+        void    start(const std::string &name) { this->start(QTimings::intern(name)); }
+        void    stop(const std::string &name) { this->stop(QTimings::intern(name)); }
         void    stopAndStart(const std::string &nameStop, const std::string &nameStart);
+#endif
 
         void    reset();
 
+        // the first maxListed steps since reset(), the others only go to the distributions
+        static const std::size_t    maxListed = 256;
+
         std::string getPPTimings() const;
 
-        static QTimings   &getShared() { return QTimings::sharedInstance; };
+        // Every stop also counts the duration in a histogram of the calling thread, per timing name.
+        // Recording takes no lock, the histograms of all the threads are merged when read
+        struct Distribution
+        {
+            std::string name;
+            uint64_t    count;
+            qint64      p50;
+            qint64      p99;
+            qint64      p999;
+            qint64      max;
+            qint64      sum;
+            std::vector<uint64_t>   buckets;    // merged counts, indexed like Histogram
+        };
+
+        static std::vector<Distribution>    getDistributions();
+        static std::string                  getPPDistributions();
+
+        // Timings of the calling thread, or the ones bound by the innermost Scope
+        static QTimings   &getShared();
+
+        // Binds a QTimings as the shared one of the calling thread while it lives
+        class Scope
+        {
+            public:
+                explicit Scope(QTimings &timings);
+                ~Scope();
+
+            private:
+                QTimings    *previous;
+        };
+
+        // Tags the steps a QTimings times with login traces while it lives, empty traces are skipped.
+        // They are written as spans of each trace when tracing is enabled, see Trace
+        class TraceScope
+        {
+            public:
+                TraceScope(QTimings &timings, const std::vector<std::string> &traces);
+                ~TraceScope();
+                TraceScope(const TraceScope &) = delete;
+                TraceScope &operator=(const TraceScope &) = delete;
+
+            private:
+                QTimings    &timings;
+                std::size_t count;
+        };
+
+        // Timer times 1 in every calls of each step, read from SCAE_TIMINGS_SAMPLING (default: 1)
+        static void     setSampling(uint32_t every);
+        static uint32_t getSampling();
+
+        // Times a step of the shared timings from its construction to stop() or its destruction.
+        // Meant for the hot primitives, only the sampled calls read the clock
+        class Timer
+        {
+            public:
+#ifdef SCAE_NO_TIMINGS
+                explicit Timer(Id) {}
+                Timer(const char *, const char *) {}
+                void    stop() {}
+#else
+                explicit Timer(Id id) : timings(nullptr) { this->begin(id); }
+                // an empty name is not timed
+                Timer(const char *name, const char *suffix) : timings(nullptr)
+                {
+                    if (*name != '\0')
+                    {
+                        this->begin(QTimings::intern(name, suffix));
+                    }
+                }
+                ~Timer() { this->stop(); }
+                Timer(const Timer &) = delete;
+                Timer &operator=(const Timer &) = delete;
+
+                void    stop();
+
+            private:
+                void    begin(Id id);
+
+                QTimings    *timings;   // null when the call is not sampled
+                Id          id;
+                qint64      started;
+#endif
+        };
 
     private:
-        static  QTimings sharedInstance;
+        qint64  now();
+        void    finish(Id id, qint64 started, qint64 stopped);
+        void    record(Id id, qint64 duration);
+
+        static  thread_local QTimings sharedInstance;
+        static  thread_local QTimings *current;
 
         QElapsedTimer timer;
 
-        std::map<std::string, qint64>    starts;
-        std::map<std::string, qint64>    timings;
-        std::vector<std::pair<std::string, qint64>>     timings2;
+        std::vector<qint64>                 starts;     // by id, -1 when not started
+        std::vector<std::pair<Id, qint64>>  listed;
+        std::size_t                         unlisted = 0;
+        std::vector<std::string>            traces;
 };
 
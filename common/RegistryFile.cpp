@@ -0,0 +1,416 @@
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <QSaveFile>
+#include <QtEndian>
+#include "RegistryFile.hpp"
+
+/*
+    The file starts with a 32 bytes header: the magic, the end of the last record and the number
+    of records, both 64 bits. Each record is its payload size and the FNV-1a of its payload, both
+    32 bits, then the payload:
+        'D', address (32 bits), id size (8 bits), id, digest size (8 bits), digest
+        'U', the same fields, for a device that its address does not resolve to (written by compact())
+        'S', key size (8 bits), key, value size (16 bits), value
+    Integers are little endian. The file is kept larger than its records, end tells where they stop.
+*/
+namespace
+{
+    const char      magic[8] = { 'S', 'C', 'A', 'E', 'R', 'E', 'G', '1' };
+    const qint64    headerSize = 32;
+    const qint64    recordHeaderSize = 8;
+    const qint64    minCapacity = 1 << 20;
+
+    // superseded records a file may hold whatever the number of live ones
+    const qint64    compactionSlack = 4096;
+
+    quint32     checksum(const char *data, std::size_t size)
+    {
+        quint32 hash = 0x811c9dc5;
+
+        for (std::size_t i = 0; i < size; ++i)
+        {
+            hash = (hash ^ static_cast<unsigned char>(data[i])) * 0x01000193;
+        }
+        return hash;
+    }
+
+    template<typename T>
+    void    put(std::string &out, T value)
+    {
+        char bytes[sizeof(T)];
+        qToLittleEndian<T>(value, bytes);
+        out.append(bytes, sizeof(T));
+    }
+
+    std::string frame(const std::string &payload)
+    {
+        std::string record;
+
+        record.reserve(recordHeaderSize + payload.size());
+        put<quint32>(record, static_cast<quint32>(payload.size()));
+        put<quint32>(record, checksum(payload.data(), payload.size()));
+        return record + payload;
+    }
+
+    // bound: the replay binds ip to the device, as the registration did
+    std::string deviceRecord(const std::string &id, const Digest &digest, quint32 ip, bool bound = true)
+    {
+        std::string payload(1, bound ? 'D' : 'U');
+
+        put<quint32>(payload, ip);
+        put<quint8>(payload, static_cast<quint8>(id.size()));
+        payload += id;
+        put<quint8>(payload, static_cast<quint8>(digest.size()));
+        payload.append(reinterpret_cast<const char *>(digest.data()), digest.size());
+        return frame(payload);
+    }
+
+    std::string stateRecord(const std::string &key, const std::string &value)
+    {
+        std::string payload(1, 'S');
+
+        put<quint8>(payload, static_cast<quint8>(key.size()));
+        payload += key;
+        put<quint16>(payload, static_cast<quint16>(value.size()));
+        payload += value;
+        return frame(payload);
+    }
+
+    // reads the fields of a payload, false when they overrun it
+    class PayloadReader
+    {
+        public:
+            PayloadReader(const uchar *data, std::size_t size) : data(data), size(size), position(1) {}
+
+            template<typename T>
+            bool    get(T &value)
+            {
+                if (this->position + sizeof(T) > this->size)
+                {
+                    return false;
+                }
+                value = qFromLittleEndian<T>(this->data + this->position);
+                this->position += sizeof(T);
+                return true;
+            }
+
+            bool    get(std::string &value, std::size_t length)
+            {
+                const char *bytes;
+
+                if (!this->get(bytes, length))
+                {
+                    return false;
+                }
+                value.assign(bytes, length);
+                return true;
+            }
+
+            // points into the payload
+            bool    get(const char *&value, std::size_t length)
+            {
+                if (this->position + length > this->size)
+                {
+                    return false;
+                }
+                value = reinterpret_cast<const char *>(this->data) + this->position;
+                this->position += length;
+                return true;
+            }
+
+        private:
+            const uchar *data;
+            std::size_t size;
+            std::size_t position;
+    };
+}
+
+RegistryFile::RegistryFile(DeviceRegistry &registry) : registry(registry), data(nullptr), capacity(0), end(headerSize), records(0), stopping(false)
+{
+}
+
+RegistryFile::~RegistryFile()
+{
+    {
+        std::lock_guard<std::mutex> guard(this->lock);
+        this->stopping = true;
+    }
+    this->wakeUp.notify_all();
+    if (this->compactor.joinable())
+    {
+        this->compactor.join();
+    }
+    if (this->data != nullptr)
+    {
+        this->file->unmap(this->data);
+    }
+}
+
+bool    RegistryFile::open(const QString &path)
+{
+    std::lock_guard<std::mutex> guard(this->lock);
+
+    this->path = path;
+    this->file.reset(new QFile(path));
+    if (!this->file->open(QIODevice::ReadWrite))
+    {
+        std::cerr << "Could not open the registry file " << path.toStdString() << ": " << this->file->errorString().toStdString() << std::endl;
+        return false;
+    }
+
+    qint64  size = this->file->size();
+
+    if (!this->map(std::max(size, minCapacity)))
+    {
+        return false;
+    }
+    if (size < headerSize)
+    {
+        std::memcpy(this->data, magic, sizeof(magic));
+        this->writeHeader();
+    }
+    else if (!this->replay())
+    {
+        std::cerr << path.toStdString() << " is not a registry file" << std::endl;
+        return false;
+    }
+
+    this->compactor = std::thread(&RegistryFile::compactPeriodically, this);
+    return true;
+}
+
+bool    RegistryFile::map(qint64 capacity)
+{
+    if (this->data != nullptr)
+    {
+        this->file->unmap(this->data);
+        this->data = nullptr;
+    }
+    if (this->file->size() < capacity && !this->file->resize(capacity))
+    {
+        std::cerr << "Could not grow the registry file to " << capacity << " bytes: " << this->file->errorString().toStdString() << std::endl;
+        return false;
+    }
+
+    this->data = this->file->map(0, capacity);
+    if (this->data == nullptr)
+    {
+        std::cerr << "Could not map the registry file: " << this->file->errorString().toStdString() << std::endl;
+        return false;
+    }
+    this->capacity = capacity;
+    return true;
+}
+
+void    RegistryFile::writeHeader()
+{
+    qToLittleEndian<quint64>(static_cast<quint64>(this->end), this->data + 8);
+    qToLittleEndian<quint64>(static_cast<quint64>(this->records), this->data + 16);
+}
+
+bool    RegistryFile::replay()
+{
+    if (std::memcmp(this->data, magic, sizeof(magic)) != 0)
+    {
+        return false;
+    }
+
+    qint64  end = std::min(static_cast<qint64>(qFromLittleEndian<quint64>(this->data + 8)), this->capacity);
+    qint64  position = headerSize;
+    qint64  devices = 0;
+
+    // the records up to the first torn one, counting the devices to size the registry once
+    this->records = 0;
+    while (position + recordHeaderSize <= end)
+    {
+        qint64  size = qFromLittleEndian<quint32>(this->data + position);
+        const char *payload = reinterpret_cast<const char *>(this->data + position + recordHeaderSize);
+
+        if (size == 0 || position + recordHeaderSize + size > end || checksum(payload, size) != qFromLittleEndian<quint32>(this->data + position + 4))
+        {
+            std::cerr << "The registry file is damaged after " << position << " bytes, the records from there on are dropped" << std::endl;
+            break;
+        }
+        devices += (payload[0] == 'D' || payload[0] == 'U') ? 1 : 0;
+        ++this->records;
+        position += recordHeaderSize + size;
+    }
+    this->end = position;
+    this->writeHeader();
+
+    // the devices point into the mapping, inserted by every core at once
+    std::vector<DeviceRegistry::Registration>   registrations;
+
+    registrations.reserve(static_cast<std::size_t>(devices));
+    for (position = headerSize; position < this->end; )
+    {
+        qint64          size = qFromLittleEndian<quint32>(this->data + position);
+        PayloadReader   reader(this->data + position + recordHeaderSize, static_cast<std::size_t>(size));
+        char            type = static_cast<char>(this->data[position + recordHeaderSize]);
+        quint32         ip;
+        quint8          idSize, digestSize, keySize;
+        quint16         valueSize;
+        const char      *id, *digest;
+        std::string     key, value;
+
+        position += recordHeaderSize + size;
+        if ((type == 'D' || type == 'U') && reader.get(ip) && reader.get(idSize) && reader.get(id, idSize) && reader.get(digestSize) && reader.get(digest, digestSize))
+        {
+            registrations.push_back({ id, idSize, reinterpret_cast<const unsigned char *>(digest), digestSize, ip, type == 'D' });
+        }
+        else if (type == 'S' && reader.get(keySize) && reader.get(key, keySize) && reader.get(valueSize) && reader.get(value, valueSize))
+        {
+            this->values[key] = value;
+        }
+    }
+    this->registry.insertMany(registrations, std::max(1u, std::thread::hardware_concurrency()));
+    return true;
+}
+
+void    RegistryFile::write(const std::string &record)
+{
+    if (this->data == nullptr)
+    {
+        return;
+    }
+    if (this->end + static_cast<qint64>(record.size()) > this->capacity)
+    {
+        qint64 capacity = this->capacity;
+
+        while (this->end + static_cast<qint64>(record.size()) > capacity)
+        {
+            capacity *= 2;
+        }
+        if (!this->map(capacity))
+        {
+            std::cerr << "The registry file can not grow, registrations are not recorded anymore" << std::endl;
+            return;
+        }
+    }
+
+    std::memcpy(this->data + this->end, record.data(), record.size());
+    this->end += static_cast<qint64>(record.size());
+    ++this->records;
+    this->writeHeader();
+}
+
+void    RegistryFile::append(const std::string &id, const Digest &digest, quint32 ip)
+{
+    std::string record = deviceRecord(id, digest, ip);
+
+    std::lock_guard<std::mutex> guard(this->lock);
+    this->write(record);
+}
+
+void    RegistryFile::setState(const std::string &key, const std::string &value)
+{
+    std::string record = stateRecord(key, value);
+
+    std::lock_guard<std::mutex> guard(this->lock);
+    this->values[key] = value;
+    this->write(record);
+}
+
+std::string RegistryFile::state(const std::string &key) const
+{
+    std::lock_guard<std::mutex> guard(this->lock);
+    auto found = this->values.find(key);
+
+    return (found != this->values.end()) ? found->second : std::string();
+}
+
+bool    RegistryFile::compact()
+{
+    std::lock_guard<std::mutex> guard(this->lock);
+
+    if (this->data == nullptr)
+    {
+        return false;
+    }
+
+    // written next to the file then renamed over it
+    QSaveFile   out(this->path);
+    std::string buffer(magic, sizeof(magic));
+    qint64      end = headerSize;
+    qint64      records = 0;
+    bool        written = out.open(QIODevice::WriteOnly);
+
+    buffer.resize(headerSize, '\0');
+    auto add = [&](const std::string &record) {
+        buffer += record;
+        end += static_cast<qint64>(record.size());
+        ++records;
+        if (buffer.size() >= static_cast<std::size_t>(minCapacity))
+        {
+            written = written && out.write(buffer.data(), static_cast<qint64>(buffer.size())) >= 0;
+            buffer.clear();
+        }
+    };
+
+    for (const auto &value : this->values)
+    {
+        add(stateRecord(value.first, value.second));
+    }
+    // only the devices an address resolves to bind it in the replay: the other devices of a NAT, and
+    // those whose address is still bound to a device that moved since, leave it as it is now
+    this->registry.forEach([&add](const std::string &id, const Digest &digest, quint32 ip, bool bound) {
+        add(deviceRecord(id, digest, ip, bound || ip == 0));
+    });
+
+    char header[16];
+    qToLittleEndian<quint64>(static_cast<quint64>(end), header);
+    qToLittleEndian<quint64>(static_cast<quint64>(records), header + 8);
+
+    written = written && out.write(buffer.data(), static_cast<qint64>(buffer.size())) >= 0 && out.seek(8) && out.write(header, sizeof(header)) >= 0;
+    if (!written)
+    {
+        std::cerr << "Could not compact the registry file: " << out.errorString().toStdString() << std::endl;
+        out.cancelWriting();
+        return false;
+    }
+
+    // the mapping of the old file goes first, some systems do not replace a mapped file
+    this->file->unmap(this->data);
+    this->data = nullptr;
+    this->file->close();
+
+    bool    committed = out.commit();
+
+    if (!committed)
+    {
+        std::cerr << "Could not replace the registry file: " << out.errorString().toStdString() << std::endl;
+    }
+    else
+    {
+        this->end = end;
+        this->records = records;
+    }
+
+    this->file.reset(new QFile(this->path));
+    if (!this->file->open(QIODevice::ReadWrite) || !this->map(std::max(this->file->size(), std::max(2 * this->end, minCapacity))))
+    {
+        std::cerr << "Could not map the registry file again, registrations are not recorded anymore" << std::endl;
+        return false;
+    }
+    return committed;
+}
+
+void    RegistryFile::compactPeriodically()
+{
+    std::unique_lock<std::mutex> guard(this->lock);
+
+    while (!this->stopping)
+    {
+        this->wakeUp.wait_for(guard, std::chrono::seconds(compactionInterval));
+
+        qint64 live = static_cast<qint64>(this->registry.size() + this->values.size());
+
+        if (!this->stopping && this->records > 2 * live + compactionSlack)
+        {
+            guard.unlock();
+            this->compact();
+            guard.lock();
+        }
+    }
+}
@@ -0,0 +1,74 @@
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <QFile>
+#include "DeviceRegistry.hpp"
+
+#pragma once
+
+/*
+    Append-only journal of a DeviceRegistry in a memory mapped file, replayed at startup so that a
+    restarted Gateway or Server serves the devices registered before without them registering
+    again, nor the protocol being run for any of them.
+
+    Every registration appends a record holding the device id, its digest and its address. The
+    process can keep a few named values next to them, the Gateway its own registration to the
+    Server. Each record has a checksum: one torn by a crash ends the replay.
+
+    Every compactionInterval seconds a thread rewrites the file with only the live records when
+    the superseded ones outnumber them; registrations wait for the rewrite. Records reach the disk
+    through the page cache: a process that crashes or is killed loses none, a machine that loses
+    power may lose the last ones.
+*/
+class RegistryFile
+{
+    public:
+        static const int    compactionInterval = 60;
+
+        explicit RegistryFile(DeviceRegistry &registry);
+        ~RegistryFile();
+        RegistryFile(const RegistryFile &) = delete;
+        RegistryFile &operator=(const RegistryFile &) = delete;
+
+        // maps path, created when missing, and replays it into the registry.
+        // False when it can not be mapped or is not a registry file
+        bool        open(const QString &path);
+
+        // records a registration the registry accepted
+        void        append(const std::string &id, const Digest &digest, quint32 ip);
+
+        // key up to 255 bytes and value up to 65535
+        void        setState(const std::string &key, const std::string &value);
+        // empty when it was never set
+        std::string state(const std::string &key) const;
+
+        // rewrites the file with one record per device and value
+        bool        compact();
+
+    private:
+        // with lock held
+        bool        map(qint64 capacity);
+        void        write(const std::string &record);
+        bool        replay();
+        void        writeHeader();
+
+        void        compactPeriodically();
+
+        DeviceRegistry          &registry;
+        QString                 path;
+        std::unique_ptr<QFile>  file;
+        uchar                   *data;
+        qint64                  capacity;
+        qint64                  end;        // of the last record
+        qint64                  records;
+
+        std::map<std::string, std::string>  values;
+        mutable std::mutex                  lock;
+
+        std::thread                 compactor;
+        std::condition_variable     wakeUp;
+        bool                        stopping;
+};
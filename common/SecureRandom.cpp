@@ -0,0 +1,139 @@
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <QRandomGenerator>
+#include "SecureRandom.hpp"
+
+namespace
+{
+    inline uint32_t rotl(uint32_t x, int n)
+    {
+        return (x << n) | (x >> (32 - n));
+    }
+
+    inline void quarterRound(uint32_t *x, int a, int b, int c, int d)
+    {
+        x[a] += x[b];
+        x[d] = rotl(x[d] ^ x[a], 16);
+        x[c] += x[d];
+        x[b] = rotl(x[b] ^ x[c], 12);
+        x[a] += x[b];
+        x[d] = rotl(x[d] ^ x[a], 8);
+        x[c] += x[d];
+        x[b] = rotl(x[b] ^ x[c], 7);
+    }
+
+    // one 64 bytes block of ChaCha20 (RFC 8439)
+    void    chacha20Block(const uint32_t key[8], uint32_t counter, const uint32_t nonce[3], unsigned char *out)
+    {
+        const uint32_t input[16] = {
+            0x61707865, 0x3320646e, 0x79622d32, 0x6b206574,
+            key[0], key[1], key[2], key[3], key[4], key[5], key[6], key[7],
+            counter, nonce[0], nonce[1], nonce[2]
+        };
+        uint32_t x[16];
+
+        std::memcpy(x, input, sizeof(x));
+        for (int i = 0; i < 10; ++i)
+        {
+            quarterRound(x, 0, 4, 8, 12);
+            quarterRound(x, 1, 5, 9, 13);
+            quarterRound(x, 2, 6, 10, 14);
+            quarterRound(x, 3, 7, 11, 15);
+            quarterRound(x, 0, 5, 10, 15);
+            quarterRound(x, 1, 6, 11, 12);
+            quarterRound(x, 2, 7, 8, 13);
+            quarterRound(x, 3, 4, 9, 14);
+        }
+
+        for (int i = 0; i < 16; ++i)
+        {
+            uint32_t word = x[i] + input[i];
+
+            out[4 * i] = static_cast<unsigned char>(word);
+            out[4 * i + 1] = static_cast<unsigned char>(word >> 8);
+            out[4 * i + 2] = static_cast<unsigned char>(word >> 16);
+            out[4 * i + 3] = static_cast<unsigned char>(word >> 24);
+        }
+    }
+}
+
+SecureRandom    &SecureRandom::local()
+{
+    thread_local SecureRandom generator;
+    return generator;
+}
+
+SecureRandom::SecureRandom() : position(sizeof(this->buffer))
+{
+    QRandomGenerator::system()->generate(std::begin(this->key), std::end(this->key));
+}
+
+void    SecureRandom::refill()
+{
+    // every key is used once, so the counter and the nonce can start from 0
+    static const uint32_t   nonce[3] = { 0, 0, 0 };
+
+    for (std::size_t i = 0; i < blocks; ++i)
+    {
+        chacha20Block(this->key, static_cast<uint32_t>(i), nonce, this->buffer + 64 * i);
+    }
+
+    for (int i = 0; i < 8; ++i)
+    {
+        const unsigned char *word = this->buffer + 4 * i;
+        this->key[i] = word[0] | (static_cast<uint32_t>(word[1]) << 8) | (static_cast<uint32_t>(word[2]) << 16) | (static_cast<uint32_t>(word[3]) << 24);
+    }
+    std::memset(this->buffer, 0, sizeof(this->key));
+    this->position = sizeof(this->key);
+}
+
+void    SecureRandom::fill(void *data, std::size_t size)
+{
+    unsigned char *out = static_cast<unsigned char *>(data);
+
+    while (size > 0)
+    {
+        if (this->position == sizeof(this->buffer))
+        {
+            this->refill();
+        }
+
+        std::size_t take = std::min(size, sizeof(this->buffer) - this->position);
+
+        std::memcpy(out, this->buffer + this->position, take);
+        std::memset(this->buffer + this->position, 0, take);
+        this->position += take;
+        out += take;
+        size -= take;
+    }
+}
+
+uint32_t    SecureRandom::next32()
+{
+    uint32_t value;
+
+    this->fill(&value, sizeof(value));
+    return value;
+}
+
+uint64_t    SecureRandom::next64()
+{
+    uint64_t value;
+
+    this->fill(&value, sizeof(value));
+    return value;
+}
+
+std::string SecureRandom::bytes(std::size_t size)
+{
+    std::string random(size, '\0');
+
+    this->fill(&random[0], size);
+    return random;
+}
+
+std::string SecureRandom::decimal()
+{
+    return std::to_string(this->next32());
+}
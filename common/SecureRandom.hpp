@@ -0,0 +1,43 @@
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#pragma once
+
+/*
+    Cryptographically secure random numbers for the nonces of the protocol.
+
+    Every thread owns a ChaCha20 generator, keyed from the system source the first time the thread
+    draws: drawing takes no lock and makes no system call. The keystream is produced 16 blocks at
+    a time. The first 32 bytes of each refill become the next key and every byte handed out is
+    wiped from the buffer, so the state of a generator does not reveal what it gave before.
+*/
+class SecureRandom
+{
+    public:
+        // the generator of the calling thread
+        static SecureRandom &local();
+
+        SecureRandom(const SecureRandom &) = delete;
+        SecureRandom &operator=(const SecureRandom &) = delete;
+
+        void        fill(void *data, std::size_t size);
+        uint32_t    next32();
+        uint64_t    next64();
+
+        // size raw bytes
+        std::string bytes(std::size_t size);
+        // a 32 bits value written in decimal, the format CommonUtils::newRandom always had
+        std::string decimal();
+
+    private:
+        SecureRandom();
+
+        void    refill();
+
+        static const std::size_t    blocks = 16;
+
+        uint32_t        key[8];
+        unsigned char   buffer[64 * blocks];
+        std::size_t     position;       // first byte of buffer not handed out yet
+};
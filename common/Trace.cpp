@@ -0,0 +1,145 @@
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <QCoreApplication>
+#include "Trace.hpp"
+#include "Hasher.hpp"
+#include "SecureRandom.hpp"
+
+namespace Trace
+{
+    namespace
+    {
+        const std::string   &directory()
+        {
+            static const std::string    configured = []() {
+                const char  *text = std::getenv("SCAE_TRACE");
+                return std::string(text != nullptr ? text : "");
+            }();
+
+            return configured;
+        }
+
+        std::string escape(const std::string &text)
+        {
+            std::string escaped;
+
+            for (char c : text)
+            {
+                if (c == '"' || c == '\\')
+                {
+                    escaped += '\\';
+                }
+                if (static_cast<unsigned char>(c) >= 0x20)
+                {
+                    escaped += c;
+                }
+            }
+            return escaped;
+        }
+
+        // the events of the process, a JSON array closed when the process exits
+        class File
+        {
+            public:
+                ~File()
+                {
+                    if (this->out.is_open())
+                    {
+                        this->out << "\n]\n";
+                    }
+                }
+
+                void    write(const std::string &events)
+                {
+                    std::lock_guard<std::mutex> lock(this->lock);
+
+                    if (!this->opened)
+                    {
+                        this->opened = true;
+                        std::string path = directory() + "/" + this->process + "-" + std::to_string(QCoreApplication::applicationPid()) + ".json";
+                        this->out.open(path, std::ios::out | std::ios::trunc);
+                        if (!this->out.is_open())
+                        {
+                            std::cerr << "Could not open trace file " << path << ", not tracing" << std::endl;
+                            return;
+                        }
+                        // names the process in the trace viewers and in scae-trace-merge
+                        this->out << "[\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << QCoreApplication::applicationPid()
+                                  << ",\"args\":{\"name\":\"" << escape(this->process) << "\"}}";
+                    }
+                    if (!this->out.is_open())
+                    {
+                        return;
+                    }
+                    this->out << ",\n" << events;
+                    this->out.flush();
+                }
+
+                std::mutex      lock;
+                std::string     process = "scae";
+                std::ofstream   out;
+                bool            opened = false;
+        };
+
+        File    file;
+
+        // small thread numbers read better than the system ones in the trace viewers
+        int     threadNumber()
+        {
+            static std::atomic<int> count(0);
+            thread_local int        number = ++count;
+
+            return number;
+        }
+    }
+
+    bool    enabled()
+    {
+        return !directory().empty();
+    }
+
+    void    setProcess(const std::string &process)
+    {
+        std::lock_guard<std::mutex> lock(file.lock);
+
+        file.process = process;
+    }
+
+    std::string newId()
+    {
+        unsigned char   id[8];
+
+        SecureRandom::local().fill(id, sizeof(id));
+        return Hasher::toHex(id, sizeof(id));
+    }
+
+    void    span(const std::string &name, int64_t duration, const std::vector<std::string> &traces)
+    {
+        if (!enabled() || traces.empty())
+        {
+            return;
+        }
+
+        // wall clock, so that the files of several processes line up, in microseconds to the nanosecond
+        int64_t end = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+
+        std::ostringstream  events;
+        std::string         escaped = escape(name);
+
+        events << std::fixed << std::setprecision(3);
+        for (std::size_t i = 0; i < traces.size(); ++i)
+        {
+            events << (i == 0 ? "" : ",\n")
+                   << "{\"name\":\"" << escaped << "\",\"ph\":\"X\",\"ts\":" << (end - duration) / 1000.0 << ",\"dur\":" << duration / 1000.0
+                   << ",\"pid\":" << QCoreApplication::applicationPid() << ",\"tid\":" << threadNumber()
+                   << ",\"args\":{\"trace\":\"" << escape(traces[i]) << "\"}}";
+        }
+        file.write(events.str());
+    }
+}
@@ -0,0 +1,32 @@
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#pragma once
+
+/*
+    End to end traces of the logins.
+
+    The Client draws a trace id for each login and sends it as an extra last field of the login
+    message, the Gateway forwards it to the Server the same way. Every step a process times while
+    working on that login (see QTimings::TraceScope) becomes a span of the trace.
+
+    Tracing is enabled by SCAE_TRACE=<directory> in the environment of a process, which then writes
+    its spans to <directory>/<process>-<pid>.json in the Chrome trace event format. The Client only
+    sends trace ids when its tracing is enabled, the Gateway and the Server forward and record
+    the ones they receive. scae-trace-merge (tools/) merges the files and shows where one login
+    spent its time.
+*/
+namespace Trace
+{
+    bool        enabled();
+
+    // names the trace file and the spans of this process, to be called before the first span
+    void        setProcess(const std::string &process);
+
+    // a new trace id, 16 hexadecimal digits
+    std::string newId();
+
+    // a step of duration nanoseconds that just ended, recorded once in each of the traces
+    void        span(const std::string &name, int64_t duration, const std::vector<std::string> &traces);
+}
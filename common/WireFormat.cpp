@@ -0,0 +1,337 @@
+#include <atomic>
+#include <iostream>
+#include <QtEndian>
+#include "Metrics.hpp"
+#include "WireFormat.hpp"
+
+namespace Wire
+{
+    Writer::Writer(Format format, char type) : format(format), count(0), tooLong(false)
+    {
+        if (this->format == Format::Binary)
+        {
+            this->buffer.reserve(256);
+            this->buffer.append(static_cast<char>(magic));
+            this->buffer.append(static_cast<char>(version));
+            this->buffer.append(type);
+            this->buffer.append(headerSize - 3, '\0');  // count and length, patched by data()
+        }
+        else
+        {
+            this->buffer.append(type);
+        }
+    }
+
+    Writer  &Writer::add(const std::string &field)
+    {
+        return this->add(field.data(), static_cast<int>(field.size()));
+    }
+
+    Writer  &Writer::add(const char *field, int size)
+    {
+        if (size > maxFieldSize)
+        {
+            this->tooLong = true;
+            return *this;
+        }
+        if (this->format == Format::Binary)
+        {
+            char length[2];
+            qToBigEndian<quint16>(static_cast<quint16>(size), length);
+            this->buffer.append(length, 2);
+            this->buffer.append(field, size);
+        }
+        else
+        {
+            if (this->count > 0)
+            {
+                this->buffer.append(':');
+            }
+            this->buffer.append(QByteArray::fromRawData(field, size).toBase64());
+        }
+        ++this->count;
+        return *this;
+    }
+
+    Writer  &Writer::add(const Digest &field)
+    {
+        if (this->format == Format::Binary)
+        {
+            return this->add(reinterpret_cast<const char *>(field.data()), static_cast<int>(field.size()));
+        }
+
+        char    text[2 * Digest::maxSize];
+
+        field.hex(text);
+        return this->add(text, static_cast<int>(2 * field.size()));
+    }
+
+    QByteArray  Writer::data()
+    {
+        if (this->tooLong || this->buffer.size() - ((this->format == Format::Binary) ? headerSize : 0) > static_cast<int>(maxLength))
+        {
+            return QByteArray();
+        }
+        if (this->format == Format::Binary)
+        {
+            this->buffer[3] = static_cast<char>(this->count);
+            qToBigEndian<quint32>(static_cast<quint32>(this->buffer.size() - headerSize), this->buffer.data() + 4);
+        }
+        return this->buffer;
+    }
+
+    // the series of scae_errors_total, one per known code: the text of an error may come from a peer
+    static  std::atomic<uint64_t>   &errorCounter(const std::string &text)
+    {
+        static const char   *const codes[] = {
+            "WrongProtocol", "InvalidNumberOfArguments", "InvalidDigest", "InvalidDeviceId", "IpAddressNotRegistered",
+            "DeviceNotRegistered", "WrongID", "ServerProtocolError", "UnableToContactServer", "UnableToReadServer",
+            "ServerTimeout", "ServerError", "FieldTooLong", "other"
+        };
+        static const std::size_t    count = sizeof(codes) / sizeof(codes[0]);
+        static std::atomic<uint64_t> *const *counters = []() {
+            static std::atomic<uint64_t>    *series[count];
+
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                series[i] = &Metrics::counter("scae_errors_total", "Error replies sent, by code.", Metrics::label("code", codes[i]));
+            }
+            return series;
+        }();
+
+        // "ServerError:<what the Server said>" is counted as ServerError
+        std::string code = text.substr(0, text.find(':'));
+
+        for (std::size_t i = 0; i + 1 < count; ++i)
+        {
+            if (code == codes[i])
+            {
+                return *counters[i];
+            }
+        }
+        return *counters[count - 1];
+    }
+
+    QByteArray  error(Format format, const std::string &text)
+    {
+        std::string cut = text.substr(0, maxErrorSize);
+
+        ++errorCounter(cut);
+        if (format == Format::Binary)
+        {
+            return Writer(format, errorType).add(cut).data();
+        }
+        return QByteArray::fromStdString(cut);
+    }
+
+    bool    readDigest(Format format, const std::string &field, Digest &digest)
+    {
+        if (format == Format::Legacy)
+        {
+            return !field.empty() && Digest::fromHex(field.data(), field.size(), digest);
+        }
+        if (field.empty() || field.size() > Digest::maxSize)
+        {
+            return false;
+        }
+        digest = Digest(reinterpret_cast<const unsigned char *>(field.data()), field.size());
+        return true;
+    }
+
+    static  Status  parseBinary(const QByteArray &buffer, Message &message, int &consumed)
+    {
+        if (buffer.size() < headerSize)
+        {
+            return Status::Incomplete;
+        }
+
+        const char  *data = buffer.constData();
+
+        if (static_cast<unsigned char>(data[1]) != version)
+        {
+            return Status::Invalid;
+        }
+
+        quint32 length = qFromBigEndian<quint32>(data + 4);
+        if (length > maxLength)
+        {
+            return Status::Invalid;
+        }
+        if (static_cast<quint64>(buffer.size()) < headerSize + static_cast<quint64>(length))
+        {
+            return Status::Incomplete;
+        }
+
+        message.format = Format::Binary;
+        message.type = data[2];
+        message.fields.clear();
+        message.fields.reserve(static_cast<unsigned char>(data[3]));
+
+        const char  *field = data + headerSize;
+        const char  *end = field + length;
+
+        for (int i = 0; i < static_cast<unsigned char>(data[3]); ++i)
+        {
+            if (end - field < 2)
+            {
+                return Status::Invalid;
+            }
+            quint16 size = qFromBigEndian<quint16>(field);
+            field += 2;
+            if (end - field < size)
+            {
+                return Status::Invalid;
+            }
+            message.fields.emplace_back(field, size);
+            field += size;
+        }
+
+        if (field != end)
+        {
+            return Status::Invalid;
+        }
+
+        consumed = headerSize + static_cast<int>(length);
+        return Status::Complete;
+    }
+
+    Status  parse(const QByteArray &buffer, Message &message, int &consumed)
+    {
+        if (buffer.isEmpty())
+        {
+            return Status::Incomplete;
+        }
+
+        if (static_cast<unsigned char>(buffer.front()) == magic)
+        {
+            return parseBinary(buffer, message, consumed);
+        }
+
+        // a legacy message spans the whole buffer
+        message.format = Format::Legacy;
+        message.fields.clear();
+        consumed = buffer.size();
+
+        char type = buffer.front();
+        if (type >= '0' && type <= '9')
+        {
+            message.type = type;
+            for (const QByteArray &field : buffer.mid(1).split(':'))
+            {
+                message.fields.push_back(QByteArray::fromBase64(field).toStdString());
+            }
+        }
+        else
+        {
+            message.type = errorType;
+            message.fields.push_back(buffer.toStdString());
+        }
+        return Status::Complete;
+    }
+
+    Status  receive(QTcpSocket &socket, Message &message, int timeout)
+    {
+        QByteArray  buffer;
+        int         consumed = 0;
+        Status      status = Status::Incomplete;
+
+        while (status == Status::Incomplete)
+        {
+            if (socket.bytesAvailable() == 0 && !socket.waitForReadyRead(timeout))
+            {
+                return Status::Incomplete;
+            }
+            buffer.append(socket.readAll());
+            status = parse(buffer, message, consumed);
+        }
+        return status;
+    }
+
+    static  std::atomic<bool>   verboseRequests(true);
+
+    void    setVerbose(bool verbose)
+    {
+        verboseRequests = verbose;
+    }
+
+    bool    request(const std::string &host, short port, Format &format, const std::function<QByteArray(Format)> &build, Message &reply,
+                    const QHostAddress &source)
+    {
+        bool    verbose = verboseRequests;
+
+        while (true)
+        {
+            QTcpSocket  socket;
+            QByteArray  message = build(format);
+
+            if (message.isEmpty())
+            {
+                if (verbose)
+                {
+                    std::cerr << "The request is too long to be sent" << std::endl;
+                }
+                return false;
+            }
+
+            if (verbose)
+            {
+                std::cout << "Connecting to " << host << ":" << port << " ..." << std::endl;
+            }
+            if (!source.isNull() && !socket.bind(source))
+            {
+                if (verbose)
+                {
+                    std::cerr << "Could not bind to " << source.toString().toStdString() << ": " << socket.errorString().toStdString() << std::endl;
+                }
+                return false;
+            }
+            socket.connectToHost(QString::fromStdString(host), port);
+
+            if (!socket.waitForConnected())
+            {
+                if (verbose)
+                {
+                    std::cerr << "Error while connecting: " << socket.errorString().toStdString() << std::endl;
+                }
+                return false;
+            }
+
+            socket.write(message);
+
+            if (!socket.waitForBytesWritten())
+            {
+                if (verbose)
+                {
+                    std::cerr << "Error while flushing: " << socket.errorString().toStdString() << std::endl;
+                }
+                socket.close();
+                return false;
+            }
+
+            Status status = receive(socket, reply);
+
+            socket.disconnectFromHost();
+            socket.close();
+
+            if (status != Status::Complete)
+            {
+                if (verbose)
+                {
+                    std::cerr << "No informations to read: " << socket.errorString().toStdString() << std::endl;
+                }
+                return false;
+            }
+
+            if (format == Format::Binary && reply.error() == "WrongProtocol")
+            {
+                if (verbose)
+                {
+                    std::cout << "Peer does not know the binary format, falling back to the legacy one" << std::endl;
+                }
+                format = Format::Legacy;
+                continue;
+            }
+            return true;
+        }
+    }
+}
@@ -0,0 +1,114 @@
+#include <functional>
+#include <string>
+#include <vector>
+#include <QByteArray>
+#include <QTcpSocket>
+#include "Digest.hpp"
+
+#pragma once
+
+/*
+    Messages exchanged by the Client, the Gateway and the Server.
+
+    Legacy format: a type digit followed by the base64 fields joined by ':', or a bare error text.
+    Nothing delimits a legacy message, it is whatever a single read returns.
+
+    Binary format (version 2), every integer big endian:
+        u8  magic (0xA5, never the first byte of a legacy message)
+        u8  version
+        u8  type ('1' register, '2' login, 'B' batch of logins, 'E' error)
+        u8  number of fields
+        u32 length of the fields that follow
+        then for each field: u16 length, raw bytes
+
+    A digest field (the registration auth and the c1 to c4 proofs of a login) holds the digest
+    bytes in the binary format and their hexadecimal text in the legacy one. Version 1 sent the
+    text in both.
+
+    A login request may carry a trace id as an extra last field, in both formats (see Trace).
+
+    A batch of logins only exists in the binary format: each field of the request is a whole
+    binary login message, each field of the reply the whole answer to the login at the same index.
+
+    Receivers detect the format of every message and answer in the same one. Senders
+    start with the binary format and fall back to the legacy one when the peer answers
+    "WrongProtocol", which is what a legacy peer does with an unknown first byte.
+*/
+namespace Wire
+{
+    enum class Format
+    {
+        Legacy,
+        Binary
+    };
+
+    enum class Status
+    {
+        Incomplete,     // more bytes are needed
+        Complete,
+        Invalid
+    };
+
+    const unsigned char magic = 0xA5;
+    const unsigned char version = 2;
+    const int           headerSize = 8;
+    const quint32       maxLength = 65536;      // bigger messages are rejected rather than buffered
+    const int           maxFieldSize = 65535;   // the field length is 16 bits
+    const char          errorType = 'E';
+    const char          batchType = 'B';
+    const int           maxBatch = 255;         // the field count is a single byte
+
+    struct Message
+    {
+        Format                      format = Format::Legacy;
+        char                        type = 0;
+        std::vector<std::string>    fields;
+
+        bool    isError() const { return this->type == errorType; }
+        // the error text of an error message, empty otherwise
+        std::string error() const { return (this->isError() && !this->fields.empty()) ? this->fields[0] : std::string(); }
+    };
+
+    // Builds a message field by field
+    class Writer
+    {
+        public:
+            Writer(Format format, char type);
+
+            // a field over maxFieldSize bytes is not added and spoils the message
+            Writer      &add(const std::string &field);
+            Writer      &add(const char *field, int size);
+            Writer      &add(const Digest &field);
+
+            // empty when a field was too long or the message is over maxLength, there is nothing to send then
+            QByteArray  data();
+
+        private:
+            Format      format;
+            QByteArray  buffer;
+            int         count;
+            bool        tooLong;
+    };
+
+    // the text is cut to maxErrorSize bytes, it may come from a peer
+    const int   maxErrorSize = 1024;
+    QByteArray  error(Format format, const std::string &text);
+
+    // decodes a digest field of a message in format, false when it is not one
+    bool    readDigest(Format format, const std::string &field, Digest &digest);
+
+    // Parses the message at the start of buffer, consumed receives its size in bytes
+    Status  parse(const QByteArray &buffer, Message &message, int &consumed);
+
+    // Blocking read of one whole message from socket
+    Status  receive(QTcpSocket &socket, Message &message, int timeout = 30000);
+
+    // Blocking round trip on a new connection to host. build gives the request in the wanted format, empty fails;
+    // when the peer answers "WrongProtocol" to a binary request, format becomes Legacy and it is sent again.
+    // A non null source is the local address the connection is made from
+    bool    request(const std::string &host, short port, Format &format, const std::function<QByteArray(Format)> &build, Message &reply,
+                    const QHostAddress &source = QHostAddress());
+
+    // whether request() logs its connections and failures, on by default
+    void    setVerbose(bool verbose);
+}
@@ -0,0 +1,148 @@
+#include <utility>
+#include "XorKernel.hpp"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SCAE_XOR_X86
+#include <immintrin.h>
+#endif
+
+namespace XorKernel
+{
+    namespace
+    {
+        // every kernel handles n bytes, b being nullptr past the end of the shorter input,
+        // and returns the position after the last positive byte it wrote (0 if none)
+        using Kernel = std::size_t (*)(const char *a, const char *b, char *out, std::size_t n);
+
+        std::size_t scalar(const char *a, const char *b, char *out, std::size_t n)
+        {
+            std::size_t end = 0;
+
+            for (std::size_t i = 0; i < n; ++i)
+            {
+                // char, like applyXOr always used: signed on x86, where bytes >= 0x80 are dropped
+                char c = (b != nullptr) ? static_cast<char>(a[i] ^ b[i]) : a[i];
+
+                if (c > '\0')
+                {
+                    out[i] = c;
+                    end = i + 1;
+                }
+                else
+                {
+                    out[i] = '\0';
+                }
+            }
+            return end;
+        }
+
+#ifdef SCAE_XOR_X86
+        __attribute__((target("sse2")))
+        std::size_t sse2(const char *a, const char *b, char *out, std::size_t n)
+        {
+            const __m128i   zero = _mm_setzero_si128();
+            std::size_t     end = 0;
+            std::size_t     i = 0;
+
+            for (; i + 16 <= n; i += 16)
+            {
+                __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i));
+                if (b != nullptr)
+                {
+                    x = _mm_xor_si128(x, _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i)));
+                }
+                __m128i positive = _mm_cmpgt_epi8(x, zero);
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), _mm_and_si128(x, positive));
+
+                unsigned int mask = static_cast<unsigned int>(_mm_movemask_epi8(positive));
+                if (mask != 0)
+                {
+                    end = i + 32 - __builtin_clz(mask);
+                }
+            }
+
+            std::size_t tail = scalar(a + i, (b != nullptr) ? b + i : nullptr, out + i, n - i);
+            return (tail != 0) ? i + tail : end;
+        }
+
+        __attribute__((target("avx2")))
+        std::size_t avx2(const char *a, const char *b, char *out, std::size_t n)
+        {
+            const __m256i   zero = _mm256_setzero_si256();
+            std::size_t     end = 0;
+            std::size_t     i = 0;
+
+            for (; i + 32 <= n; i += 32)
+            {
+                __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i));
+                if (b != nullptr)
+                {
+                    x = _mm256_xor_si256(x, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + i)));
+                }
+                __m256i positive = _mm256_cmpgt_epi8(x, zero);
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), _mm256_and_si256(x, positive));
+
+                unsigned int mask = static_cast<unsigned int>(_mm256_movemask_epi8(positive));
+                if (mask != 0)
+                {
+                    end = i + 32 - __builtin_clz(mask);
+                }
+            }
+
+            std::size_t tail = sse2(a + i, (b != nullptr) ? b + i : nullptr, out + i, n - i);
+            return (tail != 0) ? i + tail : end;
+        }
+#endif
+
+        struct Dispatch
+        {
+            Kernel      kernel = scalar;
+            const char  *name = "scalar";
+
+            Dispatch()
+            {
+#ifdef SCAE_XOR_X86
+                __builtin_cpu_init();
+                if (__builtin_cpu_supports("avx2"))
+                {
+                    this->kernel = avx2;
+                    this->name = "avx2";
+                }
+                else if (__builtin_cpu_supports("sse2"))
+                {
+                    this->kernel = sse2;
+                    this->name = "sse2";
+                }
+#endif
+            }
+        };
+
+        const Dispatch  &dispatch()
+        {
+            static const Dispatch selected;
+            return selected;
+        }
+    }
+
+    std::size_t apply(const char *a, std::size_t lengthA, const char *b, std::size_t lengthB, char *out)
+    {
+        Kernel kernel = dispatch().kernel;
+
+        if (lengthA < lengthB)
+        {
+            std::swap(a, b);
+            std::swap(lengthA, lengthB);
+        }
+
+        // both inputs, then what is left of the longer one
+        std::size_t end = kernel(a, b, out, lengthB);
+        std::size_t tail = kernel(a + lengthB, nullptr, out + lengthB, lengthA - lengthB);
+
+        return (tail != 0) ? lengthB + tail : end;
+    }
+
+    const char  *path()
+    {
+        return dispatch().name;
+    }
+}
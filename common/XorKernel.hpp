@@ -0,0 +1,18 @@
+#include <cstddef>
+
+#pragma once
+
+/*
+    XOR of two byte strings as CommonUtils::applyXOr defines it: a missing byte counts as 0,
+    a result byte that is not positive as a char becomes 0, and the zeros after the last
+    positive byte are dropped.
+    The widest code path the CPU supports (AVX2, SSE2, plain C++) is picked on first use.
+*/
+namespace XorKernel
+{
+    // writes the result to out, which must hold max(lengthA, lengthB) bytes, and returns its length
+    std::size_t apply(const char *a, std::size_t lengthA, const char *b, std::size_t lengthB, char *out);
+
+    // name of the code path in use, for the logs and benchmarks
+    const char  *path();
+}
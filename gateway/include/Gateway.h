@@ -1,6 +1,12 @@
+#include <atomic>
+#include <memory>
+#include <mutex>
 #include <QTcpSocket>
-#include <unordered_map>
 #include "CommonUtils.hpp"
+#include "DeviceRegistry.hpp"
+#include "RegistryFile.hpp"
+#include "WireFormat.hpp"
+#include "GatewayWorker.h"
 
 #pragma once
 
@@ -10,12 +16,28 @@ class Gateway : public CommonUtils
 {
     public:
         Gateway(const std::string &host, const short port, const short openPort);
-        ~Gateway() = default;
+        ~Gateway();
 
         bool    registerToServer();
 
-        void    receiveSMRegister(QTcpSocket *socket, const std::string &mid, const std::string &auth);
-        void    receiveSMLogin(QTcpSocket *socket, const std::string &cU, const std::string &cid, const std::string &cL, const std::string &time);
+        void    receiveMessage(GatewayConnection *connection, const Wire::Message &message);
+        void    receiveSMRegister(GatewayConnection *connection, const std::string &mid, const Digest &auth);
+        // an empty device finds the smart reader by the address it registered from
+        void    receiveSMLogin(GatewayConnection *connection, const std::string &cU, const std::string &cid, const Digest &cL, const std::string &time, const std::string &device);
+        void    receiveServerLogin(GatewayConnection *connection, const Wire::Message &reply);
+
+        // number of event loop threads serving smart readers, defaults to the core count
+        void    setWorkerCount(int count);
+        // connections each worker keeps open to the Server, closed after idleTimeout ms unused
+        void    setServerPool(int size, int idleTimeout);
+        // logins forwarded to the Server together, waiting at most window us for the batch to fill; 1 disables it
+        void    setLoginBatching(int size, int window);
+        // smart readers the registry holds without growing
+        void    setRegistryCapacity(std::size_t count);
+        // replays the smart readers and the registration to the Server recorded in path, then records
+        // them there from now on. Before registerToServer, which trusts the recorded registration until
+        // the Server refuses a login made with it
+        bool    openRegistryFile(const std::string &path);
 
         bool    runNAN();
 
@@ -23,13 +45,36 @@ class Gateway : public CommonUtils
         std::string getMyId() const override;
 
     private:
+        // registers with the Server and records the result, format is the one to try first and the one settled
+        bool    exchangeRegistration(Wire::Format &format);
+        // called when the Server refused a login made with the given registration, see receiveServerLogin
+        void    registerAgain(unsigned int used);
+
         std::string host;
         short       port;
         short       myPort;
+        int         workerCount;
+        int         serverPoolSize;
+        int         serverIdleTimeout;
+        int         batchSize;
+        int         batchWindow;
+
+        // negotiated by registerToServer
+        Wire::Format    serverFormat;
 
-        std::string myRandom;
-        std::string verifier;
+        // the registration logins use, replaced by registerAgain from the worker threads
+        mutable std::mutex  registrationLock;
+        std::string         myRandom;
+        std::string         verifier;
+        unsigned int        registration;       // bumped by every exchange with the Server
+        // false while the registration replayed from the registry file has not served a login yet
+        std::atomic<bool>   confirmed;
+        // held by the one worker registering again
+        std::mutex          registering;
 
-        std::unordered_map<unsigned int, std::string>   hashNames;
+        // hM of each smart reader, keyed by its mid and bound to the address it registered from
+        DeviceRegistry  registry;
+        // null without --registry-file
+        std::unique_ptr<RegistryFile>   registryFile;
 };
 
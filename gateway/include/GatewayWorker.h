@@ -0,0 +1,86 @@
+#include <QObject>
+#include <QThread>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include "QTimings.h"
+#include "WireFormat.hpp"
+#include "LoginBatcher.h"
+
+#pragma once
+
+class Gateway;
+
+// State of one smart reader connection, alive until the socket disconnects
+class GatewayConnection : public QObject
+{
+    public:
+        explicit GatewayConnection(QObject *parent = nullptr) : QObject(parent) {}
+
+        // sends the pending reply, dumps the timings and closes the connection
+        void    close();
+
+        QTcpSocket              *socket = nullptr;
+        LoginBatcher            *loginBatcher = nullptr;
+        QByteArray              received;
+        bool                    handled = false;
+        Wire::Format            format = Wire::Format::Legacy;     // the one the smart reader used
+
+        QTimings    timings;
+
+        // the trace id sent by the smart reader, forwarded to the Server
+        std::string                             trace;
+        std::unique_ptr<QTimings::TraceScope>   traceScope;
+
+        // login values computed before the Server round trip and needed after it
+        Digest      hM;
+        std::string wP;
+        std::string bi;
+        Digest      hashVnNID;
+        std::string localTime;
+        std::string myRandom;           // of the registration the login was made with
+        unsigned int registration = 0;
+};
+
+// Event loop thread owning a share of the smart reader connections
+class GatewayWorker : public QObject
+{
+    public:
+        // the worker takes ownership of the batcher, its Server connections live in the worker thread
+        GatewayWorker(Gateway &gateway, LoginBatcher *loginBatcher);
+        ~GatewayWorker();
+
+        void    start();
+        void    stop();
+
+        // can be called from any thread, the socket is opened in the worker thread
+        void    addConnection(qintptr descriptor);
+
+        int     inFlight() const { return this->connections; }
+
+    private:
+        void    openConnection(qintptr descriptor);
+        void    readConnection(GatewayConnection *connection);
+        void    closeConnection(GatewayConnection *connection);
+
+        Gateway                 &gateway;
+        LoginBatcher            *loginBatcher;
+        QThread                 thread;
+        std::atomic<int>        connections;
+};
+
+// Listening socket handing each accepted descriptor to the least busy worker
+class NANServer : public QTcpServer
+{
+    public:
+        explicit NANServer(const std::vector<std::unique_ptr<GatewayWorker>> &workers) : workers(workers) {}
+
+    protected:
+        void    incomingConnection(qintptr handle) override;
+
+    private:
+        const std::vector<std::unique_ptr<GatewayWorker>>   &workers;
+        std::size_t                                         next = 0;
+};
@@ -0,0 +1,40 @@
+#include <QObject>
+#include <QPointer>
+#include <QTimer>
+#include <vector>
+#include "ServerConnectionPool.h"
+
+#pragma once
+
+// Groups the logins a worker forwards within a short window into a single batch message
+// to the Server, so one round trip and one Server wake-up serve many smart readers.
+// With a size of 1, or a Server speaking the legacy format, logins go out one by one.
+class LoginBatcher : public QObject
+{
+    public:
+        // the batcher takes ownership of the pool; window is in microseconds
+        LoginBatcher(ServerConnectionPool *pool, int size, int window, bool enabled, QObject *parent = nullptr);
+
+        // same contract as ServerConnectionPool::request, login being a whole binary login message
+        void    submit(QObject *context, const QByteArray &login, ServerConnectionPool::Callback callback);
+
+    private:
+        struct Entry
+        {
+            QPointer<QObject>               context;
+            QByteArray                      login;
+            ServerConnectionPool::Callback  callback;
+        };
+
+        void    flush();
+        void    fanOut(std::vector<Entry> &entries, const Wire::Message &reply, const char *error);
+
+        ServerConnectionPool    *pool;
+        int                     size;
+        int                     window;
+        bool                    enabled;
+
+        std::vector<Entry>      pending;
+        int                     pendingBytes;
+        QTimer                  timer;
+};
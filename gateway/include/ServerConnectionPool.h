@@ -0,0 +1,73 @@
+#include <QObject>
+#include <QPointer>
+#include <QTcpSocket>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <deque>
+#include <functional>
+#include <list>
+#include <string>
+#include "WireFormat.hpp"
+
+#pragma once
+
+// Long-lived connections from one worker thread to the Server, reused across logins.
+// Every connection carries one request at a time; requests wait in a queue while all
+// of them are busy and the pool is full.
+class ServerConnectionPool : public QObject
+{
+    public:
+        // error is nullptr on success, otherwise the reply to forward to the smart reader
+        using Callback = std::function<void(const Wire::Message &reply, const char *error)>;
+
+        ServerConnectionPool(const std::string &host, short port, int size, int idleTimeout, QObject *parent = nullptr);
+
+        // the callback runs on the pool thread, and only if context is still alive by then
+        void    request(QObject *context, const QByteArray &message, Callback callback);
+
+    private:
+        struct Pending
+        {
+            QPointer<QObject>   context;
+            QByteArray          message;
+            Callback            callback;
+            bool                retried;
+            quint64             id;         // finds it in the queue once its deadline passed
+        };
+
+        struct Upstream
+        {
+            QTcpSocket      *socket;
+            QElapsedTimer   idleSince;
+            bool            connected;
+            bool            busy;
+            bool            reused;
+            unsigned int    sequence;
+            Pending         current;
+            QByteArray      received;
+        };
+
+        void    dispatch();
+        void    open();
+        void    send(Upstream &upstream, Pending pending);
+        void    receive(QTcpSocket *socket);
+        // closedByPeer: the Server closed the connection, the only case where its request is sent again
+        void    drop(QTcpSocket *socket, const char *error = "UnableToReadServer", bool closedByPeer = false);
+        // answers every queued request with error
+        void    failQueue(const char *error);
+        // answers the request if it still waits in the queue
+        void    expire(quint64 id);
+        void    closeIdle();
+
+        std::list<Upstream>::iterator   find(QTcpSocket *socket);
+
+        QString     host;
+        short       port;
+        int         size;
+        int         idleTimeout;
+
+        std::list<Upstream>     upstreams;
+        std::deque<Pending>     queue;
+        quint64                 nextId;
+        QTimer                  idleTimer;
+};
@@ -1,21 +1,43 @@
 #include <string>
-#include <sstream>
 #include <iostream>
 #include <future>
+#include <algorithm>
 #include <QTcpSocket>
 #include <QByteArray>
 #include <QTcpServer>
+#include <QThread>
 #include "Gateway.h"
+#include "Metrics.hpp"
+#include "MultiHasher.hpp"
 #include "QTimings.h"
 
-Gateway::Gateway(const std::string &host, short port, short open) : CommonUtils(16, 80), host(host), port(port), myPort(open)
-{}
+Gateway::Gateway(const std::string &host, short port, short open) : CommonUtils(16, 80), host(host), port(port), myPort(open),
+    workerCount(std::max(QThread::idealThreadCount(), 1)), serverPoolSize(4), serverIdleTimeout(30000), batchSize(1), batchWindow(200), serverFormat(Wire::Format::Binary),
+    registration(0), confirmed(true)
+{
+    Metrics::sampled("scae_registry_size", "Smart readers registered to the Gateway.", [this]() {
+        return static_cast<double>(this->registry.size());
+    });
+    Metrics::sampled("scae_registry_bytes", "Memory held by the registry of the Gateway.", [this]() {
+        return static_cast<double>(this->registry.memory());
+    });
+}
+
+Gateway::~Gateway()
+{
+    Metrics::removeSampled("scae_registry_size");
+    Metrics::removeSampled("scae_registry_bytes");
+}
 
 std::string Gateway::getMyId() const
 {
     return "GatewayNID028734";
 }
 
+// every field a smart reader sends is a digest, a number, a time or an id, far below this. The Server
+// takes a whole login, made of them, in a single message
+static  const std::size_t   maxReaderFieldSize = 4096;
+
 static  std::string readInput()
 {
     std::string answer;
@@ -23,15 +45,70 @@ static  std::string readInput()
     return answer;
 }
 
+void    Gateway::setWorkerCount(int count)
+{
+    this->workerCount = std::max(count, 1);
+}
+
+void    Gateway::setServerPool(int size, int idleTimeout)
+{
+    this->serverPoolSize = std::max(size, 1);
+    this->serverIdleTimeout = std::max(idleTimeout, 0);
+}
+
+void    Gateway::setLoginBatching(int size, int window)
+{
+    this->batchSize = std::min(std::max(size, 1), Wire::maxBatch);
+    this->batchWindow = std::max(window, 0);
+}
+
+void    Gateway::setRegistryCapacity(std::size_t count)
+{
+    this->registry.reserve(count);
+}
+
+bool    Gateway::openRegistryFile(const std::string &path)
+{
+    this->registryFile.reset(new RegistryFile(this->registry));
+    if (!this->registryFile->open(QString::fromStdString(path)))
+    {
+        this->registryFile.reset();
+        return false;
+    }
+    return true;
+}
+
 bool    Gateway::runNAN()
 {
-    QTcpServer  server;
+    std::vector<std::unique_ptr<GatewayWorker>> workers;
+
+    for (int i = 0; i < this->workerCount; ++i)
+    {
+        ServerConnectionPool *pool = new ServerConnectionPool(this->host, this->port, this->serverPoolSize, this->serverIdleTimeout);
+
+        // batches only exist in the binary format
+        workers.emplace_back(new GatewayWorker(*this, new LoginBatcher(pool, this->batchSize, this->batchWindow, this->serverFormat == Wire::Format::Binary)));
+        workers.back()->start();
+    }
+
+    NANServer   server(workers);
 
     if (!server.listen(QHostAddress::Any, this->myPort))
     {
         std::cerr << "Could not start NAN: " << server.errorString().toStdString() << std::endl;
         return false;
     }
+    std::cout << "NAN listening with " << workers.size() << " workers" << std::endl;
+
+    // a connection carries a single request, the open ones are the requests in flight
+    Metrics::sampled("scae_requests_in_flight", "Requests being processed.", [&workers]() {
+        int inFlight = 0;
+        for (const auto &worker : workers)
+        {
+            inFlight += worker->inFlight();
+        }
+        return static_cast<double>(inFlight);
+    });
 
     std::string prevInput;
     std::cin >> prevInput;
@@ -53,178 +130,200 @@ bool    Gateway::runNAN()
             }
             else
             {
+                if (prevInput.compare("timings") == 0)
+                {
+                    std::cout << QTimings::getPPDistributions() << std::endl;
+                }
                 consoleInput = new std::future<std::string>(std::async(readInput));
             }
         }
 
-        if (!server.waitForNewConnection(100, &timeOutCheck))
+        // accepted connections are handed to the workers by NANServer::incomingConnection
+        if (!server.waitForNewConnection(100, &timeOutCheck) && !timeOutCheck)
         {
-            if (!timeOutCheck)
-            {
-                serverIsOn = false;
-            }
-            continue;
+            serverIsOn = false;
         }
+    }
 
-        QTimings::getShared().start("connection");
-        std::cout << "Received a new connection !" << std::endl;
+    Metrics::removeSampled("scae_requests_in_flight");
+    server.close();
+    for (auto &worker : workers)
+    {
+        worker->stop();
+    }
 
-        QTcpSocket  *connection = server.nextPendingConnection();
-        if (connection == nullptr)
-        {
-            continue;
-        }
+    return true;
+}
 
-        if (!connection->waitForReadyRead())
-        {
-            connection->close();
-            continue;
-        }
+void    Gateway::receiveMessage(GatewayConnection *connection, const Wire::Message &message)
+{
+    static std::atomic<uint64_t>    &registers = Metrics::counter("scae_requests_total", "Requests received, by type.", Metrics::label("type", "register"));
+    static std::atomic<uint64_t>    &logins = Metrics::counter("scae_requests_total", "Requests received, by type.", Metrics::label("type", "login"));
+    static std::atomic<uint64_t>    &unknown = Metrics::counter("scae_requests_total", "Requests received, by type.", Metrics::label("type", "unknown"));
 
-        QByteArray  message = connection->readAll();
-        char type = message.front();
+    const std::vector<std::string> &fields = message.fields;
+    Digest                          digest;
 
-        QList<QByteArray> splitted;
+    connection->format = message.format;
 
-        if (type >= '0' && type <= '9')
+    for (const std::string &field : fields)
+    {
+        if (field.size() > maxReaderFieldSize)
         {
-            message.remove(0, 1);
-            splitted = message.split(':');
+            connection->socket->write(Wire::error(message.format, "FieldTooLong"));
+            connection->close();
+            return;
         }
+    }
 
-        switch (type)
-        {
-            case '1':
-                QTimings::getShared().start("register");
-                if (splitted.size() != 2)
-                {
-                    connection->write("InvalidNumberOfArguments");
-                    break;
-                }
-                this->receiveSMRegister(connection, QByteArray::fromBase64(splitted[0]).toStdString(), QByteArray::fromBase64(splitted[1]).toStdString());
-                QTimings::getShared().stop("register");
-                std::cout << QTimings::getShared().getPPTimings() << std::endl;
-                QTimings::getShared().reset();
+    switch (message.type)
+    {
+        case '1':
+            ++registers;
+            QTimings::getShared().start("register");
+            if (fields.size() != 2)
+            {
+                connection->socket->write(Wire::error(message.format, "InvalidNumberOfArguments"));
                 break;
-
-            case '2':
-                QTimings::getShared().start("login");
-                if (splitted.size() != 4)
-                {
-                    connection->write("InvalidNumberOfArguments");
-                    break;
-                }
-                this->receiveSMLogin(connection, QByteArray::fromBase64(splitted[0]).toStdString(), QByteArray::fromBase64(splitted[1]).toStdString(),
-                        QByteArray::fromBase64(splitted[2]).toStdString(), QByteArray::fromBase64(splitted[3]).toStdString());
-                QTimings::getShared().stop("login");
-                std::cout << QTimings::getShared().getPPTimings() << std::endl;
-                QTimings::getShared().reset();
+            }
+            if (!Wire::readDigest(message.format, fields[1], digest))
+            {
+                connection->socket->write(Wire::error(message.format, "InvalidDigest"));
                 break;
-
-            default:
-                connection->write("WrongProtocol");
+            }
+            this->receiveSMRegister(connection, fields[0], digest);
+            QTimings::getShared().stop("register");
+            break;
+
+        case '2':
+            ++logins;
+            QTimings::getShared().start("login");
+            if (fields.size() < 4 || fields.size() > 6)
+            {
+                connection->socket->write(Wire::error(message.format, "InvalidNumberOfArguments"));
                 break;
-        }
-
-        connection->flush();
-        connection->close();
-        connection = nullptr;
-
-        QTimings::getShared().stop("connection");
+            }
+            if (!Wire::readDigest(message.format, fields[2], digest))
+            {
+                connection->socket->write(Wire::error(message.format, "InvalidDigest"));
+                break;
+            }
+            // the optional fifth field is the trace id, possibly empty, the steps of the connection belong to it from now on
+            if (fields.size() >= 5 && !fields[4].empty())
+            {
+                connection->trace = fields[4];
+                connection->traceScope.reset(new QTimings::TraceScope(connection->timings, { connection->trace }));
+            }
+            // the reply is sent once the Server answered, see receiveServerLogin.
+            // The optional sixth field is the mid of the smart reader
+            this->receiveSMLogin(connection, fields[0], fields[1], digest, fields[3], (fields.size() == 6) ? fields[5] : std::string());
+            return;
+
+        default:
+            ++unknown;
+            connection->socket->write(Wire::error(message.format, "WrongProtocol"));
+            break;
     }
 
-    return true;
+    connection->close();
 }
 
-void    Gateway::receiveSMRegister(QTcpSocket *socket, const std::string &mid, const std::string &auth)
+void    Gateway::receiveSMRegister(GatewayConnection *connection, const std::string &mid, const Digest &auth)
 {
 #ifdef PRINT_DEBUG
     std::cout << "[REGISTER] client.mid == '" << mid << "' (" << QByteArray::fromStdString(mid).toHex().toStdString() << ")" << std::endl;
-    std::cout << "[REGISTER] client.auth == '" << auth << "' (" << QByteArray::fromStdString(auth).toHex().toStdString() << ")" << std::endl;
+    std::cout << "[REGISTER] client.auth == '" << auth.hex() << "'" << std::endl;
 #endif
-    std::ostringstream oss;
 
-    oss << this->verifier << this->getMyId();
+    std::string verifier;
+    {
+        std::lock_guard<std::mutex> guard(this->registrationLock);
+        verifier = this->verifier;
+    }
 
-    std::string hN = this->hash(oss.str(), "hash-hN");
+    Digest hN = (Hasher("hash-hN") << verifier << this->getMyId()).finalize();
 #ifdef PRINT_DEBUG
-    QByteArray copyhN = QByteArray::fromStdString(hN).replace("\r", "\\r");
-    std::cout << "[REGISTER] hN == '" << copyhN.toStdString() << "' (" << QByteArray::fromStdString(hN).toHex().toStdString() << ")" << std::endl;
+    std::cout << "[REGISTER] hN == '" << hN.hex() << "'" << std::endl;
 #endif
 
-    oss.str("");
-    oss.clear();
-
-    oss << hN << auth;
-
-    std::string vM = this->scalarMul(this->hash(oss.str(), "hash-vM"), 126, "scalar-vM");
+    // the curve multiplies the hexadecimal text of the digest
+    std::string vM = this->scalarMul((Hasher("hash-vM") << hN << auth).finalize().hex(), 126, "scalar-vM");
 #ifdef PRINT_DEBUG
     std::cout << "[REGISTER] vM == '" << vM << "' (" << QByteArray::fromStdString(vM).toHex().toStdString() << ")" << std::endl;
 #endif
 
-    oss.str("");
-    oss.clear();
-
-    oss << vM << mid;
-
-    std::string hM = this->hash(oss.str(), "hash-hM");
+    Digest hM = (Hasher("hash-hM") << vM << mid).finalize();
 #ifdef PRINT_DEBUG
-    std::cout << "[REGISTER] hM == '" << hM << "' (" << QByteArray::fromStdString(hM).toHex().toStdString() << ")" << std::endl;
+    std::cout << "[REGISTER] hM == '" << hM.hex() << "'" << std::endl;
 #endif
 
-    quint32 ip = socket->peerAddress().toIPv4Address();
+    quint32 ip = connection->socket->peerAddress().toIPv4Address();
 
-    this->hashNames.emplace(ip, hM);
+    if (!this->registry.insert(mid, hM, ip))
+    {
+        connection->socket->write(Wire::error(connection->format, "InvalidDeviceId"));
+        return;
+    }
+    if (this->registryFile)
+    {
+        this->registryFile->append(mid, hM, ip);
+    }
 
-    socket->write("1");
-    socket->write(QByteArray::fromStdString(vM).toBase64());
+    connection->socket->write(Wire::Writer(connection->format, '1').add(vM).data());
 }
 
-void    Gateway::receiveSMLogin(QTcpSocket *socket, const std::string &cU, const std::string &cid, const std::string &cL, const std::string &time)
+void    Gateway::receiveSMLogin(GatewayConnection *connection, const std::string &cU, const std::string &cid, const Digest &cL, const std::string &time, const std::string &device)
 {
 #ifdef PRINT_DEBUG
     std::cout << "[LOGIN] client.cU == '" << cU << "' (" << QByteArray::fromStdString(cU).toHex().toStdString() << ")" << std::endl;
     std::cout << "[LOGIN] client.cid == '" << cid << "' (" << QByteArray::fromStdString(cid).toHex().toStdString() << ")" << std::endl;
-    std::cout << "[LOGIN] client.C1   == '" << cL << "' (" << QByteArray::fromStdString(cL).toHex().toStdString() << ")" << std::endl;
+    std::cout << "[LOGIN] client.C1   == '" << cL.hex() << "'" << std::endl;
     std::cout << "[LOGIN] client.time   == '" << time << "' (" << QByteArray::fromStdString(time).toHex().toStdString() << ")" << std::endl;
 #endif
+    QTcpSocket  *socket = connection->socket;
     std::string localTime = "TIME";
 
-    std::string hM;
-    try
+    // a smart reader naming itself has to log in from the address it registered from
+    quint32     ip = socket->peerAddress().toIPv4Address();
+    Digest      hM = device.empty() ? this->registry.findByAddress(ip) : this->registry.find(device, ip);
+    if (hM.empty())
     {
-        hM = this->hashNames.at(socket->peerAddress().toIPv4Address());
-    }
-    catch (const std::out_of_range &e)
-    {
-        socket->write("IpAddressNotRegistered");
+        socket->write(Wire::error(connection->format, device.empty() ? "IpAddressNotRegistered" : "DeviceNotRegistered"));
+        connection->close();
         return;
     }
 #ifdef PRINT_DEBUG
-    std::cout << "[LOGIN] hM == '" << hM << "' (" << QByteArray::fromStdString(hM).toHex().toStdString() << ")" << std::endl;
+    std::cout << "[LOGIN] hM == '" << hM.hex() << "'" << std::endl;
 #endif
 
     //TODO: check delta time
 
+    std::string verifier;
+    {
+        std::lock_guard<std::mutex> guard(this->registrationLock);
+        verifier = this->verifier;
+        connection->myRandom = this->myRandom;
+        connection->registration = this->registration;
+    }
+    const std::string &myRandom = connection->myRandom;
+
     std::string wP = this->applyXOr(cU, hM, "xor-wP");
 #ifdef PRINT_DEBUG
     std::cout << "[LOGIN] wP == '" << wP << "' (" << QByteArray::fromStdString(wP).toHex().toStdString() << ")" << std::endl;
 #endif
 
-    std::ostringstream tmp;
-    tmp << wP << time;
+    // independent hashes are computed together
+    MultiHasher hashBiVnID("hash-bi-VnID");
+    hashBiVnID.add() << wP << time;
+    hashBiVnID.add() << verifier << this->getMyId();
+    std::vector<Digest> digests = hashBiVnID.finalize();
 
-    std::string bi = this->applyXOr(this->hash(tmp.str(), "hash-bi"), cid, "xor-bi");
+    std::string bi = this->applyXOr(digests[0], cid, "xor-bi");
 #ifdef PRINT_DEBUG
     std::cout << "[LOGIN] bi == '" << bi << "' (" << QByteArray::fromStdString(bi).toHex().toStdString() << ")" << std::endl;
 #endif
 
-    tmp.str("");
-    tmp.clear();
-
-    tmp << this->verifier << this->getMyId();
-
-    std::string hashVnNID = this->hash(tmp.str(), "hash-VnID");
+    Digest hashVnNID = digests[1];
 
     std::string cN = this->applyXOr(this->applyXOr(cU, hM, "xor-cN-1"), hashVnNID, "xor-cN-2");
 #ifdef PRINT_DEBUG
@@ -232,101 +331,106 @@ void    Gateway::receiveSMLogin(QTcpSocket *socket, const std::string &cU, const
     std::cout << "[LOGIN] cN == '" << copycN.toStdString() << "' (" << QByteArray::fromStdString(cN).toHex().toStdString() << ")" << std::endl;
 #endif
 
-    tmp.str("");
-    tmp.clear();
-
-    tmp << cN << hashVnNID;
+    MultiHasher hashRidC2("hash-rid-c2");
+    hashRidC2.add() << cN << hashVnNID;
+    hashRidC2.add() << cL << localTime << cN << myRandom;
+    digests = hashRidC2.finalize();
 
-    std::string rid = this->applyXOr(this->hash(tmp.str(), "hash-rid"), this->myRandom, "xor-rid");
+    std::string rid = this->applyXOr(digests[0], myRandom, "xor-rid");
 #ifdef PRINT_DEBUG
     std::cout << "[LOGIN] rid == '" << rid << "' (" << QByteArray::fromStdString(rid).toHex().toStdString() << ")" << std::endl;
 #endif
 
-    tmp.str("");
-    tmp.clear();
-
-    tmp << cL << localTime << cN << this->myRandom;
-
-    std::string c2 = this->hash(tmp.str(), "hash-c2");
+    Digest c2 = digests[1];
 #ifdef PRINT_DEBUG
-    std::cout << "[LOGIN] C2 == '" << c2 << "' (" << QByteArray::fromStdString(c2).toHex().toStdString() << ")" << std::endl;
+    std::cout << "[LOGIN] C2 == '" << c2.hex() << "'" << std::endl;
 #endif
 
-    QTcpSocket  serverSocket;
-    QByteArray  output;
-
-    output.append('2');
-    output.append(QByteArray::fromStdString(cid).toBase64());
-    output.append(':');
-    output.append(QByteArray::fromStdString(time).toBase64());
-    output.append(':');
-    output.append(QByteArray::fromStdString(c2).toBase64());
-    output.append(':');
-    output.append(QByteArray::fromStdString(rid).toBase64());
-    output.append(':');
-    output.append(QByteArray::fromStdString(cN).toBase64());
-    output.append(':');
-    output.append(QByteArray::fromStdString(localTime).toBase64());
+    connection->hM = hM;
+    connection->wP = wP;
+    connection->bi = bi;
+    connection->hashVnNID = hashVnNID;
+    connection->localTime = localTime;
 
-    QTimings::getShared().start("send_login");
-
-    serverSocket.connectToHost(QString::fromStdString(this->host), this->port);
+    Wire::Writer    request(this->serverFormat, '2');
 
-    if (!serverSocket.waitForConnected())
+    request.add(cid).add(time).add(c2).add(rid).add(cN).add(localTime);
+    if (!connection->trace.empty())
     {
-        std::cerr << "Error while connecting: " << socket->errorString().toStdString() << std::endl;
-        socket->write("UnableToContactServer");
-        return;
+        request.add(connection->trace);
     }
+    QByteArray  output = request.data();
 
-    serverSocket.write(output);
-
-    if (!serverSocket.waitForBytesWritten())
+    if (output.isEmpty())
     {
-        std::cerr << "Error while flushing: " << serverSocket.errorString().toStdString() << std::endl;
-        socket->write("UnableToContactServer");
-        serverSocket.close();
-        return;
-    }
-
-    if (!serverSocket.waitForReadyRead())
-    {
-        std::cerr << "No informations to read: " << serverSocket.errorString().toStdString() << std::endl;
-        socket->write("UnableToReadServer");
-        serverSocket.close();
+        socket->write(Wire::error(connection->format, "FieldTooLong"));
+        connection->close();
         return;
     }
+    QTimings::getShared().start("send_login");
 
-    QByteArray  rawResult = serverSocket.readAll();
+    // the round trip runs on the worker event loop, other connections keep being served meanwhile
+    connection->loginBatcher->submit(connection, output, [this, connection](const Wire::Message &reply, const char *error) {
+        QTimings::Scope scope(connection->timings);
+        if (error != nullptr)
+        {
+            std::cerr << "Error while contacting server: " << error << std::endl;
+            connection->socket->write(Wire::error(connection->format, error));
+            connection->close();
+            return;
+        }
+        this->receiveServerLogin(connection, reply);
+    });
+}
 
-    serverSocket.disconnectFromHost();
-    serverSocket.close();
+void    Gateway::receiveServerLogin(GatewayConnection *connection, const Wire::Message &reply)
+{
+    QTcpSocket  *socket = connection->socket;
+    const Digest &hM = connection->hM;
+    const std::string &wP = connection->wP;
+    const std::string &bi = connection->bi;
+    const Digest &hashVnNID = connection->hashVnNID;
+    const std::string &localTime = connection->localTime;
+    const std::string &myRandom = connection->myRandom;
 
     QTimings::getShared().stop("send_login");
 
-    if (rawResult.front() != '2')
+    if (reply.type != '2')
     {
-        std::cerr << "The server returned an error: " << rawResult.toStdString() << std::endl;
-        socket->write("ServerError:");
-        socket->write(rawResult);
+        std::cerr << "The server returned an error: " << reply.error() << std::endl;
+        // the Server lost this Gateway, or never had the registration replayed from the registry file.
+        // A smart reader can cause WrongID itself, so it only counts before a login went through
+        if (reply.error() == "IpAddressNotRegistered" || (reply.error() == "WrongID" && !this->confirmed))
+        {
+            this->registerAgain(connection->registration);
+        }
+        socket->write(Wire::error(connection->format, "ServerError:" + reply.error()));
+        connection->close();
         return;
     }
 
-    rawResult.remove(0, 1);
-    QList<QByteArray>  results = rawResult.split(':');
-    if (results.size() != 3)
+    if (reply.fields.size() != 3)
     {
-        std::cerr << "Wrong amount of arguments, expected " << 3 << ", got " << results.size() << std::endl;
-        socket->write("ServerProtocolError");
+        std::cerr << "Wrong amount of arguments, expected " << 3 << ", got " << reply.fields.size() << std::endl;
+        socket->write(Wire::error(connection->format, "ServerProtocolError"));
+        connection->close();
         return;
     }
 
-    std::string c3 = QByteArray::fromBase64(results[0]).toStdString();
-    std::string cS = QByteArray::fromBase64(results[1]).toStdString();
-    std::string serverTime = QByteArray::fromBase64(results[2]).toStdString();
+    const std::string &cS = reply.fields[1];
+    const std::string &serverTime = reply.fields[2];
+    Digest  c3;
+
+    if (!Wire::readDigest(reply.format, reply.fields[0], c3))
+    {
+        std::cerr << "The server returned an invalid C3" << std::endl;
+        socket->write(Wire::error(connection->format, "ServerProtocolError"));
+        connection->close();
+        return;
+    }
 
 #ifdef PRINT_DEBUG
-    std::cout << "[LOGIN] server.C3 == '" << c3 << "' (" << QByteArray::fromStdString(c3).toHex().toStdString() << ")" << std::endl;
+    std::cout << "[LOGIN] server.C3 == '" << c3.hex() << "'" << std::endl;
     std::cout << "[LOGIN] server.Cs == '" << cS << "' (" << QByteArray::fromStdString(cS).toHex().toStdString() << ")" << std::endl;
     std::cout << "[LOGIN] server.time == '" << serverTime << "' (" << QByteArray::fromStdString(serverTime).toHex().toStdString() << ")" << std::endl;
 #endif
@@ -341,53 +445,86 @@ void    Gateway::receiveSMLogin(QTcpSocket *socket, const std::string &cU, const
     std::cout << "[LOGIN] cM == '" << cM << "' (" << QByteArray::fromStdString(cM).toHex().toStdString() << ")" << std::endl;
 #endif
 
-    tmp.str("");
-    tmp.clear();
-
-    tmp << yP << wP << bi << this->myRandom;
+    MultiHasher hashes("hash-SKn-c4-ridM");
+    hashes.add() << yP << wP << bi << myRandom;
+    hashes.add() << c3 << localTime << cM << myRandom;
+    hashes.add() << cM << hM;
+    std::vector<Digest> digests = hashes.finalize();
 
-    std::string SKn = this->hash(tmp.str(), "hash-SKn");
 #ifdef PRINT_DEBUG
-    std::cout << "[LOGIN] SKn == '" << SKn << "' (" << QByteArray::fromStdString(SKn).toHex().toStdString() << ")" << std::endl;
+    std::cout << "[LOGIN] SKn == '" << digests[0].hex() << "'" << std::endl;
 #endif
 
-    tmp.str("");
-    tmp.clear();
-
-    tmp << c3 << localTime << cM << this->myRandom;
-
-    std::string c4 = this->hash(tmp.str(), "hash-c4");
+    const Digest &c4 = digests[1];
 #ifdef PRINT_DEBUG
-    std::cout << "[LOGIN] C4 == '" << c4 << "' (" << QByteArray::fromStdString(c4).toHex().toStdString() << ")" << std::endl;
+    std::cout << "[LOGIN] C4 == '" << c4.hex() << "'" << std::endl;
 #endif
 
-    tmp.str("");
-    tmp.clear();
-
-    tmp << cM << hM;
-
-    std::string ridM = this->applyXOr(this->hash(tmp.str(), "hash-ridM"), this->myRandom, "xor-ridM");
+    std::string ridM = this->applyXOr(digests[2], myRandom, "xor-ridM");
 #ifdef PRINT_DEBUG
     std::cout << "[LOGIN] ridM == '" << ridM << "' (" << QByteArray::fromStdString(ridM).toHex().toStdString() << ")" << std::endl;
 #endif
 
-    socket->write("2");
-    socket->write(QByteArray::fromStdString(c3).toBase64());
-    socket->write(":");
-    socket->write(QByteArray::fromStdString(cS).toBase64());
-    socket->write(":");
-    socket->write(QByteArray::fromStdString(serverTime).toBase64());
-    socket->write(":");
-    socket->write(QByteArray::fromStdString(c4).toBase64());
-    socket->write(":");
-    socket->write(QByteArray::fromStdString(cM).toBase64());
-    socket->write(":");
-    socket->write(QByteArray::fromStdString(localTime).toBase64());
-    socket->write(":");
-    socket->write(QByteArray::fromStdString(ridM).toBase64());
+    QByteArray  output = Wire::Writer(connection->format, '2').add(c3).add(cS).add(serverTime).add(c4).add(cM).add(localTime).add(ridM).data();
+
+    if (output.isEmpty())
+    {
+        std::cerr << "The server returned fields too long to be forwarded" << std::endl;
+        socket->write(Wire::error(connection->format, "ServerProtocolError"));
+        connection->close();
+        return;
+    }
+    socket->write(output);
+    this->confirmed = true;
+
+    QTimings::getShared().stop("login");
+    connection->close();
 }
 
 bool    Gateway::registerToServer()
+{
+    // only a hint that the Server kept this Gateway registered across the restart,
+    // registerAgain runs when a login tells otherwise
+    if (this->registryFile && !this->registryFile->state("gateway.verifier").empty())
+    {
+        this->myRandom = this->registryFile->state("gateway.myRandom");
+        this->verifier = this->registryFile->state("gateway.verifier");
+        this->serverFormat = (this->registryFile->state("gateway.serverFormat") == "binary") ? Wire::Format::Binary : Wire::Format::Legacy;
+        this->confirmed = false;
+        return true;
+    }
+
+    return this->exchangeRegistration(this->serverFormat);
+}
+
+void    Gateway::registerAgain(unsigned int used)
+{
+    // the other workers answer their failed logins meanwhile, the smart readers try again
+    std::unique_lock<std::mutex>    guard(this->registering, std::try_to_lock);
+    if (!guard.owns_lock())
+    {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> current(this->registrationLock);
+        if (this->registration != used)
+        {
+            // already replaced since that login
+            return;
+        }
+    }
+
+    std::cerr << "The Server refused the registration of this Gateway, registering again" << std::endl;
+
+    // blocks this worker for the exchange. The format logins use was settled at start
+    Wire::Format    format = this->serverFormat;
+    if (!this->exchangeRegistration(format))
+    {
+        std::cerr << "Could not register again to the Server" << std::endl;
+    }
+}
+
+bool    Gateway::exchangeRegistration(Wire::Format &format)
 {
     std::string nid = this->getMyId();
     std::string bi = this->newRandom();
@@ -395,75 +532,49 @@ bool    Gateway::registerToServer()
     std::cout << "[MY_REG] bi == '" << bi << "' (" << QByteArray::fromStdString(bi).toHex().toStdString() << ")" << std::endl;
 #endif
 
-    std::ostringstream strs;
-
-    strs.str("");
-    strs.clear();
-
-    strs << nid << bi;
-
-    std::string ai = this->hash(strs.str(), "calcA");
+    Digest ai = (Hasher("calcA") << nid << bi).finalize();
 #ifdef PRINT_DEBUG
-    std::cout << "[MY_REG] ai == '" << ai << "' (" << QByteArray::fromStdString(ai).toHex().toStdString() << ")" << std::endl;
+    std::cout << "[MY_REG] ai == '" << ai.hex() << "'" << std::endl;
 #endif
 
-    QTcpSocket  socket;
-    QByteArray  output;
-
-    output.append('1');
-    output.append(QByteArray::fromStdString(nid).toBase64());
-    output.append(':');
-    output.append(QByteArray::fromStdString(ai).toBase64());
+    Wire::Message   reply;
 
     QTimings::getShared().start("send_register");
 
-    std::cout << "Connecting to " << this->host << ":" << this->port << " ..." << std::endl;
-    socket.connectToHost(QString::fromStdString(this->host), this->port);
-
-    if (!socket.waitForConnected())
+    // also settles the format used with the Server by every login afterwards
+    if (!Wire::request(this->host, this->port, format, [&nid, &ai](Wire::Format format) {
+            return Wire::Writer(format, '1').add(nid).add(ai).data();
+        }, reply))
     {
-        std::cerr << "Error while connecting: " << socket.errorString().toStdString() << std::endl;
         return false;
     }
 
-    socket.write(output);
-
-    if (!socket.waitForBytesWritten())
-    {
-        std::cerr << "Error while flushing: " << socket.errorString().toStdString() << std::endl;
-        socket.close();
-        return false;
-    }
-
-    if (!socket.waitForReadyRead())
-    {
-        std::cerr << "No informations to read: " << socket.errorString().toStdString() << std::endl;
-        socket.close();
-        return false;
-    }
-
-    QByteArray  rawResult = socket.readAll();
-
-    socket.disconnectFromHost();
-    socket.close();
-
     QTimings::getShared().stop("send_register");
 
-    if (rawResult.front() != '1')
+    if (reply.type != '1' || reply.fields.size() != 1)
     {
-        std::cerr << "The server returned an error: " << rawResult.toStdString() << std::endl;
+        std::cerr << "The server returned an error: " << reply.error() << std::endl;
         return false;
     }
 
-    rawResult.remove(0, 1);
-    QByteArray  result = QByteArray::fromBase64(rawResult);
-
-    std::string vn = result.toStdString();
+    std::string vn = reply.fields[0];
 #ifdef PRINT_DEBUG
     std::cout << "[MY_REG] vn == '" << vn << "' (" << QByteArray::fromStdString(vn).toHex().toStdString() << ")" << std::endl;
 #endif
 
-    this->myRandom = bi;
-    this->verifier = vn;
+    {
+        std::lock_guard<std::mutex> guard(this->registrationLock);
+        this->myRandom = bi;
+        this->verifier = vn;
+        ++this->registration;
+    }
+    this->confirmed = true;
+    if (this->registryFile)
+    {
+        this->registryFile->setState("gateway.myRandom", bi);
+        this->registryFile->setState("gateway.serverFormat", (format == Wire::Format::Binary) ? "binary" : "legacy");
+        // last, it tells the registration was recorded
+        this->registryFile->setState("gateway.verifier", vn);
+    }
     return true;
 }
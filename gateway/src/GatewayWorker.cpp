@@ -0,0 +1,131 @@
+#include <iostream>
+#include <QMetaObject>
+#include "GatewayWorker.h"
+#include "Gateway.h"
+
+void    GatewayConnection::close()
+{
+    this->timings.stop("connection");
+    std::cout << this->timings.getPPTimings() << std::endl;
+
+    this->socket->flush();
+    this->socket->disconnectFromHost();
+}
+
+GatewayWorker::GatewayWorker(Gateway &gateway, LoginBatcher *loginBatcher) : gateway(gateway), loginBatcher(loginBatcher), connections(0)
+{
+    this->loginBatcher->setParent(this);
+    this->moveToThread(&this->thread);
+}
+
+GatewayWorker::~GatewayWorker()
+{
+    this->stop();
+}
+
+void    GatewayWorker::start()
+{
+    this->thread.start();
+}
+
+void    GatewayWorker::stop()
+{
+    if (!this->thread.isRunning())
+    {
+        return;
+    }
+
+    // sockets have to be destroyed by the thread they live in
+    QMetaObject::invokeMethod(this, [this]() {
+        const QObjectList pending = this->children();
+        qDeleteAll(pending);
+        this->loginBatcher = nullptr;
+        this->connections = 0;
+    }, Qt::BlockingQueuedConnection);
+
+    this->thread.quit();
+    this->thread.wait();
+}
+
+void    GatewayWorker::addConnection(qintptr descriptor)
+{
+    ++this->connections;
+    QMetaObject::invokeMethod(this, [this, descriptor]() { this->openConnection(descriptor); }, Qt::QueuedConnection);
+}
+
+void    GatewayWorker::openConnection(qintptr descriptor)
+{
+    GatewayConnection   *connection = new GatewayConnection(this);
+    QTcpSocket          *socket = new QTcpSocket(connection);
+
+    if (!socket->setSocketDescriptor(descriptor))
+    {
+        std::cerr << "Could not open connection: " << socket->errorString().toStdString() << std::endl;
+        --this->connections;
+        delete connection;
+        return;
+    }
+
+    connection->socket = socket;
+    connection->loginBatcher = this->loginBatcher;
+    connection->timings.start("connection");
+    std::cout << "Received a new connection !" << std::endl;
+
+    QObject::connect(socket, &QTcpSocket::readyRead, connection, [this, connection]() { this->readConnection(connection); });
+    QObject::connect(socket, &QTcpSocket::disconnected, connection, [this, connection]() { this->closeConnection(connection); });
+}
+
+void    GatewayWorker::readConnection(GatewayConnection *connection)
+{
+    // one request per connection, anything sent after it is ignored
+    if (connection->handled)
+    {
+        connection->socket->readAll();
+        return;
+    }
+    connection->received.append(connection->socket->readAll());
+
+    Wire::Message   message;
+    int             consumed = 0;
+    Wire::Status    status = Wire::parse(connection->received, message, consumed);
+
+    if (status == Wire::Status::Incomplete)
+    {
+        return;
+    }
+    connection->handled = true;
+    connection->received.clear();
+
+    QTimings::Scope scope(connection->timings);
+
+    if (status == Wire::Status::Invalid)
+    {
+        connection->socket->write(Wire::error(Wire::Format::Legacy, "WrongProtocol"));
+        connection->close();
+        return;
+    }
+    this->gateway.receiveMessage(connection, message);
+}
+
+void    GatewayWorker::closeConnection(GatewayConnection *connection)
+{
+    --this->connections;
+    connection->deleteLater();
+}
+
+void    NANServer::incomingConnection(qintptr handle)
+{
+    GatewayWorker   *chosen = this->workers[this->next].get();
+
+    for (std::size_t i = 1; i < this->workers.size(); ++i)
+    {
+        GatewayWorker *candidate = this->workers[(this->next + i) % this->workers.size()].get();
+        if (candidate->inFlight() < chosen->inFlight())
+        {
+            chosen = candidate;
+        }
+    }
+    this->next = (this->next + 1) % this->workers.size();
+
+    chosen->addConnection(handle);
+}
@@ -0,0 +1,134 @@
+#include <algorithm>
+#include <memory>
+#include "LoginBatcher.h"
+
+LoginBatcher::LoginBatcher(ServerConnectionPool *pool, int size, int window, bool enabled, QObject *parent)
+    : QObject(parent), pool(pool), size(std::min(std::max(size, 1), Wire::maxBatch)), window(std::max(window, 0)),
+      enabled(enabled && this->size > 1), pendingBytes(0), timer(this)
+{
+    this->pool->setParent(this);
+    this->timer.setSingleShot(true);
+
+    // below a millisecond the batch is flushed as soon as the event loop has drained what is ready
+    if (this->window < 1000)
+    {
+        this->timer.setInterval(0);
+    }
+    else
+    {
+        this->timer.setTimerType(Qt::PreciseTimer);
+        this->timer.setInterval((this->window + 999) / 1000);
+    }
+    QObject::connect(&this->timer, &QTimer::timeout, this, [this]() { this->flush(); });
+}
+
+void    LoginBatcher::submit(QObject *context, const QByteArray &login, ServerConnectionPool::Callback callback)
+{
+    if (!this->enabled)
+    {
+        this->pool->request(context, login, std::move(callback));
+        return;
+    }
+
+    // every field costs its u16 length on top of its bytes
+    if (!this->pending.empty() && Wire::headerSize + this->pendingBytes + 2 + login.size() > static_cast<int>(Wire::maxLength))
+    {
+        this->flush();
+    }
+
+    this->pending.push_back(Entry{ context, login, std::move(callback) });
+    this->pendingBytes += 2 + login.size();
+
+    if (static_cast<int>(this->pending.size()) >= this->size)
+    {
+        this->flush();
+    }
+    else if (!this->timer.isActive())
+    {
+        this->timer.start();
+    }
+}
+
+void    LoginBatcher::flush()
+{
+    this->timer.stop();
+
+    std::vector<Entry> entries;
+    entries.swap(this->pending);
+    this->pendingBytes = 0;
+
+    // the smart readers that went away meanwhile are not worth a slot
+    entries.erase(std::remove_if(entries.begin(), entries.end(), [](const Entry &entry) { return entry.context.isNull(); }), entries.end());
+
+    if (entries.empty())
+    {
+        return;
+    }
+    if (entries.size() == 1)
+    {
+        this->pool->request(entries[0].context, entries[0].login, std::move(entries[0].callback));
+        return;
+    }
+
+    Wire::Writer batch(Wire::Format::Binary, Wire::batchType);
+
+    for (const Entry &entry : entries)
+    {
+        batch.add(entry.login.constData(), entry.login.size());
+    }
+
+    // shared so the pool can copy the callback around
+    auto shared = std::make_shared<std::vector<Entry>>(std::move(entries));
+
+    this->pool->request(this, batch.data(), [this, shared](const Wire::Message &reply, const char *error) {
+        this->fanOut(*shared, reply, error);
+    });
+}
+
+void    LoginBatcher::fanOut(std::vector<Entry> &entries, const Wire::Message &reply, const char *error)
+{
+    if (error == nullptr && reply.error() == "WrongProtocol")
+    {
+        // a Server without batch support: send these and the next logins one by one
+        this->enabled = false;
+        for (Entry &entry : entries)
+        {
+            if (!entry.context.isNull())
+            {
+                this->pool->request(entry.context, entry.login, std::move(entry.callback));
+            }
+        }
+        return;
+    }
+
+    if (error == nullptr && (reply.type != Wire::batchType || reply.fields.size() != entries.size()))
+    {
+        error = "ServerProtocolError";
+    }
+
+    Wire::Message   login;
+    int             consumed = 0;
+
+    for (std::size_t i = 0; i < entries.size(); ++i)
+    {
+        if (entries[i].context.isNull())
+        {
+            continue;
+        }
+        if (error != nullptr)
+        {
+            entries[i].callback(Wire::Message(), error);
+            continue;
+        }
+
+        const std::string   &field = reply.fields[i];
+        QByteArray          raw = QByteArray::fromRawData(field.data(), static_cast<int>(field.size()));
+
+        if (Wire::parse(raw, login, consumed) != Wire::Status::Complete || consumed != raw.size())
+        {
+            entries[i].callback(Wire::Message(), "ServerProtocolError");
+            continue;
+        }
+        entries[i].callback(login, nullptr);
+    }
+}
@@ -0,0 +1,271 @@
+#include <algorithm>
+#include <iostream>
+#include "ServerConnectionPool.h"
+
+namespace
+{
+    // same bound as the blocking waitFor* calls used elsewhere
+    const int   requestTimeout = 30000;
+}
+
+ServerConnectionPool::ServerConnectionPool(const std::string &host, short port, int size, int idleTimeout, QObject *parent)
+    : QObject(parent), host(QString::fromStdString(host)), port(port), size(std::max(size, 1)), idleTimeout(idleTimeout), nextId(0), idleTimer(this)
+{
+    QObject::connect(&this->idleTimer, &QTimer::timeout, this, [this]() { this->closeIdle(); });
+    this->idleTimer.setInterval(std::max(idleTimeout / 2, 100));
+}
+
+void    ServerConnectionPool::request(QObject *context, const QByteArray &message, Callback callback)
+{
+    // started lazily so it is started from the thread the pool lives in
+    if (this->idleTimeout > 0 && !this->idleTimer.isActive())
+    {
+        this->idleTimer.start();
+    }
+
+    quint64 id = ++this->nextId;
+
+    this->queue.push_back(Pending{ context, message, std::move(callback), false, id });
+    // no connection may ever free up for it, the wait in the queue is bounded too
+    QTimer::singleShot(requestTimeout, this, [this, id]() { this->expire(id); });
+    this->dispatch();
+}
+
+void    ServerConnectionPool::dispatch()
+{
+    while (!this->queue.empty())
+    {
+        if (this->queue.front().context.isNull())
+        {
+            this->queue.pop_front();
+            continue;
+        }
+
+        auto idle = std::find_if(this->upstreams.begin(), this->upstreams.end(), [](const Upstream &upstream) {
+            return !upstream.busy && upstream.socket->state() == QAbstractSocket::ConnectedState;
+        });
+
+        if (idle != this->upstreams.end())
+        {
+            Pending pending = std::move(this->queue.front());
+            this->queue.pop_front();
+            this->send(*idle, std::move(pending));
+            continue;
+        }
+
+        std::size_t connecting = std::count_if(this->upstreams.begin(), this->upstreams.end(), [](const Upstream &upstream) {
+            return !upstream.connected;
+        });
+
+        if (connecting < this->queue.size() && this->upstreams.size() < static_cast<std::size_t>(this->size))
+        {
+            this->open();
+            continue;
+        }
+        break;
+    }
+}
+
+void    ServerConnectionPool::open()
+{
+    QTcpSocket *socket = new QTcpSocket(this);
+
+    this->upstreams.push_back(Upstream{ socket, QElapsedTimer(), false, false, false, 0, Pending(), QByteArray() });
+
+    QObject::connect(socket, &QTcpSocket::connected, this, [this, socket]() {
+        auto it = this->find(socket);
+        if (it != this->upstreams.end())
+        {
+            it->connected = true;
+            it->idleSince.start();
+            socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+            socket->setSocketOption(QAbstractSocket::KeepAliveOption, 1);
+        }
+        this->dispatch();
+    });
+    QObject::connect(socket, &QTcpSocket::readyRead, this, [this, socket]() { this->receive(socket); });
+    QObject::connect(socket, &QTcpSocket::errorOccurred, this, [this, socket](QAbstractSocket::SocketError error) {
+        std::cerr << "Server connection error: " << socket->errorString().toStdString() << std::endl;
+        this->drop(socket, "UnableToReadServer", error == QAbstractSocket::RemoteHostClosedError);
+    });
+    QObject::connect(socket, &QTcpSocket::disconnected, this, [this, socket]() { this->drop(socket, "UnableToReadServer", true); });
+    QTimer::singleShot(requestTimeout, socket, [this, socket]() {
+        auto it = this->find(socket);
+        if (it != this->upstreams.end() && !it->connected)
+        {
+            std::cerr << "Server connection error: timed out while connecting" << std::endl;
+            this->drop(socket);
+        }
+    });
+
+    socket->connectToHost(this->host, this->port);
+}
+
+void    ServerConnectionPool::send(Upstream &upstream, Pending pending)
+{
+    QTcpSocket      *socket = upstream.socket;
+    unsigned int    sequence = ++upstream.sequence;
+
+    upstream.busy = true;
+    upstream.current = std::move(pending);
+    socket->write(upstream.current.message);
+
+    QTimer::singleShot(requestTimeout, socket, [this, socket, sequence]() {
+        auto it = this->find(socket);
+        if (it != this->upstreams.end() && it->busy && it->sequence == sequence)
+        {
+            std::cerr << "Server connection error: timed out while waiting for a reply" << std::endl;
+            // not sent again, the Server is too slow already
+            this->drop(socket, "ServerTimeout");
+        }
+    });
+}
+
+void    ServerConnectionPool::receive(QTcpSocket *socket)
+{
+    auto it = this->find(socket);
+    QByteArray data = socket->readAll();
+
+    // nothing is expected on an idle connection
+    if (it == this->upstreams.end() || !it->busy)
+    {
+        return;
+    }
+
+    Wire::Message   reply;
+    int             consumed = 0;
+
+    it->received.append(data);
+    Wire::Status status = Wire::parse(it->received, reply, consumed);
+
+    if (status == Wire::Status::Incomplete)
+    {
+        return;
+    }
+    if (status == Wire::Status::Invalid)
+    {
+        // the stream can not be trusted anymore
+        this->drop(socket, "ServerProtocolError");
+        return;
+    }
+
+    Pending pending = std::move(it->current);
+
+    it->received.clear();
+    it->busy = false;
+    it->reused = true;
+    it->idleSince.start();
+
+    if (!pending.context.isNull())
+    {
+        pending.callback(reply, nullptr);
+    }
+    this->dispatch();
+}
+
+void    ServerConnectionPool::drop(QTcpSocket *socket, const char *error, bool closedByPeer)
+{
+    auto it = this->find(socket);
+    if (it == this->upstreams.end())
+    {
+        return;
+    }
+
+    Upstream upstream = std::move(*it);
+    this->upstreams.erase(it);
+
+    socket->disconnect(this);
+    socket->abort();
+    socket->deleteLater();
+
+    if (upstream.busy)
+    {
+        Pending pending = std::move(upstream.current);
+
+        // the Server may have closed a reused connection while it was idle, before it saw the request:
+        // replay once on a fresh one. A request it started answering is never sent twice
+        if (closedByPeer && upstream.reused && !pending.retried && upstream.received.isEmpty())
+        {
+            quint64 id = pending.id;
+
+            pending.retried = true;
+            this->queue.push_front(std::move(pending));
+            QTimer::singleShot(requestTimeout, this, [this, id]() { this->expire(id); });
+        }
+        else if (!pending.context.isNull())
+        {
+            pending.callback(Wire::Message(), error);
+        }
+    }
+    else if (!upstream.connected && std::none_of(this->upstreams.begin(), this->upstreams.end(), [](const Upstream &other) { return other.connected; }))
+    {
+        // the Server cannot be reached, the other attempts would fail alike: do not keep the queued
+        // logins waiting, nor open new connections for them one after the other
+        this->failQueue("UnableToContactServer");
+    }
+
+    this->dispatch();
+}
+
+void    ServerConnectionPool::failQueue(const char *error)
+{
+    std::deque<Pending> failed;
+
+    // a callback may queue another request
+    failed.swap(this->queue);
+    for (Pending &pending : failed)
+    {
+        if (!pending.context.isNull())
+        {
+            pending.callback(Wire::Message(), error);
+        }
+    }
+}
+
+void    ServerConnectionPool::expire(quint64 id)
+{
+    auto it = std::find_if(this->queue.begin(), this->queue.end(), [id](const Pending &pending) {
+        return pending.id == id;
+    });
+
+    if (it == this->queue.end())
+    {
+        // sent, the reply timeout of its connection applies
+        return;
+    }
+
+    Pending pending = std::move(*it);
+    this->queue.erase(it);
+    std::cerr << "Server connection error: timed out while waiting for a connection" << std::endl;
+    if (!pending.context.isNull())
+    {
+        pending.callback(Wire::Message(), "UnableToContactServer");
+    }
+}
+
+void    ServerConnectionPool::closeIdle()
+{
+    for (auto it = this->upstreams.begin(); it != this->upstreams.end();)
+    {
+        if (!it->busy && it->connected && it->idleSince.hasExpired(this->idleTimeout))
+        {
+            QTcpSocket *socket = it->socket;
+
+            socket->disconnect(this);
+            socket->disconnectFromHost();
+            socket->deleteLater();
+            it = this->upstreams.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
+
+std::list<ServerConnectionPool::Upstream>::iterator ServerConnectionPool::find(QTcpSocket *socket)
+{
+    return std::find_if(this->upstreams.begin(), this->upstreams.end(), [socket](const Upstream &upstream) {
+        return upstream.socket == socket;
+    });
+}
@@ -1,11 +1,58 @@
 #include <iostream>
+#include <QCoreApplication>
+#include <QCommandLineParser>
 #include "Gateway.h"
+#include "MetricsServer.hpp"
 #include "QTimings.h"
+#include "Trace.hpp"
 
-int main()
+int main(int argc, char **argv)
 {
+    QCoreApplication app(argc, argv);
+    QCommandLineParser parser;
+    QCommandLineOption workersOption("workers", "Number of event loop threads serving smart readers (default: core count).", "count");
+    QCommandLineOption poolOption("server-connections", "Connections each worker keeps open to the Server (default: 4).", "count", "4");
+    QCommandLineOption batchOption("batch-size", "Logins forwarded to the Server in a single message, 1 disables batching (default: 1).", "count", "1");
+    QCommandLineOption windowOption("batch-window", "Microseconds a login waits for the rest of its batch (default: 200).", "us", "200");
+    QCommandLineOption metricsOption("metrics-port", "Serve Prometheus metrics at http://127.0.0.1:<port>/metrics (default: off).", "port");
+    QCommandLineOption registryOption("registry-capacity", "Smart readers the registry holds before it has to grow (default: 0, grows as they register).", "count", "0");
+    QCommandLineOption fileOption("registry-file", "Keep the registered smart readers and the registration to the Server in <path>, replayed at startup (default: memory only).", "path");
+    QCommandLineOption idleOption("server-idle-timeout", "Milliseconds before an unused Server connection is closed, 0 keeps them (default: 30000).", "ms", "30000");
+
+    parser.addHelpOption();
+    parser.addOption(workersOption);
+    parser.addOption(poolOption);
+    parser.addOption(idleOption);
+    parser.addOption(batchOption);
+    parser.addOption(windowOption);
+    parser.addOption(metricsOption);
+    parser.addOption(registryOption);
+    parser.addOption(fileOption);
+    parser.process(app);
+
+    Trace::setProcess("gateway");
+
     Gateway nan("127.0.0.1", 3874, 4542);
 
+    if (parser.isSet(workersOption))
+    {
+        nan.setWorkerCount(parser.value(workersOption).toInt());
+    }
+    nan.setServerPool(parser.value(poolOption).toInt(), parser.value(idleOption).toInt());
+    nan.setLoginBatching(parser.value(batchOption).toInt(), parser.value(windowOption).toInt());
+    nan.setRegistryCapacity(parser.value(registryOption).toULongLong());
+    if (parser.isSet(fileOption) && !nan.openRegistryFile(parser.value(fileOption).toStdString()))
+    {
+        return 1;
+    }
+
+    MetricsServer metrics;
+
+    if (parser.isSet(metricsOption) && !metrics.start(parser.value(metricsOption).toUShort()))
+    {
+        return 1;
+    }
+
     QTimings::getShared().start("registration");
 
     if (!nan.registerToServer())
@@ -1,6 +1,10 @@
-#include <QTcpSocket>
-#include <unordered_map>
+#include <QByteArray>
+#include <memory>
+#include <vector>
 #include "CommonUtils.hpp"
+#include "DeviceRegistry.hpp"
+#include "RegistryFile.hpp"
+#include "WireFormat.hpp"
 
 #pragma once
 
@@ -10,11 +14,27 @@ class Server : public CommonUtils
 {
     public:
         Server(const short port);
-        ~Server() = default;
-
-        void    receiveNANGRegister(QTcpSocket *socket, const std::string &nid, const std::string &auth);
-        void    receiveNANGLogin(QTcpSocket *socket, const std::string &cid, const std::string &smTime,
-                                 const std::string &c2, const std::string &rid, const std::string &cN, const std::string &nangTime);
+        ~Server();
+
+        // handlers are transport agnostic: they take the peer IPv4 address and return the reply
+        // consumes every complete message of buffer and returns their replies, empty while incomplete.
+        // close is set after a message that can not be parsed: the bytes that follow can not be told
+        // apart, the connection is closed once the replies are sent
+        QByteArray  receiveMessage(quint32 peer, QByteArray &buffer, bool &close);
+        QByteArray  receiveRequest(quint32 peer, const Wire::Message &message);
+        QByteArray  receiveNANGRegister(quint32 peer, Wire::Format format, const std::string &nid, const Digest &auth);
+        // each login holds the fields cid, smTime, c2, rid, cN and nangTime, the replies are in the same order.
+        // The logins go through the protocol step by step together so that their hashes share the SIMD lanes
+        std::vector<QByteArray> receiveNANGLogins(quint32 peer, Wire::Format format, const std::vector<const std::vector<std::string> *> &logins);
+        // every field is a binary login, answered in a field of the reply at the same index
+        QByteArray  receiveNANGLoginBatch(quint32 peer, const Wire::Message &message);
+
+        // number of io_uring rings serving connections, 0 keeps the QTcpServer loop
+        void    setUringRings(int rings);
+        // Gateways the registry holds without growing
+        void    setRegistryCapacity(std::size_t count);
+        // replays the Gateways recorded in path, then records every registration there
+        bool    openRegistryFile(const std::string &path);
 
         bool    runServer();
 
@@ -22,11 +42,17 @@ class Server : public CommonUtils
         std::string getMyId() const override;
 
     private:
+        bool    runUringServer();
+
         short       port;
+        int         uringRings;
 
         std::string myRandom;
         std::string verifier;
 
-        std::unordered_map<unsigned int, std::string>   hashNames;
+        // hN of each Gateway, keyed by its nid and bound to the address it registered from
+        DeviceRegistry  registry;
+        // null without --registry-file
+        std::unique_ptr<RegistryFile>   registryFile;
 };
 
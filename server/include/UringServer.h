@@ -0,0 +1,33 @@
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#pragma once
+
+class Server;
+
+// Linux io_uring network backend: every ring runs in its own thread with its own
+// SO_REUSEPORT listening socket and serves accept, recv and send for its connections
+// out of registered buffers, handing complete requests to Server::receiveMessage
+class UringServer
+{
+    public:
+        UringServer(Server &server, short port, int rings, unsigned int connectionsPerRing = 1024);
+        ~UringServer();
+
+        bool    start();
+        void    stop();
+
+    private:
+        class Ring;
+
+        Server          &server;
+        short           port;
+        int             ringCount;
+        unsigned int    connectionsPerRing;
+
+        std::atomic<bool>                   running;
+        std::vector<std::unique_ptr<Ring>>  rings;
+        std::vector<std::thread>            threads;
+};
@@ -1,15 +1,36 @@
 #include <string>
-#include <sstream>
 #include <iostream>
 #include <future>
+#include <algorithm>
+#include <memory>
 #include <QTcpSocket>
 #include <QByteArray>
 #include <QTcpServer>
+#include <QTimer>
+#include <QCoreApplication>
 #include "Server.h"
+#include "Metrics.hpp"
+#include "MultiHasher.hpp"
 #include "QTimings.h"
+#ifdef SCAE_WITH_IO_URING
+#include "UringServer.h"
+#endif
+
+Server::Server(short port) : CommonUtils(16, 80), port(port), uringRings(0)
+{
+    Metrics::sampled("scae_registry_size", "Gateways registered to the Server.", [this]() {
+        return static_cast<double>(this->registry.size());
+    });
+    Metrics::sampled("scae_registry_bytes", "Memory held by the registry of the Server.", [this]() {
+        return static_cast<double>(this->registry.memory());
+    });
+}
 
-Server::Server(short port) : CommonUtils(16, 80), port(port)
-{}
+Server::~Server()
+{
+    Metrics::removeSampled("scae_registry_size");
+    Metrics::removeSampled("scae_registry_bytes");
+}
 
 std::string Server::getMyId() const
 {
@@ -23,8 +44,34 @@ static  std::string readInput()
     return answer;
 }
 
+void    Server::setUringRings(int rings)
+{
+    this->uringRings = std::max(rings, 0);
+}
+
+void    Server::setRegistryCapacity(std::size_t count)
+{
+    this->registry.reserve(count);
+}
+
+bool    Server::openRegistryFile(const std::string &path)
+{
+    this->registryFile.reset(new RegistryFile(this->registry));
+    if (!this->registryFile->open(QString::fromStdString(path)))
+    {
+        this->registryFile.reset();
+        return false;
+    }
+    return true;
+}
+
 bool    Server::runServer()
 {
+    if (this->uringRings > 0)
+    {
+        return this->runUringServer();
+    }
+
     QTcpServer  server;
 
     if (!server.listen(QHostAddress::Any, this->port))
@@ -33,12 +80,59 @@ bool    Server::runServer()
         return false;
     }
 
+    // connections stay open and may carry any number of requests, one after the other
+    QObject::connect(&server, &QTcpServer::newConnection, [this, &server]() {
+        while (QTcpSocket *connection = server.nextPendingConnection())
+        {
+#ifdef PRINT_DEBUG
+            std::cout << "A new connection appeared" << std::endl;
+#endif
+            std::shared_ptr<QByteArray> buffer = std::make_shared<QByteArray>();
+
+            QObject::connect(connection, &QTcpSocket::readyRead, [this, connection, buffer]() {
+                QTimings::getShared().start("request");
+#ifdef PRINT_DEBUG
+                std::cout << "Reading data:" << std::endl;
+#endif
+                bool        close = false;
+
+                buffer->append(connection->readAll());
+                QByteArray replies = this->receiveMessage(connection->peerAddress().toIPv4Address(), *buffer, close);
+                QTimings::getShared().stop("request");
+
+                if (close)
+                {
+                    // sends the replies first
+                    connection->write(replies);
+                    connection->disconnectFromHost();
+                    QTimings::getShared().reset();
+                    return;
+                }
+
+                if (replies.isEmpty())
+                {
+                    QTimings::getShared().reset();
+                    return;
+                }
+                connection->write(replies);
+                connection->flush();
+
+                std::cout << QTimings::getShared().getPPTimings() << std::endl;
+                QTimings::getShared().reset();
+            });
+            QObject::connect(connection, &QTcpSocket::disconnected, [connection]() { connection->deleteLater(); });
+        }
+    });
+
     std::string prevInput;
     std::cin >> prevInput;
 
     std::future<std::string> *consoleInput = new std::future<std::string>(std::async(readInput));
     std::atomic<bool> serverIsOn(true);
-    bool timeOutCheck = false;
+
+    // bounds the event wait below so the console keeps being polled
+    QTimer  wakeUp;
+    wakeUp.start(100);
 
     while (serverIsOn && server.isListening())
     {
@@ -53,266 +147,389 @@ bool    Server::runServer()
             }
             else
             {
+                if (prevInput.compare("timings") == 0)
+                {
+                    std::cout << QTimings::getPPDistributions() << std::endl;
+                }
                 consoleInput = new std::future<std::string>(std::async(readInput));
             }
         }
 
-        if (!server.waitForNewConnection(100, &timeOutCheck))
+        QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents);
+    }
+
+    return true;
+}
+
+bool    Server::runUringServer()
+{
+#ifdef SCAE_WITH_IO_URING
+    UringServer server(*this, this->port, this->uringRings);
+
+    if (!server.start())
+    {
+        std::cerr << "Could not start io_uring Server" << std::endl;
+        return false;
+    }
+    std::cout << "Server listening with " << this->uringRings << " io_uring rings" << std::endl;
+
+    std::string prevInput;
+    std::cin >> prevInput;
+
+    std::future<std::string> consoleInput = std::async(readInput);
+
+    // the rings run in their own threads, this one only waits for the console
+    while (true)
+    {
+        if (consoleInput.wait_for(std::chrono::milliseconds(100)) == std::future_status::ready)
         {
-            if (!timeOutCheck)
+            prevInput = consoleInput.get();
+            if (prevInput.compare("stop") == 0 || prevInput.compare("end") == 0)
             {
-                serverIsOn = false;
+                break;
             }
-            continue;
+            if (prevInput.compare("timings") == 0)
+            {
+                std::cout << QTimings::getPPDistributions() << std::endl;
+            }
+            consoleInput = std::async(readInput);
         }
+    }
 
+    server.stop();
+    return true;
+#else
+    std::cerr << "This Server was built without io_uring support (SCAE_IO_URING)" << std::endl;
+    return false;
+#endif
+}
+
+QByteArray  Server::receiveMessage(quint32 peer, QByteArray &buffer, bool &close)
+{
 #ifdef PRINT_DEBUG
-        std::cout << "A new connection appeared" << std::endl;
+    std::cout << "     '" << buffer.toStdString() << "'" << std::endl;
 #endif
+    QByteArray      replies;
+    Wire::Message   message;
+    int             consumed = 0;
 
-        QTimings::getShared().start("connection");
+    while (!buffer.isEmpty())
+    {
+        Wire::Status status = Wire::parse(buffer, message, consumed);
 
-        QTcpSocket  *connection = server.nextPendingConnection();
-        if (connection == nullptr)
+        if (status == Wire::Status::Incomplete)
         {
-            continue;
+            break;
         }
-
-        if (!connection->waitForReadyRead())
+        if (status == Wire::Status::Invalid)
         {
-            connection->close();
-            continue;
+            // also what an unsupported binary version gets, so the peer falls back to the legacy format
+            // on a new connection
+            buffer.clear();
+            replies.append(Wire::error(Wire::Format::Legacy, "WrongProtocol"));
+            close = true;
+            break;
         }
 
+        buffer.remove(0, consumed);
+        replies.append(this->receiveRequest(peer, message));
+    }
+    return replies;
+}
 
-#ifdef PRINT_DEBUG
-        std::cout << "Reading data:" << std::endl;
-#endif
-        QByteArray  message = connection->readAll();
-        char type = message.front();
-#ifdef PRINT_DEBUG
-        std::cout << "     '" << message.toStdString() << "'" << std::endl;
-#endif
+QByteArray  Server::receiveRequest(quint32 peer, const Wire::Message &message)
+{
+    static std::atomic<int64_t>     &inFlight = Metrics::gauge("scae_requests_in_flight", "Requests being processed.");
+    static std::atomic<uint64_t>    &registers = Metrics::counter("scae_requests_total", "Requests received, by type.", Metrics::label("type", "register"));
+    static std::atomic<uint64_t>    &batches = Metrics::counter("scae_requests_total", "Requests received, by type.", Metrics::label("type", "login-batch"));
+    static std::atomic<uint64_t>    &unknown = Metrics::counter("scae_requests_total", "Requests received, by type.", Metrics::label("type", "unknown"));
+    Metrics::InFlight               current(inFlight);
 
-        QList<QByteArray> splitted;
+    const std::vector<std::string> &fields = message.fields;
+    QByteArray  output;
+    Digest      auth;
 
-        if (type >= '0' && type <= '9')
+    switch (message.type)
+    {
+        case '1':
+            ++registers;
+            if (fields.size() != 2)
+            {
+                return Wire::error(message.format, "InvalidNumberOfArguments");
+            }
+            if (!Wire::readDigest(message.format, fields[1], auth))
+            {
+                return Wire::error(message.format, "InvalidDigest");
+            }
+            QTimings::getShared().start("register");
+            output = this->receiveNANGRegister(peer, message.format, fields[0], auth);
+            QTimings::getShared().stop("register");
+            return output;
+
+        case '2':
         {
-            message.remove(0, 1);
-            splitted = message.split(':');
+            if (fields.size() != 6 && fields.size() != 7)
+            {
+                return Wire::error(message.format, "InvalidNumberOfArguments");
+            }
+            // the optional seventh field is the trace id
+            QTimings::TraceScope    trace(QTimings::getShared(), { fields.size() == 7 ? fields[6] : std::string() });
+
+            QTimings::getShared().start("login");
+            output = this->receiveNANGLogins(peer, message.format, { &fields }).front();
+            QTimings::getShared().stop("login");
+            return output;
         }
 
-        switch (type)
-        {
-            case '1':
-                QTimings::getShared().start("register");
-                if (splitted.size() != 2)
-                {
-                    connection->write("InvalidNumberOfArguments");
-                    break;
-                }
-                this->receiveNANGRegister(connection, QByteArray::fromBase64(splitted[0]).toStdString(), QByteArray::fromBase64(splitted[1]).toStdString());
-                QTimings::getShared().stop("register");
-                std::cout << QTimings::getShared().getPPTimings() << std::endl;
-                QTimings::getShared().reset();
-                break;
+        case Wire::batchType:
+            ++batches;
+            return this->receiveNANGLoginBatch(peer, message);
 
-            case '2':
-                QTimings::getShared().start("login");
-                if (splitted.size() != 6)
-                {
-                    connection->write("InvalidNumberOfArguments");
-                    break;
-                }
-                this->receiveNANGLogin(connection, QByteArray::fromBase64(splitted[0]).toStdString(), QByteArray::fromBase64(splitted[1]).toStdString(),
-                        QByteArray::fromBase64(splitted[2]).toStdString(), QByteArray::fromBase64(splitted[3]).toStdString(),
-                        QByteArray::fromBase64(splitted[4]).toStdString(), QByteArray::fromBase64(splitted[5]).toStdString());
-                QTimings::getShared().stop("login");
-                std::cout << QTimings::getShared().getPPTimings() << std::endl;
-                QTimings::getShared().reset();
-                break;
+        default:
+            ++unknown;
+            return Wire::error(message.format, "WrongProtocol");
+    }
+}
 
-            default:
-                connection->write("WrongProtocol");
-                break;
+QByteArray  Server::receiveNANGLoginBatch(quint32 peer, const Wire::Message &message)
+{
+    if (message.format != Wire::Format::Binary)
+    {
+        return Wire::error(message.format, "WrongProtocol");
+    }
+
+    std::size_t                                     count = message.fields.size();
+    std::vector<Wire::Message>                      logins(count);
+    std::vector<QByteArray>                         replies(count);
+    std::vector<const std::vector<std::string> *>   valid;
+    std::vector<std::size_t>                        positions;
+    std::vector<std::string>                        traces;
+    int                                             consumed = 0;
+
+    QTimings::getShared().start("login-batch");
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        QByteArray raw = QByteArray::fromRawData(message.fields[i].data(), static_cast<int>(message.fields[i].size()));
+
+        if (Wire::parse(raw, logins[i], consumed) != Wire::Status::Complete || logins[i].type != '2')
+        {
+            replies[i] = Wire::error(Wire::Format::Binary, "WrongProtocol");
+        }
+        else if (logins[i].fields.size() != 6 && logins[i].fields.size() != 7)
+        {
+            replies[i] = Wire::error(Wire::Format::Binary, "InvalidNumberOfArguments");
         }
+        else
+        {
+            valid.push_back(&logins[i].fields);
+            positions.push_back(i);
+            if (logins[i].fields.size() == 7)
+            {
+                traces.push_back(logins[i].fields[6]);
+            }
+        }
+    }
 
-        connection->flush();
-        connection->close();
-        connection = nullptr;
+    // the logins of the batch share their steps, every step belongs to each of their traces
+    QTimings::TraceScope    trace(QTimings::getShared(), traces);
 
-        QTimings::getShared().stop("connection");
+    // the logins of the batch go through the protocol together
+    std::vector<QByteArray> answers = this->receiveNANGLogins(peer, Wire::Format::Binary, valid);
+    for (std::size_t k = 0; k < positions.size(); ++k)
+    {
+        replies[positions[k]] = std::move(answers[k]);
     }
 
-    return true;
+    Wire::Writer output(Wire::Format::Binary, Wire::batchType);
+    for (const QByteArray &reply : replies)
+    {
+        output.add(reply.constData(), reply.size());
+    }
+    QTimings::getShared().stop("login-batch");
+
+    QByteArray  data = output.data();
+
+    // the Gateway answers each of its logins with ServerProtocolError then
+    return data.isEmpty() ? Wire::error(Wire::Format::Binary, "ServerError") : data;
 }
 
-void    Server::receiveNANGRegister(QTcpSocket *socket, const std::string &nid, const std::string &auth)
+QByteArray  Server::receiveNANGRegister(quint32 peer, Wire::Format format, const std::string &nid, const Digest &auth)
 {
 #ifdef PRINT_DEBUG
     std::cout << "[REGISTER] nang.nid == '" << nid << "' (" << QByteArray::fromStdString(nid).toHex().toStdString() << ")" << std::endl;
-    std::cout << "[REGISTER] nang.auth == '" << auth << "' (" << QByteArray::fromStdString(auth).toHex().toStdString() << ")" << std::endl;
+    std::cout << "[REGISTER] nang.auth == '" << auth.hex() << "'" << std::endl;
 #endif
-    std::ostringstream oss;
 
     std::string e = this->newRandom();
 
-    oss << this->getMyId() << e;
-
-    std::string mI = this->hash(oss.str(), "hash-mI");
+    Digest mI = (Hasher("hash-mI") << this->getMyId() << e).finalize();
 #ifdef PRINT_DEBUG
-    std::cout << "[REGISTER] mI == '" << mI << "' (" << QByteArray::fromStdString(mI).toHex().toStdString() << ")" << std::endl;
+    std::cout << "[REGISTER] mI == '" << mI.hex() << "'" << std::endl;
 #endif
 
-    oss.str("");
-    oss.clear();
-
-    oss << mI << auth;
-
-    std::string vN = this->scalarMul(this->hash(oss.str(), "hash-vN"), 126, "scalar-vN");
+    // the curve multiplies the hexadecimal text of the digest
+    std::string vN = this->scalarMul((Hasher("hash-vN") << mI << auth).finalize().hex(), 126, "scalar-vN");
 #ifdef PRINT_DEBUG
     std::cout << "[REGISTER] vN == '" << vN << "' (" << QByteArray::fromStdString(vN).toHex().toStdString() << ")" << std::endl;
 #endif
 
-    oss.str("");
-    oss.clear();
-
-    oss << vN << nid;
-
-    std::string hN = this->hash(oss.str(), "hash-hN");
+    Digest hN = (Hasher("hash-hN") << vN << nid).finalize();
 #ifdef PRINT_DEBUG
-    QByteArray copy = QByteArray::fromStdString(hN).replace("\r", "\\r");
-    std::cout << "[REGISTER] hN == '" << copy.toStdString() << "' (" << QByteArray::fromStdString(hN).toHex().toStdString() << ")" << std::endl;
+    std::cout << "[REGISTER] hN == '" << hN.hex() << "'" << std::endl;
 #endif
 
-    quint32 ip = socket->peerAddress().toIPv4Address();
-
-    this->hashNames.emplace(ip, hN);
+    if (!this->registry.insert(nid, hN, peer))
+    {
+        return Wire::error(format, "InvalidDeviceId");
+    }
+    if (this->registryFile)
+    {
+        this->registryFile->append(nid, hN, peer);
+    }
 
-    socket->write("1");
-    socket->write(QByteArray::fromStdString(vN).toBase64());
+    return Wire::Writer(format, '1').add(vN).data();
 }
 
-void    Server::receiveNANGLogin(QTcpSocket *socket, const std::string &cid, const std::string &smTime,
-                                 const std::string &c2, const std::string &rid, const std::string &cN, const std::string &nangTime)
+std::vector<QByteArray>     Server::receiveNANGLogins(quint32 peer, Wire::Format format, const std::vector<const std::vector<std::string> *> &logins)
 {
-#ifdef PRINT_DEBUG
-    std::cout << "[LOGIN] client.CID == '" << cid << "' (" << QByteArray::fromStdString(cid).toHex().toStdString() << ")" << std::endl;
-    std::cout << "[LOGIN] client.time == '" << smTime << "' (" << QByteArray::fromStdString(smTime).toHex().toStdString() << ")" << std::endl;
-    std::cout << "[LOGIN] client.C2   == '" << c2 << "' (" << QByteArray::fromStdString(c2).toHex().toStdString() << ")" << std::endl;
-    std::cout << "[LOGIN] client.RID   == '" << rid << "' (" << QByteArray::fromStdString(rid).toHex().toStdString() << ")" << std::endl;
-    QByteArray copycN = QByteArray::fromStdString(cN).replace("\r", "\\r");
-    std::cout << "[LOGIN] client.Cn   == '" << copycN.toStdString() << "' (" << QByteArray::fromStdString(cN).toHex().toStdString() << ")" << std::endl;
-    std::cout << "[LOGIN] gateway.time   == '" << nangTime << "' (" << QByteArray::fromStdString(nangTime).toHex().toStdString() << ")" << std::endl;
-#endif
-    std::string localTime = "TIME";
+    static std::atomic<uint64_t>    &requests = Metrics::counter("scae_requests_total", "Requests received, by type.", Metrics::label("type", "login"));
 
-    std::string hN;
-    try
-    {
-        hN = this->hashNames.at(socket->peerAddress().toIPv4Address());
-    }
-    catch (const std::out_of_range &e)
+    std::size_t             count = logins.size();
+    std::vector<QByteArray> replies(count);
+    std::string             localTime = "TIME";
+
+    requests += count;
+
+    // the logins of a Gateway do not carry its nid, the address it registered from stands for it
+    Digest hN = this->registry.findByAddress(peer);
+    if (hN.empty())
     {
-        socket->write("IpAddressNotRegistered");
-        return;
+        std::fill(replies.begin(), replies.end(), Wire::error(format, "IpAddressNotRegistered"));
+        return replies;
     }
 #ifdef PRINT_DEBUG
-    QByteArray copy = QByteArray::fromStdString(hN).replace("\r", "\\r");
-    std::cout << "[LOGIN] hN == '" << copy.toStdString() << "' (" << QByteArray::fromStdString(hN).toHex().toStdString() << ")" << std::endl;
+    std::cout << "[LOGIN] hN == '" << hN.hex() << "'" << std::endl;
 #endif
 
     //TODO: check delta time
 
-    std::string wP = this->applyXOr(cN, hN, "xor-wP");
+    // each step runs for every login before the next one, so that their hashes are computed together
+    std::vector<std::string>    wP(count), bi(count), bj(count), yP(count);
+    std::vector<std::size_t>    accepted;
+    std::vector<Digest>         digests;
+    MultiHasher                 hashBiBj("hash-bi-bj");
+
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        const std::string &smTime = (*logins[i])[1];
+        const std::string &cN = (*logins[i])[4];
 #ifdef PRINT_DEBUG
-    std::cout << "[LOGIN] wP == '" << wP << "' (" << QByteArray::fromStdString(wP).toHex().toStdString() << ")" << std::endl;
+        const std::vector<std::string> &fields = *logins[i];
+        std::cout << "[LOGIN] client.CID == '" << fields[0] << "' (" << QByteArray::fromStdString(fields[0]).toHex().toStdString() << ")" << std::endl;
+        std::cout << "[LOGIN] client.time == '" << smTime << "' (" << QByteArray::fromStdString(smTime).toHex().toStdString() << ")" << std::endl;
+        std::cout << "[LOGIN] client.C2   == '" << fields[2] << "' (" << QByteArray::fromStdString(fields[2]).toHex().toStdString() << ")" << std::endl;
+        std::cout << "[LOGIN] client.RID   == '" << fields[3] << "' (" << QByteArray::fromStdString(fields[3]).toHex().toStdString() << ")" << std::endl;
+        QByteArray copycN = QByteArray::fromStdString(cN).replace("\r", "\\r");
+        std::cout << "[LOGIN] client.Cn   == '" << copycN.toStdString() << "' (" << QByteArray::fromStdString(cN).toHex().toStdString() << ")" << std::endl;
+        std::cout << "[LOGIN] gateway.time   == '" << fields[5] << "' (" << QByteArray::fromStdString(fields[5]).toHex().toStdString() << ")" << std::endl;
 #endif
 
-    std::ostringstream tmp;
-    tmp << wP << smTime;
-
-    std::string bi = this->applyXOr(this->hash(tmp.str(), "hash-bi"), cid, "xor-bi");
+        wP[i] = this->applyXOr(cN, hN, "xor-wP");
 #ifdef PRINT_DEBUG
-    std::cout << "[LOGIN] bi == '" << bi << "' (" << QByteArray::fromStdString(bi).toHex().toStdString() << ")" << std::endl;
+        std::cout << "[LOGIN] wP == '" << wP[i] << "' (" << QByteArray::fromStdString(wP[i]).toHex().toStdString() << ")" << std::endl;
 #endif
 
-    tmp.str("");
-    tmp.clear();
+        hashBiBj.add() << wP[i] << smTime;
+        hashBiBj.add() << cN << hN;
+    }
+    digests = hashBiBj.finalize();
 
-    tmp << cN << hN;
+    MultiHasher hashC1("hash-c1'");
 
-    std::string bj = this->applyXOr(this->hash(tmp.str(), "hash-bj"), rid, "xor-bj");
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        const std::string &cid = (*logins[i])[0];
+        const std::string &rid = (*logins[i])[3];
+
+        bi[i] = this->applyXOr(digests[2 * i], cid, "xor-bi");
 #ifdef PRINT_DEBUG
-    std::cout << "[LOGIN] bj == '" << bj << "' (" << QByteArray::fromStdString(bj).toHex().toStdString() << ")" << std::endl;
+        std::cout << "[LOGIN] bi == '" << bi[i] << "' (" << QByteArray::fromStdString(bi[i]).toHex().toStdString() << ")" << std::endl;
 #endif
 
-    tmp.str("");
-    tmp.clear();
-
-    tmp << cid << bi << wP;
-
-    std::string c1_bis = this->hash(tmp.str(), "hash-c1'");
+        bj[i] = this->applyXOr(digests[2 * i + 1], rid, "xor-bj");
 #ifdef PRINT_DEBUG
-    std::cout << "[LOGIN] C1' == '" << c1_bis << "' (" << QByteArray::fromStdString(c1_bis).toHex().toStdString() << ")" << std::endl;
+        std::cout << "[LOGIN] bj == '" << bj[i] << "' (" << QByteArray::fromStdString(bj[i]).toHex().toStdString() << ")" << std::endl;
 #endif
 
-    tmp.str("");
-    tmp.clear();
+        hashC1.add() << cid << bi[i] << wP[i];
+    }
+    digests = hashC1.finalize();
 
-    tmp << c1_bis << nangTime << cN << bj;
+    MultiHasher hashC2("hash-c2'");
 
-    std::string c2_bis = this->hash(tmp.str(), "hash-c2'");
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        const std::string &cN = (*logins[i])[4];
+        const std::string &nangTime = (*logins[i])[5];
 #ifdef PRINT_DEBUG
-    std::cout << "[LOGIN] C2' == '" << c2_bis << "' (" << QByteArray::fromStdString(c2_bis).toHex().toStdString() << ")" << std::endl;
+        std::cout << "[LOGIN] C1' == '" << digests[i].hex() << "'" << std::endl;
 #endif
 
-    if (c2_bis.compare(c2) != 0)
-    {
-        socket->write("WrongID");
-        return;
+        hashC2.add() << digests[i] << nangTime << cN << bj[i];
     }
+    digests = hashC2.finalize();
 
-    std::string y = this->newRandom();
+    MultiHasher hashSKs("hash-SKs");
 
-    std::string yP = this->scalarMul(y, 256, "scalar-yP");
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        Digest  c2;
 #ifdef PRINT_DEBUG
-    std::cout << "[LOGIN] yP == '" << yP << "' (" << QByteArray::fromStdString(yP).toHex().toStdString() << ")" << std::endl;
+        std::cout << "[LOGIN] C2' == '" << digests[i].hex() << "'" << std::endl;
 #endif
 
-    std::string cS = this->applyXOr(yP, /*this->hash(*/hN/*, "hash-cS")*/, "xor-cS");
+        if (!Wire::readDigest(format, (*logins[i])[2], c2) || digests[i] != c2)
+        {
+            replies[i] = Wire::error(format, "WrongID");
+            continue;
+        }
+
+        std::string y = this->newRandom();
+
+        yP[i] = this->scalarMul(y, 256, "scalar-yP");
 #ifdef PRINT_DEBUG
-    std::cout << "[LOGIN] cS == '" << cS << "' (" << QByteArray::fromStdString(cS).toHex().toStdString() << ")" << std::endl;
+        std::cout << "[LOGIN] yP == '" << yP[i] << "' (" << QByteArray::fromStdString(yP[i]).toHex().toStdString() << ")" << std::endl;
 #endif
 
-    tmp.str("");
-    tmp.clear();
+        accepted.push_back(i);
+        hashSKs.add() << yP[i] << wP[i] << bi[i] << bj[i];
+    }
+    digests = hashSKs.finalize();
 
-    tmp << yP << wP << bi << bj;
+    MultiHasher hashC3("hash-c3");
 
-    std::string SKs = this->hash(tmp.str(), "hash-SKs");
+    for (std::size_t k = 0; k < accepted.size(); ++k)
+    {
 #ifdef PRINT_DEBUG
-    std::cout << "[LOGIN] SKs == '" << SKs << "' (" << QByteArray::fromStdString(SKs).toHex().toStdString() << ")" << std::endl;
+        std::cout << "[LOGIN] SKs == '" << digests[k].hex() << "'" << std::endl;
 #endif
 
-    tmp.str("");
-    tmp.clear();
+        hashC3.add() << digests[k] << localTime << yP[accepted[k]];
+    }
+    digests = hashC3.finalize();
 
-    tmp << SKs << localTime << yP;
+    for (std::size_t k = 0; k < accepted.size(); ++k)
+    {
+        std::size_t i = accepted[k];
 
-    std::string c3 = this->hash(tmp.str(), "hash-c3");
+        std::string cS = this->applyXOr(yP[i], /*this->hash(*/hN/*, "hash-cS")*/, "xor-cS");
 #ifdef PRINT_DEBUG
-    std::cout << "[LOGIN] C3 == '" << c3 << "' (" << QByteArray::fromStdString(c3).toHex().toStdString() << ")" << std::endl;
+        std::cout << "[LOGIN] cS == '" << cS << "' (" << QByteArray::fromStdString(cS).toHex().toStdString() << ")" << std::endl;
+        std::cout << "[LOGIN] C3 == '" << digests[k].hex() << "'" << std::endl;
 #endif
 
-    QByteArray  output;
-
-    output.append('2');
-    output.append(QByteArray::fromStdString(c3).toBase64());
-    output.append(':');
-    output.append(QByteArray::fromStdString(cS).toBase64());
-    output.append(':');
-    output.append(QByteArray::fromStdString(localTime).toBase64());
+        replies[i] = Wire::Writer(format, '2').add(digests[k]).add(cS).add(localTime).data();
+    }
 
-    socket->write(output);
+    return replies;
 }
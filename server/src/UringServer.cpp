@@ -0,0 +1,423 @@
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <liburing.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <QByteArray>
+#include "UringServer.h"
+#include "Server.h"
+#include "QTimings.h"
+
+namespace
+{
+    const unsigned int  bufferSize = 4096;
+
+    enum Operation : __u64
+    {
+        Accept = 0,
+        Read = 1,
+        Write = 2,
+        Close = 3
+    };
+
+    // user_data of every submission: the operation in the low bits, the connection slot above
+    __u64   tag(Operation operation, unsigned int slot = 0)
+    {
+        return (static_cast<__u64>(slot) << 2) | operation;
+    }
+}
+
+class UringServer::Ring
+{
+    public:
+        Ring(Server &server, unsigned int slots);
+        ~Ring();
+
+        bool    open(short port);
+        void    run(const std::atomic<bool> &running);
+
+    private:
+        struct Connection
+        {
+            int         fd = -1;
+            quint32     peer = 0;
+            QByteArray  received;
+            QByteArray  reply;
+            unsigned    sent = 0;
+            bool        closing = false;    // once the reply is sent, see Server::receiveMessage
+            QTimings    timings;
+        };
+
+        io_uring_sqe    *nextSqe();
+        char            *buffer(unsigned int slot) { return this->slab.get() + static_cast<std::size_t>(slot) * bufferSize; }
+
+        void    submitAccept();
+        void    submitRead(unsigned int slot);
+        void    submitWrite(unsigned int slot);
+        void    submitClose(unsigned int slot);
+
+        void    onAccept(int result);
+        void    onRead(unsigned int slot, int result);
+        void    onWrite(unsigned int slot, int result);
+        void    onClose(unsigned int slot);
+
+        Server                      &server;
+        io_uring                    ring;
+        bool                        ringReady = false;
+        bool                        fixedBuffers = false;
+        int                         listenFd = -1;
+
+        std::unique_ptr<char[]>     slab;
+        std::vector<Connection>     connections;
+        std::vector<unsigned int>   freeSlots;
+
+        bool                        acceptPending = false;
+        sockaddr_in                 acceptAddress;
+        socklen_t                   acceptLength = sizeof(sockaddr_in);
+};
+
+UringServer::Ring::Ring(Server &server, unsigned int slots) : server(server), slab(new char[static_cast<std::size_t>(slots) * bufferSize]), connections(slots)
+{
+    for (unsigned int i = slots; i > 0; --i)
+    {
+        this->freeSlots.push_back(i - 1);
+    }
+}
+
+UringServer::Ring::~Ring()
+{
+    for (Connection &connection : this->connections)
+    {
+        if (connection.fd >= 0)
+        {
+            ::close(connection.fd);
+        }
+    }
+    if (this->listenFd >= 0)
+    {
+        ::close(this->listenFd);
+    }
+    if (this->ringReady)
+    {
+        io_uring_queue_exit(&this->ring);
+    }
+}
+
+bool    UringServer::Ring::open(short port)
+{
+    this->listenFd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (this->listenFd < 0)
+    {
+        std::cerr << "Could not create socket: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+
+    // every ring listens on the same port, the kernel spreads the connections between them
+    int enable = 1;
+    ::setsockopt(this->listenFd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+    ::setsockopt(this->listenFd, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable));
+
+    sockaddr_in address;
+    std::memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(static_cast<uint16_t>(port));
+
+    if (::bind(this->listenFd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0 || ::listen(this->listenFd, SOMAXCONN) < 0)
+    {
+        std::cerr << "Could not listen on port " << port << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+
+    int error = io_uring_queue_init(this->connections.size() * 2 + 2, &this->ring, 0);
+    if (error < 0)
+    {
+        std::cerr << "Could not create io_uring: " << std::strerror(-error) << std::endl;
+        return false;
+    }
+    this->ringReady = true;
+
+    std::vector<iovec> iovecs(this->connections.size());
+    for (unsigned int i = 0; i < iovecs.size(); ++i)
+    {
+        iovecs[i].iov_base = this->buffer(i);
+        iovecs[i].iov_len = bufferSize;
+    }
+
+    // registration can be refused (RLIMIT_MEMLOCK, old kernels), plain recv and send still work
+    error = io_uring_register_buffers(&this->ring, iovecs.data(), iovecs.size());
+    this->fixedBuffers = (error == 0);
+    if (!this->fixedBuffers)
+    {
+        std::cerr << "Could not register io_uring buffers, falling back to recv/send: " << std::strerror(-error) << std::endl;
+    }
+
+    return true;
+}
+
+void    UringServer::Ring::run(const std::atomic<bool> &running)
+{
+    this->submitAccept();
+
+    while (running)
+    {
+        io_uring_submit(&this->ring);
+
+        io_uring_cqe        *cqe = nullptr;
+        __kernel_timespec   timeout = { 0, 100 * 1000 * 1000 };
+
+        int error = io_uring_wait_cqe_timeout(&this->ring, &cqe, &timeout);
+        if (error < 0 && error != -ETIME && error != -EINTR)
+        {
+            std::cerr << "io_uring wait failed: " << std::strerror(-error) << std::endl;
+            break;
+        }
+
+        unsigned int head;
+        unsigned int count = 0;
+
+        io_uring_for_each_cqe(&this->ring, head, cqe)
+        {
+            ++count;
+
+            __u64           data = io_uring_cqe_get_data64(cqe);
+            unsigned int    slot = static_cast<unsigned int>(data >> 2);
+
+            switch (static_cast<Operation>(data & 3))
+            {
+                case Accept:
+                    this->onAccept(cqe->res);
+                    break;
+                case Read:
+                    this->onRead(slot, cqe->res);
+                    break;
+                case Write:
+                    this->onWrite(slot, cqe->res);
+                    break;
+                case Close:
+                    this->onClose(slot);
+                    break;
+            }
+        }
+        io_uring_cq_advance(&this->ring, count);
+    }
+}
+
+io_uring_sqe    *UringServer::Ring::nextSqe()
+{
+    io_uring_sqe *sqe = io_uring_get_sqe(&this->ring);
+
+    while (sqe == nullptr)
+    {
+        io_uring_submit(&this->ring);
+        sqe = io_uring_get_sqe(&this->ring);
+    }
+    return sqe;
+}
+
+void    UringServer::Ring::submitAccept()
+{
+    if (this->acceptPending || this->freeSlots.empty())
+    {
+        return;
+    }
+
+    io_uring_sqe *sqe = this->nextSqe();
+
+    this->acceptLength = sizeof(this->acceptAddress);
+    io_uring_prep_accept(sqe, this->listenFd, reinterpret_cast<sockaddr *>(&this->acceptAddress), &this->acceptLength, SOCK_CLOEXEC);
+    io_uring_sqe_set_data64(sqe, tag(Accept));
+    this->acceptPending = true;
+}
+
+void    UringServer::Ring::submitRead(unsigned int slot)
+{
+    io_uring_sqe *sqe = this->nextSqe();
+    Connection &connection = this->connections[slot];
+
+    if (this->fixedBuffers)
+    {
+        io_uring_prep_read_fixed(sqe, connection.fd, this->buffer(slot), bufferSize, 0, slot);
+    }
+    else
+    {
+        io_uring_prep_recv(sqe, connection.fd, this->buffer(slot), bufferSize, 0);
+    }
+    io_uring_sqe_set_data64(sqe, tag(Read, slot));
+}
+
+void    UringServer::Ring::submitWrite(unsigned int slot)
+{
+    io_uring_sqe *sqe = this->nextSqe();
+    Connection &connection = this->connections[slot];
+    unsigned int remaining = connection.reply.size() - connection.sent;
+
+    // replies fitting in the slot go through the registered buffer, bigger ones are sent as is
+    if (this->fixedBuffers && static_cast<unsigned int>(connection.reply.size()) <= bufferSize)
+    {
+        io_uring_prep_write_fixed(sqe, connection.fd, this->buffer(slot) + connection.sent, remaining, 0, slot);
+    }
+    else
+    {
+        io_uring_prep_send(sqe, connection.fd, connection.reply.constData() + connection.sent, remaining, MSG_NOSIGNAL);
+    }
+    io_uring_sqe_set_data64(sqe, tag(Write, slot));
+}
+
+void    UringServer::Ring::submitClose(unsigned int slot)
+{
+    io_uring_sqe *sqe = this->nextSqe();
+
+    io_uring_prep_close(sqe, this->connections[slot].fd);
+    io_uring_sqe_set_data64(sqe, tag(Close, slot));
+}
+
+void    UringServer::Ring::onAccept(int result)
+{
+    this->acceptPending = false;
+
+    if (result < 0)
+    {
+        std::cerr << "Accept failed: " << std::strerror(-result) << std::endl;
+    }
+    else
+    {
+        unsigned int slot = this->freeSlots.back();
+        this->freeSlots.pop_back();
+
+        Connection &connection = this->connections[slot];
+        connection.fd = result;
+        connection.peer = ntohl(this->acceptAddress.sin_addr.s_addr);
+        connection.sent = 0;
+
+        this->submitRead(slot);
+    }
+
+    this->submitAccept();
+}
+
+void    UringServer::Ring::onRead(unsigned int slot, int result)
+{
+    Connection &connection = this->connections[slot];
+
+    if (result <= 0)
+    {
+        this->submitClose(slot);
+        return;
+    }
+
+    {
+        QTimings::Scope scope(connection.timings);
+
+        QTimings::getShared().start("request");
+        connection.received.append(this->buffer(slot), result);
+        connection.reply = this->server.receiveMessage(connection.peer, connection.received, connection.closing);
+        QTimings::getShared().stop("request");
+
+        if (!connection.reply.isEmpty())
+        {
+            std::cout << QTimings::getShared().getPPTimings() << std::endl;
+        }
+        QTimings::getShared().reset();
+    }
+    connection.sent = 0;
+
+    // a partial binary message, wait for the rest of it
+    if (connection.reply.isEmpty())
+    {
+        this->submitRead(slot);
+        return;
+    }
+
+    if (this->fixedBuffers && static_cast<unsigned int>(connection.reply.size()) <= bufferSize)
+    {
+        std::memcpy(this->buffer(slot), connection.reply.constData(), connection.reply.size());
+    }
+    this->submitWrite(slot);
+}
+
+void    UringServer::Ring::onWrite(unsigned int slot, int result)
+{
+    Connection &connection = this->connections[slot];
+
+    if (result < 0)
+    {
+        std::cerr << "Send failed: " << std::strerror(-result) << std::endl;
+        this->submitClose(slot);
+        return;
+    }
+
+    connection.sent += result;
+    if (connection.sent < static_cast<unsigned int>(connection.reply.size()))
+    {
+        this->submitWrite(slot);
+        return;
+    }
+
+    if (connection.closing)
+    {
+        this->submitClose(slot);
+        return;
+    }
+    // the connection stays open for the next request until the peer closes it
+    this->submitRead(slot);
+}
+
+void    UringServer::Ring::onClose(unsigned int slot)
+{
+    Connection &connection = this->connections[slot];
+
+    connection.fd = -1;
+    connection.received.clear();
+    connection.reply.clear();
+    connection.closing = false;
+    this->freeSlots.push_back(slot);
+
+    this->submitAccept();
+}
+
+UringServer::UringServer(Server &server, short port, int rings, unsigned int connectionsPerRing)
+    : server(server), port(port), ringCount(rings), connectionsPerRing(connectionsPerRing), running(false)
+{}
+
+UringServer::~UringServer()
+{
+    this->stop();
+}
+
+bool    UringServer::start()
+{
+    for (int i = 0; i < this->ringCount; ++i)
+    {
+        std::unique_ptr<Ring> ring(new Ring(this->server, this->connectionsPerRing));
+
+        if (!ring->open(this->port))
+        {
+            this->rings.clear();
+            return false;
+        }
+        this->rings.push_back(std::move(ring));
+    }
+
+    this->running = true;
+    for (auto &ring : this->rings)
+    {
+        Ring *current = ring.get();
+        this->threads.emplace_back([this, current]() { current->run(this->running); });
+    }
+    return true;
+}
+
+void    UringServer::stop()
+{
+    this->running = false;
+    for (std::thread &thread : this->threads)
+    {
+        thread.join();
+    }
+    this->threads.clear();
+    this->rings.clear();
+}
@@ -1,12 +1,50 @@
 #include <iostream>
+#include <QCoreApplication>
+#include <QCommandLineParser>
 #include "Server.h"
+#include "MetricsServer.hpp"
+#include "Trace.hpp"
 
-int main()
+int main(int argc, char **argv)
 {
+    QCoreApplication app(argc, argv);
+    QCommandLineParser parser;
+    QCommandLineOption uringOption("io-uring", "Serve connections from <rings> io_uring rings instead of QTcpServer (Linux only).", "rings");
+
+    QCommandLineOption metricsOption("metrics-port", "Serve Prometheus metrics at http://127.0.0.1:<port>/metrics (default: off).", "port");
+    QCommandLineOption registryOption("registry-capacity", "Gateways the registry holds before it has to grow (default: 0, grows as they register).", "count", "0");
+    QCommandLineOption fileOption("registry-file", "Keep the registered Gateways in <path>, replayed at startup (default: memory only).", "path");
+
+    parser.addHelpOption();
+    parser.addOption(uringOption);
+    parser.addOption(metricsOption);
+    parser.addOption(registryOption);
+    parser.addOption(fileOption);
+    parser.process(app);
+
     std::cout << "Hello world!" << std::endl;
 
+    Trace::setProcess("server");
+
     Server serv(3874);
 
+    if (parser.isSet(uringOption))
+    {
+        serv.setUringRings(parser.value(uringOption).toInt());
+    }
+    serv.setRegistryCapacity(parser.value(registryOption).toULongLong());
+    if (parser.isSet(fileOption) && !serv.openRegistryFile(parser.value(fileOption).toStdString()))
+    {
+        return 1;
+    }
+
+    MetricsServer metrics;
+
+    if (parser.isSet(metricsOption) && !metrics.start(parser.value(metricsOption).toUShort()))
+    {
+        return 1;
+    }
+
     serv.runServer();
 
     return 0;
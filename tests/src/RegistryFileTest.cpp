@@ -0,0 +1,232 @@
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include "DeviceRegistry.hpp"
+#include "RegistryFile.hpp"
+
+/*
+    Writes, damages and compacts a registry file, checking what a DeviceRegistry holds once the
+    file was replayed into it. Takes the path of the file to use, which is overwritten.
+*/
+namespace
+{
+    int         failures = 0;
+    std::string path;
+
+    void    check(bool condition, const char *what, int line)
+    {
+        if (!condition)
+        {
+            std::cerr << "line " << line << ": " << what << " failed" << std::endl;
+            ++failures;
+        }
+    }
+
+    #define CHECK(condition)    check((condition), #condition, __LINE__)
+
+    Digest  digest(const std::string &text)
+    {
+        Digest  result;
+
+        Digest::fromHex(text.data(), text.size(), result);
+        return result;
+    }
+
+    // the registry and the file it is recorded to, as the Gateway and the Server hold them
+    struct Recorded
+    {
+        DeviceRegistry  registry;
+        RegistryFile    file;
+        bool            opened;
+
+        Recorded() : file(registry), opened(file.open(QString::fromStdString(path))) {}
+
+        void    insert(const std::string &id, const std::string &hex, quint32 ip)
+        {
+            this->registry.insert(id, digest(hex), ip);
+            this->file.append(id, digest(hex), ip);
+        }
+    };
+
+    // the end of the last record, from the header
+    std::uint64_t   recordsEnd()
+    {
+        std::ifstream   in(path, std::ios::binary);
+        unsigned char   bytes[8] = {};
+        std::uint64_t   end = 0;
+
+        in.seekg(8);
+        in.read(reinterpret_cast<char *>(bytes), sizeof(bytes));
+        for (int i = 7; i >= 0; --i)
+        {
+            end = (end << 8) | bytes[i];
+        }
+        return end;
+    }
+
+    std::uint64_t   fileSize()
+    {
+        std::ifstream   in(path, std::ios::binary | std::ios::ate);
+
+        return static_cast<std::uint64_t>(in.tellg());
+    }
+
+    void    testReplay()
+    {
+        std::remove(path.c_str());
+        {
+            Recorded    recorded;
+
+            CHECK(recorded.opened);
+            recorded.insert("reader0", "a0a0", 0x0a000001);
+            recorded.insert("reader1", "a1a1", 0x0a000002);
+            recorded.insert("unbound", "b0b0", 0);
+            recorded.file.setState("gateway.verifier", std::string(300, '7'));
+        }
+
+        Recorded    replayed;
+
+        CHECK(replayed.opened);
+        CHECK(replayed.registry.size() == 3);
+        CHECK(replayed.registry.find("reader0", 0x0a000001).hex() == "a0a0");
+        CHECK(replayed.registry.find("reader0", 0x0a000002).empty());
+        CHECK(replayed.registry.findByAddress(0x0a000002).hex() == "a1a1");
+        CHECK(replayed.registry.find("unbound", 0).hex() == "b0b0");
+        CHECK(replayed.file.state("gateway.verifier") == std::string(300, '7'));
+        CHECK(replayed.file.state("gateway.myRandom").empty());
+    }
+
+    // more records than the first mapping holds, the file is mapped again larger
+    void    testGrowth()
+    {
+        const int           count = 40000;
+        const std::string   hex(64, 'e');
+
+        std::remove(path.c_str());
+        {
+            Recorded    recorded;
+
+            CHECK(recorded.opened);
+            for (int i = 0; i < count; ++i)
+            {
+                recorded.insert("reader" + std::to_string(i), hex, 0x0a000000 + i);
+            }
+        }
+        CHECK(recordsEnd() > (1 << 20));
+        CHECK(fileSize() >= recordsEnd());
+
+        Recorded    replayed;
+
+        CHECK(replayed.registry.size() == count);
+        CHECK(replayed.registry.find("reader0", 0x0a000000).hex() == hex);
+        CHECK(replayed.registry.find("reader" + std::to_string(count - 1), 0x0a000000 + count - 1).hex() == hex);
+        CHECK(replayed.registry.findByAddress(0x0a000000 + count / 2).hex() == hex);
+    }
+
+    // a record torn by a crash ends the replay, the next one is written in its place
+    void    testTornRecord()
+    {
+        std::remove(path.c_str());
+        {
+            Recorded    recorded;
+
+            recorded.insert("reader0", "a0a0", 1);
+            recorded.insert("reader1", "a1a1", 2);
+        }
+
+        std::uint64_t   end = recordsEnd();
+        {
+            std::fstream    io(path, std::ios::binary | std::ios::in | std::ios::out);
+
+            io.seekp(static_cast<std::streamoff>(end - 1));
+            io.put('\xff');
+        }
+        {
+            Recorded    replayed;
+
+            CHECK(replayed.opened);
+            CHECK(replayed.registry.size() == 1);
+            CHECK(replayed.registry.find("reader0", 1).hex() == "a0a0");
+            CHECK(replayed.registry.find("reader1", 2).empty());
+            CHECK(recordsEnd() < end);
+            replayed.insert("reader2", "a2a2", 3);
+        }
+
+        Recorded    replayed;
+
+        CHECK(replayed.registry.size() == 2);
+        CHECK(replayed.registry.find("reader2", 3).hex() == "a2a2");
+    }
+
+    // compaction keeps the last digest of each device and the device each address resolves to, or
+    // that it resolves to none
+    void    testCompaction()
+    {
+        std::remove(path.c_str());
+        {
+            Recorded    recorded;
+
+            for (int i = 0; i < 10000; ++i)
+            {
+                recorded.insert("moving", (i % 2 == 0) ? "c0c0" : "c1c1", 0x0a000100 + i % 7);
+            }
+            // behind a NAT the address resolves to the last one registered, which is not the last in id order
+            recorded.insert("nat2", "d2d2", 0x0a000200);
+            recorded.insert("nat0", "d0d0", 0x0a000200);
+            recorded.insert("nat1", "d1d1", 0x0a000200);
+            recorded.insert("nat0", "d3d3", 0x0a000200);
+            // the address stays bound to a device that moved, a device left behind does not take it over
+            recorded.insert("left", "f0f0", 0x0a000400);
+            recorded.insert("moved", "f1f1", 0x0a000400);
+            recorded.insert("moved", "f2f2", 0x0a000500);
+            recorded.file.setState("gateway.verifier", "1234");
+            recorded.file.setState("gateway.verifier", "5678");
+            CHECK(recorded.registry.findByAddress(0x0a000200).hex() == "d3d3");
+            CHECK(recorded.registry.findByAddress(0x0a000400).empty());
+
+            std::uint64_t   before = recordsEnd();
+
+            CHECK(recorded.file.compact());
+            CHECK(recordsEnd() < before / 100);
+
+            // still recorded after the rewrite
+            recorded.insert("late", "e0e0", 0x0a000300);
+        }
+
+        Recorded    replayed;
+
+        CHECK(replayed.opened);
+        CHECK(replayed.registry.size() == 7);
+        CHECK(replayed.registry.find("moving", 0x0a000100 + 9999 % 7).hex() == "c1c1");
+        CHECK(replayed.registry.findByAddress(0x0a000100 + 9998 % 7).empty());
+        CHECK(replayed.registry.findByAddress(0x0a000200).hex() == "d3d3");
+        CHECK(replayed.registry.find("nat1", 0x0a000200).hex() == "d1d1");
+        CHECK(replayed.registry.find("nat2", 0x0a000200).hex() == "d2d2");
+        CHECK(replayed.registry.find("late", 0x0a000300).hex() == "e0e0");
+        CHECK(replayed.registry.findByAddress(0x0a000400).empty());
+        CHECK(replayed.registry.find("left", 0x0a000400).hex() == "f0f0");
+        CHECK(replayed.registry.findByAddress(0x0a000500).hex() == "f2f2");
+        CHECK(replayed.file.state("gateway.verifier") == "5678");
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    path = (argc > 1) ? argv[1] : "registry-file-test.bin";
+
+    testReplay();
+    testGrowth();
+    testTornRecord();
+    testCompaction();
+
+    std::remove(path.c_str());
+    if (failures != 0)
+    {
+        std::cerr << failures << " checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "all checks passed" << std::endl;
+    return 0;
+}
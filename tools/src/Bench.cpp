@@ -0,0 +1,456 @@
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+// the templates of FiniteFieldElement.cpp come with it, they are instantiated here for every order below
+#include "CommonUtils.cpp"
+
+/*
+    Microbenchmarks of the primitives in common/: the field arithmetic, the inversions, the curve
+    tables, the point operations and the CommonUtils steps of the protocol, over a sweep of
+    field orders, scalar sizes and input lengths.
+
+    Each benchmark first doubles its iteration count until a run lasts --min-time, then times
+    --repetitions runs of that many iterations and keeps the median. The results are written as
+    JSON; --baseline compares them with an earlier file and fails on the benchmarks that got slower
+    than --threshold percent, so that a regression shows up before the binaries are deployed.
+*/
+
+using namespace Cryptography;
+
+struct Result
+{
+    std::string name;
+    double      median;     // nanoseconds per operation
+    double      min;
+    qint64      iterations; // per repetition
+};
+
+class Bench
+{
+    public:
+        Bench(qint64 minTime, int repetitions, const QString &filter)
+         : minTime(minTime), repetitions(std::max(repetitions, 1)), filter(filter)
+        {}
+
+        // body(n) runs the operation n times, maxIterations bounds the operations that cost memory
+        void    measure(const std::string &name, const std::function<void(qint64)> &body, qint64 maxIterations = qint64(1) << 40)
+        {
+            if (!QString::fromStdString(name).contains(this->filter))
+            {
+                return;
+            }
+
+            qint64  iterations = 1;
+
+            while (elapsed(body, iterations) < this->minTime && iterations < maxIterations)
+            {
+                iterations = std::min(iterations * 2, maxIterations);
+            }
+
+            std::vector<double> perOperation;
+
+            for (int r = 0; r < this->repetitions; ++r)
+            {
+                perOperation.push_back(static_cast<double>(elapsed(body, iterations)) / iterations);
+            }
+            std::sort(perOperation.begin(), perOperation.end());
+
+            Result result = { name, perOperation[perOperation.size() / 2], perOperation.front(), iterations };
+
+            std::cerr << std::left << std::setw(32) << name << std::right << std::fixed << std::setprecision(1)
+                      << std::setw(14) << result.median << " ns" << std::setw(14) << result.min << " ns" << std::endl;
+            this->results.push_back(result);
+        }
+
+        std::vector<Result> results;
+
+    private:
+        static qint64   elapsed(const std::function<void(qint64)> &body, qint64 iterations)
+        {
+            auto started = std::chrono::steady_clock::now();
+            body(iterations);
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - started).count();
+        }
+
+        qint64  minTime;        // nanoseconds
+        int     repetitions;
+        QString filter;
+};
+
+// keeps the compiler from hoisting an operation out of its loop or dropping its result
+template<typename T>
+static  void    keep(T &value)
+{
+    asm volatile("" : : "g"(&value) : "memory");
+}
+
+class BenchUtils : public CommonUtils
+{
+    public:
+        // the curve of the protocol
+        BenchUtils() : CommonUtils(16, 80) {}
+
+        using CommonUtils::newRandom;
+        using CommonUtils::hash;
+        using CommonUtils::applyXOr;
+        using CommonUtils::scalarMul;
+
+    protected:
+        std::string getMyId() const override { return "scae-bench"; }
+};
+
+// size characters of hexadecimal digits, what the protocol hashes, xors and multiplies
+static  std::string hexText(std::size_t size)
+{
+    static const char   digits[] = "0123456789abcdef";
+    std::string         text(size, '0');
+
+    for (std::size_t i = 0; i < size; ++i)
+    {
+        text[i] = digits[(i * 7 + 3) % 16];
+    }
+    return text;
+}
+
+template<int P>
+static  void    benchField(Bench &bench)
+{
+    typedef FiniteFieldElement<P>   ffe_t;
+
+    std::string order = std::to_string(P);
+    ffe_t       y(P / 3 + 1);
+
+    // each operation takes the result of the previous one, these are latencies
+    bench.measure("ffe_add/" + order, [&](qint64 n) {
+        ffe_t acc(1);
+        for (qint64 i = 0; i < n; ++i) { acc = acc + y; }
+        keep(acc);
+    });
+    bench.measure("ffe_mul/" + order, [&](qint64 n) {
+        ffe_t acc(1);
+        for (qint64 i = 0; i < n; ++i) { acc = acc * y; }
+        keep(acc);
+    });
+    bench.measure("ffe_div/" + order, [&](qint64 n) {
+        ffe_t acc(1);
+        for (qint64 i = 0; i < n; ++i) { acc = acc / y; }
+        keep(acc);
+    });
+    bench.measure("inv_mod/" + order, [](qint64 n) {
+        int x = 1;
+        int sum = 0;
+        for (qint64 i = 0; i < n; ++i)
+        {
+            sum += detail::InvMod(x, P);
+            x = (x == P - 1) ? 1 : x + 1;
+        }
+        keep(sum);
+    });
+    bench.measure("binary_inv_mod/" + order, [](qint64 n) {
+        int x = 1;
+        int sum = 0;
+        for (qint64 i = 0; i < n; ++i)
+        {
+            sum += detail::BinaryInvMod(x, P);
+            x = (x == P - 1) ? 1 : x + 1;
+        }
+        keep(sum);
+    });
+}
+
+template<int P>
+static  void    benchCurve(Bench &bench)
+{
+    typedef EllipticCurve<P>            ec_t;
+    typedef typename ec_t::Point        point_t;
+
+    std::string order = std::to_string(P);
+    int         b = 80;
+
+    // a table is computed once per process for given a and b, each call takes the next b to compute
+    // a new one. They are all kept, hence the bound on the iterations
+    bench.measure("calculate_points/" + order, [&b](qint64 n) {
+        for (qint64 i = 0; i < n; ++i)
+        {
+            ec_t curve(16, ++b);
+            curve.CalculatePoints();
+            std::size_t size = curve.Size();
+            keep(size);
+        }
+    }, 16);
+
+    ec_t    curve(16, 80);
+
+    curve.CalculatePoints();
+    if (curve.Size() < 3)
+    {
+        std::cerr << "The curve over F_" << P << " has too few points" << std::endl;
+        return;
+    }
+
+    point_t p = curve[static_cast<int>(curve.Size() / 3)];
+    point_t q = curve[static_cast<int>(2 * curve.Size() / 3)];
+
+    bench.measure("point_add/" + order, [&](qint64 n) {
+        for (qint64 i = 0; i < n; ++i)
+        {
+            point_t r = p + q;
+            keep(r);
+        }
+    });
+    bench.measure("point_double/" + order, [&](qint64 n) {
+        for (qint64 i = 0; i < n; ++i)
+        {
+            point_t r = p + p;
+            keep(r);
+        }
+    });
+    for (int bits : { 8, 16, 30 })
+    {
+        // the top bit and every other bit below it set
+        int k = (1 << (bits - 1)) | (0x2AAAAAAA & ((1 << bits) - 1));
+        std::string suffix = order + "/" + std::to_string(bits);
+
+        bench.measure("point_multiply/" + suffix, [&](qint64 n) {
+            for (qint64 i = 0; i < n; ++i)
+            {
+                point_t r = p.binaryMultiplied(k);
+                keep(r);
+            }
+        });
+        bench.measure("point_multiply_naf4/" + suffix, [&](qint64 n) {
+            for (qint64 i = 0; i < n; ++i)
+            {
+                point_t r = p.windowMultiplied(k, 4);
+                keep(r);
+            }
+        });
+    }
+}
+
+static  void    benchCommonUtils(Bench &bench)
+{
+    BenchUtils  utils;
+
+    bench.measure("new_random", [&](qint64 n) {
+        for (qint64 i = 0; i < n; ++i)
+        {
+            std::string r = utils.newRandom();
+            keep(r);
+        }
+    });
+    for (HashBackend::Algorithm algorithm : { HashBackend::Algorithm::Md5, HashBackend::Algorithm::Sha256, HashBackend::Algorithm::Blake3 })
+    {
+        for (std::size_t size : { 16, 64, 256, 1024, 4096 })
+        {
+            std::string text = hexText(size);
+
+            bench.measure(std::string("hash/") + HashBackend::name(algorithm) + "/" + std::to_string(size), [&](qint64 n) {
+                for (qint64 i = 0; i < n; ++i)
+                {
+                    Digest r = utils.hash(text, "", algorithm);
+                    keep(r);
+                }
+            });
+        }
+    }
+    for (std::size_t size : { 16, 64, 256, 1024, 4096 })
+    {
+        std::string a = hexText(size);
+        std::string b = hexText(size + 5).substr(5);
+
+        bench.measure("xor/" + std::to_string(size), [&](qint64 n) {
+            for (qint64 i = 0; i < n; ++i)
+            {
+                std::string r = utils.applyXOr(a, b);
+                keep(r);
+            }
+        });
+    }
+    // a digest is XORed as its hexadecimal text, written on the stack
+    for (HashBackend::Algorithm algorithm : { HashBackend::Algorithm::Md5, HashBackend::Algorithm::Sha256 })
+    {
+        Digest      digest = utils.hash("scae-bench", "", algorithm);
+        std::string text = hexText(2 * digest.size());
+
+        bench.measure(std::string("xor_digest/") + HashBackend::name(algorithm), [&](qint64 n) {
+            for (qint64 i = 0; i < n; ++i)
+            {
+                std::string r = utils.applyXOr(text, digest);
+                keep(r);
+            }
+        });
+    }
+    // the protocol multiplies hex digests, 32 digits for md5 and 64 for sha256 and blake3
+    for (std::size_t size : { 8, 32, 64 })
+    {
+        std::string text = hexText(size);
+
+        bench.measure("scalar_mul/" + std::to_string(size), [&](qint64 n) {
+            for (qint64 i = 0; i < n; ++i)
+            {
+                std::string r = utils.scalarMul(text, 126);
+                keep(r);
+            }
+        });
+    }
+}
+
+static  QJsonObject toJson(const Bench &bench, const QJsonObject &context)
+{
+    QJsonArray  benchmarks;
+
+    for (const Result &result : bench.results)
+    {
+        QJsonObject benchmark;
+        benchmark.insert("name", QString::fromStdString(result.name));
+        benchmark.insert("ns_per_op", result.median);
+        benchmark.insert("min_ns_per_op", result.min);
+        benchmark.insert("iterations", static_cast<double>(result.iterations));
+        benchmarks.append(benchmark);
+    }
+
+    QJsonObject document;
+    document.insert("context", context);
+    document.insert("benchmarks", benchmarks);
+    return document;
+}
+
+// the benchmarks slower than the baseline by more than threshold percent, all of them are listed
+static  int     compare(const Bench &bench, const QString &path, double threshold)
+{
+    QFile   file(path);
+
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        std::cerr << "Could not open " << path.toStdString() << std::endl;
+        return -1;
+    }
+
+    QJsonDocument   document = QJsonDocument::fromJson(file.readAll());
+
+    if (!document.isObject())
+    {
+        std::cerr << path.toStdString() << " is not a scae-bench file" << std::endl;
+        return -1;
+    }
+
+    std::map<std::string, double>   baseline;
+
+    for (const QJsonValue &value : document.object().value("benchmarks").toArray())
+    {
+        QJsonObject benchmark = value.toObject();
+        baseline[benchmark.value("name").toString().toStdString()] = benchmark.value("ns_per_op").toDouble();
+    }
+
+    int regressions = 0;
+
+    std::cerr << std::endl << std::left << std::setw(32) << "benchmark" << std::right
+              << std::setw(14) << "baseline ns" << std::setw(14) << "current ns" << std::setw(10) << "change" << std::endl;
+    for (const Result &result : bench.results)
+    {
+        auto found = baseline.find(result.name);
+
+        std::cerr << std::left << std::setw(32) << result.name << std::right << std::fixed << std::setprecision(1);
+        if (found == baseline.end() || found->second <= 0)
+        {
+            std::cerr << std::setw(14) << "-" << std::setw(14) << result.median << std::setw(10) << "new" << std::endl;
+            continue;
+        }
+
+        double  change = (result.median / found->second - 1) * 100;
+        bool    regressed = change > threshold;
+
+        std::cerr << std::setw(14) << found->second << std::setw(14) << result.median
+                  << std::setw(9) << std::showpos << change << std::noshowpos << "%" << (regressed ? "  REGRESSION" : "") << std::endl;
+        if (regressed)
+        {
+            ++regressions;
+        }
+    }
+    return regressions;
+}
+
+int main(int argc, char **argv)
+{
+    QCoreApplication    app(argc, argv);
+    QCommandLineParser  parser;
+    QCommandLineOption  outputOption("output", "Write the results to <file> rather than to the standard output.", "file");
+    QCommandLineOption  baselineOption("baseline", "Compare the results with an earlier output and fail on regressions.", "file");
+    QCommandLineOption  thresholdOption("threshold", "Percentage by which a benchmark may be slower than the baseline (default: 10).", "percent", "10");
+    QCommandLineOption  filterOption("filter", "Only run the benchmarks whose name contains <text>.", "text");
+    QCommandLineOption  minTimeOption("min-time", "Duration of each timed run in milliseconds (default: 100).", "ms", "100");
+    QCommandLineOption  repetitionsOption("repetitions", "Timed runs per benchmark, the median is kept (default: 5).", "count", "5");
+
+    parser.setApplicationDescription("Microbenchmarks of the finite field, elliptic curve and CommonUtils primitives.");
+    parser.addHelpOption();
+    parser.addOption(outputOption);
+    parser.addOption(baselineOption);
+    parser.addOption(thresholdOption);
+    parser.addOption(filterOption);
+    parser.addOption(minTimeOption);
+    parser.addOption(repetitionsOption);
+    parser.process(app);
+
+    Bench   bench(static_cast<qint64>(parser.value(minTimeOption).toDouble() * 1000000), parser.value(repetitionsOption).toInt(), parser.value(filterOption));
+
+    // the order of the protocol, then larger ones up to the limit of the int products of FiniteFieldElement
+    benchField<263>(bench);
+    benchField<2003>(bench);
+    benchField<32003>(bench);
+    benchCurve<263>(bench);
+    benchCurve<2003>(bench);
+    benchCurve<32003>(bench);
+    benchCommonUtils(bench);
+
+    QJsonObject context;
+    context.insert("hash_md5", HashBackend::implementation(HashBackend::Algorithm::Md5));
+    context.insert("hash_sha256", HashBackend::implementation(HashBackend::Algorithm::Sha256));
+    context.insert("hash_blake3", HashBackend::implementation(HashBackend::Algorithm::Blake3));
+    context.insert("xor", XorKernel::path());
+    context.insert("repetitions", parser.value(repetitionsOption).toInt());
+    context.insert("min_time_ms", parser.value(minTimeOption).toDouble());
+
+    QByteArray  json = QJsonDocument(toJson(bench, context)).toJson();
+
+    if (parser.isSet(outputOption))
+    {
+        QFile   file(parser.value(outputOption));
+
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate) || file.write(json) < 0)
+        {
+            std::cerr << "Could not write " << parser.value(outputOption).toStdString() << std::endl;
+            return 1;
+        }
+    }
+    else
+    {
+        std::cout << json.constData() << std::flush;
+    }
+
+    if (parser.isSet(baselineOption))
+    {
+        int regressions = compare(bench, parser.value(baselineOption), parser.value(thresholdOption).toDouble());
+
+        if (regressions != 0)
+        {
+            if (regressions > 0)
+            {
+                std::cerr << regressions << " benchmarks slower than the baseline by more than " << parser.value(thresholdOption).toStdString() << "%" << std::endl;
+            }
+            return 1;
+        }
+    }
+    return 0;
+}
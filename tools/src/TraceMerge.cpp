@@ -0,0 +1,296 @@
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+/*
+    Merges the trace files the Client, the Gateway and the Server write with SCAE_TRACE (see
+    common/Trace.hpp) and shows where one login spent its time.
+
+    Without --trace it lists the slowest traces found. With --trace it prints the spans of that
+    login nested across the three tiers, marks its critical path and sums the time each process
+    spent on it; --output writes the spans of the trace as a single Chrome trace event file.
+
+    The spans are placed with the wall clock of each process, the tiers of different hosts
+    line up only as well as their clocks do.
+*/
+
+struct Span
+{
+    std::string name;
+    std::string process;
+    qint64      begin;      // nanoseconds
+    qint64      end;
+    QJsonObject event;
+
+    std::vector<Span *> children;
+    qint64              self = 0;
+    bool                critical = false;
+};
+
+// a file whose process was stopped before it could close the JSON array is still read
+static  bool    readEvents(const QString &path, QJsonArray &events)
+{
+    QFile   file(path);
+
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        std::cerr << "Could not open " << path.toStdString() << std::endl;
+        return false;
+    }
+
+    QByteArray      content = file.readAll().trimmed();
+    QJsonDocument   document = QJsonDocument::fromJson(content);
+
+    if (!document.isArray())
+    {
+        while (content.endsWith(',') || content.endsWith('\n'))
+        {
+            content.chop(1);
+        }
+        document = QJsonDocument::fromJson(content + "\n]");
+    }
+    if (!document.isArray())
+    {
+        std::cerr << path.toStdString() << " is not a trace event file" << std::endl;
+        return false;
+    }
+    for (const QJsonValue &event : document.array())
+    {
+        events.append(event);
+    }
+    return true;
+}
+
+// the latest ending child first, then going back the ones that end before the next one starts
+static  void    markCritical(Span *span)
+{
+    span->critical = true;
+
+    qint64  before = span->end;
+    std::vector<Span *> children = span->children;
+
+    std::sort(children.begin(), children.end(), [](const Span *a, const Span *b) { return a->end > b->end; });
+    for (Span *child : children)
+    {
+        if (child->end <= before)
+        {
+            markCritical(child);
+            before = child->begin;
+        }
+    }
+}
+
+static  void    print(const Span *span, qint64 origin, int depth)
+{
+    std::cout << (span->critical ? " * " : "   ")
+              << std::setw(10) << (span->begin - origin) / 1000000.0
+              << std::setw(10) << (span->end - span->begin) / 1000000.0
+              << std::setw(10) << span->self / 1000000.0 << "  "
+              << std::setw(8) << std::left << span->process << std::right << "  "
+              << std::string(2 * depth, ' ') << span->name << std::endl;
+    for (const Span *child : span->children)
+    {
+        print(child, origin, depth + 1);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    QCoreApplication    app(argc, argv);
+    QCommandLineParser  parser;
+    QCommandLineOption  traceOption("trace", "Trace id of the login to show, the slowest traces are listed without it.", "id");
+    QCommandLineOption  outputOption("output", "Write the spans of the trace to <file>, for chrome://tracing or Perfetto.", "file");
+    QCommandLineOption  topOption("top", "Number of traces listed without --trace (default: 20).", "count", "20");
+
+    parser.setApplicationDescription("Merges the SCAE_TRACE files of the Client, the Gateway and the Server.");
+    parser.addHelpOption();
+    parser.addOption(traceOption);
+    parser.addOption(outputOption);
+    parser.addOption(topOption);
+    parser.addPositionalArgument("files", "Trace files written by the processes.", "files...");
+    parser.process(app);
+
+    QJsonArray  events;
+
+    for (const QString &path : parser.positionalArguments())
+    {
+        if (!readEvents(path, events))
+        {
+            return 1;
+        }
+    }
+
+    std::map<qint64, std::string>               processes;
+    std::map<std::string, std::vector<Span>>    traces;
+    std::vector<QJsonObject>                    metadata;
+
+    for (const QJsonValue &value : events)
+    {
+        QJsonObject event = value.toObject();
+        qint64      pid = static_cast<qint64>(event.value("pid").toDouble());
+
+        if (event.value("ph").toString() == "M")
+        {
+            if (event.value("name").toString() == "process_name")
+            {
+                processes[pid] = event.value("args").toObject().value("name").toString().toStdString();
+            }
+            metadata.push_back(event);
+            continue;
+        }
+
+        std::string trace = event.value("args").toObject().value("trace").toString().toStdString();
+        if (event.value("ph").toString() != "X" || trace.empty())
+        {
+            continue;
+        }
+
+        Span    span;
+        span.name = event.value("name").toString().toStdString();
+        span.begin = static_cast<qint64>(event.value("ts").toDouble() * 1000);
+        span.end = span.begin + static_cast<qint64>(event.value("dur").toDouble() * 1000);
+        span.event = event;
+        traces[trace].push_back(span);
+    }
+
+    if (!parser.isSet(traceOption))
+    {
+        std::vector<std::pair<qint64, std::string>> durations;
+
+        for (const auto &entry : traces)
+        {
+            qint64 begin = entry.second.front().begin;
+            qint64 end = entry.second.front().end;
+            for (const Span &span : entry.second)
+            {
+                begin = std::min(begin, span.begin);
+                end = std::max(end, span.end);
+            }
+            durations.emplace_back(end - begin, entry.first);
+        }
+        std::sort(durations.rbegin(), durations.rend());
+
+        std::cout << durations.size() << " traces, the slowest (ms):" << std::endl;
+        for (std::size_t i = 0; i < durations.size() && i < static_cast<std::size_t>(parser.value(topOption).toInt()); ++i)
+        {
+            std::cout << "  " << durations[i].second << std::setw(12) << durations[i].first / 1000000.0 << std::endl;
+        }
+        return 0;
+    }
+
+    std::string trace = parser.value(traceOption).toStdString();
+    auto        found = traces.find(trace);
+
+    if (found == traces.end())
+    {
+        std::cerr << "No span of trace " << trace << std::endl;
+        return 1;
+    }
+
+    std::vector<Span>   &spans = found->second;
+
+    for (Span &span : spans)
+    {
+        auto process = processes.find(static_cast<qint64>(span.event.value("pid").toDouble()));
+        span.process = (process != processes.end()) ? process->second : "?";
+    }
+
+    // outer spans first, a span is the child of the innermost one that still covers it.
+    // ts, microseconds since the epoch in a double, is only precise to a fraction of a microsecond, hence the slack
+    std::sort(spans.begin(), spans.end(), [](const Span &a, const Span &b) {
+        return (a.begin != b.begin) ? a.begin < b.begin : a.end > b.end;
+    });
+
+    std::vector<Span *> roots;
+    std::vector<Span *> open;
+
+    for (Span &span : spans)
+    {
+        while (!open.empty() && span.end > open.back()->end + 1000)
+        {
+            open.pop_back();
+        }
+        (open.empty() ? roots : open.back()->children).push_back(&span);
+        open.push_back(&span);
+    }
+
+    for (Span &span : spans)
+    {
+        qint64 covered = 0;
+        for (const Span *child : span.children)
+        {
+            covered += std::min(child->end, span.end) - std::max(child->begin, span.begin);
+        }
+        span.self = std::max<qint64>(span.end - span.begin - covered, 0);
+    }
+
+    qint64  origin = roots.front()->begin;
+    qint64  end = origin;
+
+    for (Span *root : roots)
+    {
+        end = std::max(end, root->end);
+    }
+    for (Span *root : roots)
+    {
+        if (root->end == end)
+        {
+            markCritical(root);
+        }
+    }
+
+    std::cout << "Trace " << trace << ": " << (end - origin) / 1000000.0 << " ms end to end" << std::endl;
+    std::cout << std::fixed << std::setprecision(3)
+              << "   " << std::setw(10) << "start ms" << std::setw(10) << "total" << std::setw(10) << "self" << "  process   step" << std::endl;
+    for (const Span *root : roots)
+    {
+        print(root, origin, 0);
+    }
+
+    // what is left of a span once its children are taken out is time spent by its own process,
+    // or on the network when the children belong to another one
+    std::map<std::string, qint64>   spent;
+
+    for (const Span &span : spans)
+    {
+        if (span.critical)
+        {
+            spent[span.process] += span.self;
+        }
+    }
+    std::cout << "Critical path (*) by process:" << std::endl;
+    for (const auto &entry : spent)
+    {
+        std::cout << "  " << std::setw(8) << std::left << entry.first << std::right << std::setw(10) << entry.second / 1000000.0 << " ms" << std::endl;
+    }
+
+    if (parser.isSet(outputOption))
+    {
+        QJsonArray  merged;
+        QFile       file(parser.value(outputOption));
+
+        for (const QJsonObject &event : metadata)
+        {
+            merged.append(event);
+        }
+        for (const Span &span : spans)
+        {
+            merged.append(span.event);
+        }
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate) || file.write(QJsonDocument(merged).toJson()) < 0)
+        {
+            std::cerr << "Could not write " << parser.value(outputOption).toStdString() << std::endl;
+            return 1;
+        }
+    }
+    return 0;
+}